@@ -34,12 +34,14 @@ void ECS::register_relations() {
 		{ Relation::InRegion, Scope::Region }, // Province/area in a region
 		{ Relation::ProvinceIn, Scope::Province }, // Province in a region/area
 		{ Relation::Border, Scope::None },
-		{ Relation::Adjacency, Scope::None },
 		{ Relation::AdjacencyTo, Scope::Province },
 		{ Relation::AdjacencyFrom, Scope::Province },
+		{ Relation::Location, Scope::Province }, // Unit in a province
 	};
 	// clang-format on
 
+	// The world is reset when a map is loaded again, the old relationship entities are gone with it.
+	relations.clear();
 	for (int i = 0; i < int(Relation::RELATION_MAX); ++i) {
 		const Scope scope = relation_scopes[Relation(i)];
 		RelationEntity relation_entity;
@@ -67,6 +69,7 @@ void ECS::register_scopes() {
 		"unit"
 	};
 	// clang-format on
+	scopes.clear();
 	for (int i = 0; i < int(Scope::None); ++i)
 		scopes.push_back(entity(scope_names[i]));
 }
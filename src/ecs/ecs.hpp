@@ -15,14 +15,14 @@ enum class Relation : uint8_t {
 	Capital,
 	Owner,
 	Unit,
-	Province,
+	Province, // Not added to countries, Map::get_country_provinces() has the provinces of a country
 	InArea,
 	InRegion,
 	ProvinceIn,
 	Border,
-	Adjacency, // province entity -> adjacency entity
 	AdjacencyTo,
 	AdjacencyFrom,
+	Location, // unit entity -> province entity the unit is in
 	RELATION_MAX
 };
 
@@ -0,0 +1,148 @@
+#include "ClusterGraph.hpp"
+
+#include <limits>
+
+using namespace CG;
+
+void ClusterGraph::build(const ProvinceGraph &p_graph, const Vec<Node> &p_node_clusters, uint32_t p_cluster_count) {
+	clear();
+
+	constexpr int domain_count = int(MovementDomain::MOVEMENT_DOMAIN_MAX);
+
+	Vec<uint32_t> cluster_sizes;
+	positions.resize(p_cluster_count);
+	cluster_sizes.resize(p_cluster_count);
+	for (uint32_t i = 0; i < p_cluster_count; ++i) {
+		positions[i] = Vector2();
+		cluster_sizes[i] = 0;
+	}
+
+	for (Node node = 0; node < p_graph.get_node_count(); ++node) {
+		const Node cluster = p_node_clusters[node];
+		if (cluster == INVALID_NODE)
+			continue;
+
+		positions[cluster] += p_graph.get_position(node);
+		cluster_sizes[cluster]++;
+	}
+
+	for (uint32_t i = 0; i < p_cluster_count; ++i)
+		if (cluster_sizes[i] > 0)
+			positions[i] /= float(cluster_sizes[i]);
+
+	// Every pair of clusters that share a province edge gets a cluster edge, even if no domain can use it yet, so unblocking a province never has to add edges.
+	struct PendingEdge {
+		Node from = INVALID_NODE;
+		Node to = INVALID_NODE;
+		uint32_t links[domain_count]{};
+	};
+
+	Vec<PendingEdge> pending_edges;
+	AHashMap<uint64_t, uint32_t> pending_lookup;
+
+	for (Node node = 0; node < p_graph.get_node_count(); ++node) {
+		const Node from_cluster = p_node_clusters[node];
+		if (from_cluster == INVALID_NODE)
+			continue;
+
+		for (uint32_t edge = p_graph.get_edge_begin(node); edge < p_graph.get_edge_end(node); ++edge) {
+			const Node to_cluster = p_node_clusters[p_graph.get_edge_target(edge)];
+			if (to_cluster == INVALID_NODE or to_cluster == from_cluster)
+				continue;
+
+			const uint64_t key = _get_edge_key(from_cluster, to_cluster);
+			uint32_t *pending_index = pending_lookup.getptr(key);
+			if (pending_index == nullptr) {
+				pending_lookup.insert(key, pending_edges.size());
+				pending_edges.push_back({ from_cluster, to_cluster });
+				pending_index = pending_lookup.getptr(key);
+			}
+
+			for (int domain = 0; domain < domain_count; ++domain)
+				if (_is_link(p_graph, edge, node, MovementDomain(domain)))
+					pending_edges[*pending_index].links[domain]++;
+		}
+	}
+
+	edge_offsets.resize(p_cluster_count + 1);
+	for (uint32_t i = 0; i <= p_cluster_count; ++i)
+		edge_offsets[i] = 0;
+	for (const PendingEdge &pending_edge : pending_edges)
+		edge_offsets[pending_edge.from + 1]++;
+	for (uint32_t i = 0; i < p_cluster_count; ++i)
+		edge_offsets[i + 1] += edge_offsets[i];
+
+	edge_targets.resize(pending_edges.size());
+	for (int domain = 0; domain < domain_count; ++domain) {
+		edge_costs[domain].resize(pending_edges.size());
+		edge_links[domain].resize(pending_edges.size());
+	}
+
+	Vec<uint32_t> next_edge;
+	next_edge.resize(p_cluster_count);
+	for (uint32_t i = 0; i < p_cluster_count; ++i)
+		next_edge[i] = edge_offsets[i];
+
+	for (const PendingEdge &pending_edge : pending_edges) {
+		const uint32_t edge = next_edge[pending_edge.from]++;
+		edge_targets[edge] = pending_edge.to;
+		edge_lookup.insert(_get_edge_key(pending_edge.from, pending_edge.to), edge);
+
+		for (int domain = 0; domain < domain_count; ++domain) {
+			edge_links[domain][edge] = 0;
+			_add_link(pending_edge.from, pending_edge.to, MovementDomain(domain), int(pending_edge.links[domain]));
+		}
+	}
+}
+
+void ClusterGraph::clear() {
+	positions.clear();
+	edge_offsets.clear();
+	edge_targets.clear();
+	for (int domain = 0; domain < int(MovementDomain::MOVEMENT_DOMAIN_MAX); ++domain) {
+		edge_costs[domain].clear();
+		edge_links[domain].clear();
+	}
+	edge_lookup.clear();
+}
+
+void ClusterGraph::update_blocked_province(const ProvinceGraph &p_graph, const Vec<Node> &p_node_clusters, Node p_province) {
+	const Node from_cluster = p_node_clusters[p_province];
+	if (from_cluster == INVALID_NODE)
+		return;
+
+	// Only edges to provinces that aren't blocked themselves changed, the others already weren't links.
+	const int change = p_graph.is_node_blocked(p_province) ? -1 : 1;
+
+	for (uint32_t edge = p_graph.get_edge_begin(p_province); edge < p_graph.get_edge_end(p_province); ++edge) {
+		const Node neighbor = p_graph.get_edge_target(edge);
+		const Node to_cluster = p_node_clusters[neighbor];
+		if (to_cluster == INVALID_NODE or to_cluster == from_cluster or p_graph.is_node_blocked(neighbor))
+			continue;
+
+		for (int domain = 0; domain < int(MovementDomain::MOVEMENT_DOMAIN_MAX); ++domain) {
+			if (p_graph.get_edge_cost(edge, MovementDomain(domain)) == std::numeric_limits<float>::infinity())
+				continue;
+
+			_add_link(from_cluster, to_cluster, MovementDomain(domain), change);
+			_add_link(to_cluster, from_cluster, MovementDomain(domain), change);
+		}
+	}
+}
+
+uint32_t ClusterGraph::get_node_count() const { return positions.size(); }
+
+const Vector2 &ClusterGraph::get_position(Node p_node) const { return positions[p_node]; }
+
+bool ClusterGraph::_is_link(const ProvinceGraph &p_graph, uint32_t p_edge, Node p_from, MovementDomain p_domain) {
+	return p_graph.get_edge_cost(p_edge, p_domain) != std::numeric_limits<float>::infinity() and !p_graph.is_node_blocked(p_from) and !p_graph.is_node_blocked(p_graph.get_edge_target(p_edge));
+}
+
+void ClusterGraph::_add_link(Node p_from, Node p_to, MovementDomain p_domain, int p_count) {
+	const uint32_t *edge = edge_lookup.getptr(_get_edge_key(p_from, p_to));
+	ERR_FAIL_NULL(edge);
+
+	uint32_t &links = edge_links[int(p_domain)][*edge];
+	links = uint32_t(MAX(int(links) + p_count, 0));
+	edge_costs[int(p_domain)][*edge] = links > 0 ? positions[p_from].distance_to(positions[p_to]) : std::numeric_limits<float>::infinity();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ProvinceGraph.hpp"
+
+namespace CG {
+
+// Abstract graph where each node is a cluster of provinces, like an area or a region.
+// Two clusters are connected in a MovementDomain when any province edge between them can be used by that domain. The number of such province edges is kept for every cluster edge so blocking a province only updates the edges around it.
+// Has the same interface as ProvinceGraph so the PathFinder can search it.
+class ClusterGraph {
+public:
+	using Node = ProvinceGraph::Node;
+	static constexpr Node INVALID_NODE = ProvinceGraph::INVALID_NODE;
+
+	// p_node_clusters maps every province node to its cluster or INVALID_NODE.
+	void build(const ProvinceGraph &p_graph, const Vec<Node> &p_node_clusters, uint32_t p_cluster_count);
+	void clear();
+
+	// Call after the province was blocked or unblocked in p_graph.
+	void update_blocked_province(const ProvinceGraph &p_graph, const Vec<Node> &p_node_clusters, Node p_province);
+
+	uint32_t get_node_count() const;
+	const Vector2 &get_position(Node p_node) const;
+
+	uint32_t get_edge_begin(Node p_node) const { return edge_offsets[p_node]; }
+	uint32_t get_edge_end(Node p_node) const { return edge_offsets[p_node + 1]; }
+	Node get_edge_target(uint32_t p_edge) const { return edge_targets[p_edge]; }
+	float get_edge_cost(uint32_t p_edge, MovementDomain p_domain) const { return edge_costs[int(p_domain)][p_edge]; }
+	bool is_node_blocked(Node p_node) const { return false; }
+
+private:
+	Vec<Vector2> positions; // Average position of the provinces in the cluster
+	Vec<uint32_t> edge_offsets;
+	Vec<Node> edge_targets;
+	Vec<float> edge_costs[int(MovementDomain::MOVEMENT_DOMAIN_MAX)];
+	Vec<uint32_t> edge_links[int(MovementDomain::MOVEMENT_DOMAIN_MAX)]; // Number of usable province edges behind each cluster edge
+	AHashMap<uint64_t, uint32_t> edge_lookup; // (from cluster, to cluster) -> edge
+
+	static uint64_t _get_edge_key(Node p_from, Node p_to) { return (uint64_t(p_from) << 32) | p_to; }
+	static bool _is_link(const ProvinceGraph &p_graph, uint32_t p_edge, Node p_from, MovementDomain p_domain);
+	void _add_link(Node p_from, Node p_to, MovementDomain p_domain, int p_count);
+};
+
+} // namespace CG
@@ -0,0 +1,369 @@
+#include "CountryLabels.hpp"
+
+#include "core/templates/sort_array.h"
+
+#include "cg/NodeManager.hpp"
+
+#include "ecs/components.hpp"
+#include "ecs/tags.hpp"
+
+#include "nodes/Map3D.hpp"
+
+#include "Map.hpp"
+#include "MapLabelShaper.hpp"
+
+using namespace CG;
+
+void CountryLabels::invalidate(CountryEntity p_country) {
+	if (!labels.has(p_country))
+		labels.insert(p_country, CountryLabel());
+	CountryLabel &label = *labels.getptr(p_country);
+	if (label.dirty)
+		return;
+
+	label.dirty = true;
+	dirty_countries.push_back(p_country);
+}
+
+void CountryLabels::invalidate_all() { dirty_all = true; }
+
+void CountryLabels::update() {
+	if (dirty_all) {
+		clear();
+		ECS::self->get_scope(Scope::Country).children([this](Entity p_country) { _rebuild(p_country); });
+		dirty_all = false;
+		return;
+	}
+
+	// Countries that were invalidated again while waiting keep their place so every label is rebuilt within a few frames.
+	const uint32_t rebuild_count = MIN(dirty_countries.size(), max_rebuilds_per_update);
+	for (uint32_t i = 0; i < rebuild_count; ++i) {
+		if (CountryLabel *label = labels.getptr(dirty_countries[i]))
+			label->dirty = false;
+		_rebuild(dirty_countries[i]);
+	}
+
+	for (uint32_t i = rebuild_count; i < dirty_countries.size(); ++i)
+		dirty_countries[i - rebuild_count] = dirty_countries[i];
+	dirty_countries.resize(dirty_countries.size() - rebuild_count);
+}
+
+bool CountryLabels::is_dirty() const { return dirty_all or !dirty_countries.is_empty(); }
+
+void CountryLabels::set_visible(bool p_visible) {
+	if (p_visible == visible)
+		return;
+
+	visible = p_visible;
+	for (const KeyValue<CountryEntity, CountryLabel> &kv : labels)
+		if (kv.value.label_id != MapLabelBatch::INVALID_LABEL)
+			MapLabelBatch::self->set_label_visible(kv.value.label_id, visible and kv.value.placed);
+}
+
+void CountryLabels::clear() {
+	if (MapLabelShaper::self != nullptr)
+		MapLabelShaper::self->cancel(this);
+
+	for (KeyValue<CountryEntity, CountryLabel> &kv : labels)
+		_free_label(kv.value);
+	labels.clear();
+	dirty_countries.clear();
+}
+
+Vec<Vector2> CountryLabels::_calc_spine(CountryEntity p_country, float &r_thickness) {
+	ECS &ecs = *ECS::self;
+
+	Vec<ProvinceEntity> provinces;
+	Vec<Vector2> positions;
+	AHashMap<ProvinceEntity, uint32_t, EntityHasher> province_nodes;
+	float thickness = 0.0;
+
+	const ProvinceTable &province_table = Map::self->get_province_table();
+	for (const ProvinceIndex province_id : Map::self->get_country_provinces(p_country)) {
+		const ProvinceEntity province_entity = Map::self->get_province_entity(province_id);
+		if (province_table.get_type(province_id) != ProvinceType::Land or !province_entity.has<TextLocator>())
+			continue;
+
+		province_nodes[province_entity] = provinces.size();
+		provinces.push_back(province_entity);
+		positions.push_back(province_entity.get<TextLocator>().position);
+
+		if (province_entity.has<AABB>()) {
+			const AABB &aabb = province_entity.get<AABB>();
+			thickness += MIN(aabb.size.x, aabb.size.z);
+		}
+	}
+
+	const uint32_t node_count = provinces.size();
+	if (node_count == 0)
+		return {};
+
+	r_thickness = thickness / float(node_count);
+
+	if (node_count == 1) {
+		// Single province countries get a straight spine along their text locator.
+		const TextLocator &locator = provinces[0].get<TextLocator>();
+		const Vector2 direction = Vector2(Math::cos(locator.orientation), -Math::sin(locator.orientation));
+		return { positions[0] - (direction * r_thickness * 0.5), positions[0] + (direction * r_thickness * 0.5) };
+	}
+
+	// Crossings don't connect the land of a country so only shared borders count.
+	const ProvinceGraph &graph = Map::self->get_province_graph();
+	Vec<Vec<uint32_t>> neighbors;
+	neighbors.resize(node_count);
+	for (uint32_t i = 0; i < node_count; ++i) {
+		const ProvinceGraph::Node province_node = graph.get_node(provinces[i]);
+		if (province_node == ProvinceGraph::INVALID_NODE)
+			continue;
+
+		for (uint32_t edge = graph.get_edge_begin(province_node); edge < graph.get_edge_end(province_node); ++edge) {
+			if (graph.get_edge_type(edge) == ProvinceAdjacencyType::Crossing)
+				continue;
+
+			if (const uint32_t *node = province_nodes.getptr(graph.get_province(graph.get_edge_target(edge))))
+				neighbors[i].push_back(*node);
+		}
+	}
+
+	// Minimum spanning tree of the part of the country that is connected to the capital.
+	const ProvinceEntity capital = ecs.get_target(p_country, Relation::Capital);
+	const uint32_t *capital_node = province_nodes.getptr(capital);
+	const uint32_t start = capital_node != nullptr ? *capital_node : 0;
+
+	Vec<float> best_distance;
+	Vec<int> parent;
+	Vec<uint8_t> in_tree;
+	best_distance.resize(node_count);
+	parent.resize(node_count);
+	in_tree.resize(node_count);
+	for (uint32_t i = 0; i < node_count; ++i) {
+		best_distance[i] = std::numeric_limits<float>::infinity();
+		parent[i] = -1;
+		in_tree[i] = false;
+	}
+	best_distance[start] = 0.0;
+
+	SortArray<OpenNode, OpenNodeComparator> sorter;
+	Vec<OpenNode> open_nodes = { { 0.0, start } };
+
+	while (!open_nodes.is_empty()) {
+		sorter.pop_heap(0, open_nodes.size(), open_nodes.ptr());
+		const OpenNode open_node = open_nodes[open_nodes.size() - 1];
+		open_nodes.remove_at(open_nodes.size() - 1);
+
+		// The open list can have outdated entries for nodes that were reached again with a shorter edge.
+		const uint32_t next = open_node.node;
+		if (in_tree[next] or open_node.distance > best_distance[next])
+			continue;
+
+		in_tree[next] = true;
+		for (const uint32_t neighbor : neighbors[next]) {
+			const float distance = positions[next].distance_to(positions[neighbor]);
+			if (!in_tree[neighbor] and distance < best_distance[neighbor]) {
+				best_distance[neighbor] = distance;
+				parent[neighbor] = int(next);
+
+				const OpenNode neighbor_node = { distance, neighbor };
+				open_nodes.push_back(neighbor_node);
+				sorter.push_heap(0, open_nodes.size() - 1, 0, neighbor_node, open_nodes.ptr());
+			}
+		}
+	}
+
+	Vec<Vec<uint32_t>> tree;
+	tree.resize(node_count);
+	for (uint32_t i = 0; i < node_count; ++i) {
+		if (parent[i] == -1)
+			continue;
+		tree[i].push_back(parent[i]);
+		tree[parent[i]].push_back(i);
+	}
+
+	// The spine is the diameter of the tree, found by walking to the furthest node twice.
+	Vec<int> previous;
+	Vec<float> distances;
+	previous.resize(node_count);
+	distances.resize(node_count);
+
+	const auto furthest_node = [&](uint32_t p_from) {
+		for (uint32_t i = 0; i < node_count; ++i) {
+			previous[i] = -1;
+			distances[i] = -1.0;
+		}
+
+		Vec<uint32_t> stack = { p_from };
+		distances[p_from] = 0.0;
+		uint32_t furthest = p_from;
+
+		while (!stack.is_empty()) {
+			const uint32_t node = stack[stack.size() - 1];
+			stack.remove_at(stack.size() - 1);
+
+			if (distances[node] > distances[furthest])
+				furthest = node;
+
+			for (const uint32_t neighbor : tree[node]) {
+				if (distances[neighbor] >= 0.0)
+					continue;
+				distances[neighbor] = distances[node] + positions[node].distance_to(positions[neighbor]);
+				previous[neighbor] = int(node);
+				stack.push_back(neighbor);
+			}
+		}
+
+		return furthest;
+	};
+
+	const uint32_t spine_start = furthest_node(start);
+	const uint32_t spine_end = furthest_node(spine_start);
+
+	Vec<Vector2> spine;
+	for (int node = int(spine_end); node != -1; node = previous[node])
+		spine.push_back(positions[node]);
+
+	if (spine.size() == 1) {
+		// Only the capital is connected, use its province like a single province country.
+		const TextLocator &locator = provinces[start].get<TextLocator>();
+		const Vector2 direction = Vector2(Math::cos(locator.orientation), -Math::sin(locator.orientation));
+		return { positions[start] - (direction * r_thickness * 0.5), positions[start] + (direction * r_thickness * 0.5) };
+	}
+
+	// The end points are province centers, extend them towards the province borders.
+	const uint32_t last = spine.size() - 1;
+	spine[0] += (spine[0] - spine[1]).normalized() * r_thickness * 0.5;
+	spine[last] += (spine[last] - spine[last - 1]).normalized() * r_thickness * 0.5;
+
+	// Chaikin smoothing turns the path between province centers into a curve without moving the end points.
+	for (int iteration = 0; iteration < spine_smooth_iterations; ++iteration) {
+		Vec<Vector2> smooth_spine;
+		smooth_spine.reserve(spine.size() * 2);
+		smooth_spine.push_back(spine[0]);
+		for (uint32_t i = 0; i + 1 < spine.size(); ++i) {
+			smooth_spine.push_back(spine[i].lerp(spine[i + 1], 0.25));
+			smooth_spine.push_back(spine[i].lerp(spine[i + 1], 0.75));
+		}
+		smooth_spine.push_back(spine[spine.size() - 1]);
+		spine = std::move(smooth_spine);
+	}
+
+	// Text is read from left to right.
+	if (spine[spine.size() - 1].x < spine[0].x)
+		spine.reverse();
+
+	return spine;
+}
+
+void CountryLabels::_bend_glyphs(LabelGlyphSurfaces &r_surfaces, const Vec<Vector2> &p_spine, float p_text_offset, float p_scale) {
+	Vec<float> lengths;
+	lengths.resize(p_spine.size());
+	lengths[0] = 0.0;
+	for (uint32_t i = 1; i < p_spine.size(); ++i)
+		lengths[i] = lengths[i - 1] + p_spine[i - 1].distance_to(p_spine[i]);
+
+	for (KeyValue<LabelSurfaceKey, LabelGlyphSurface> &kv : r_surfaces) {
+		for (LabelGlyphQuad &quad : kv.value.quads) {
+			// Place each glyph at the point of the spine under its center and rotate it to follow the spine.
+			const float glyph_center = (quad.vertices[0].x + quad.vertices[1].x) * 0.5;
+			const float offset = p_text_offset + (glyph_center * p_scale);
+
+			uint32_t segment = 0;
+			while (segment + 2 < p_spine.size() and lengths[segment + 1] < offset)
+				segment++;
+
+			const Vector2 from = p_spine[segment];
+			const Vector2 to = p_spine[segment + 1];
+			const float segment_length = lengths[segment + 1] - lengths[segment];
+			const Vector2 tangent = (to - from).normalized();
+			const Vector2 up = Vector2(tangent.y, -tangent.x);
+			const Vector2 point = segment_length > 0.0 ? from.lerp(to, (offset - lengths[segment]) / segment_length) : from;
+
+			for (Vector3 &vertex : quad.vertices) {
+				const Vector2 map_position = point + (tangent * (vertex.x - glyph_center) * p_scale) + (up * vertex.y * p_scale);
+				vertex = Vector3(map_position.x, vertex.z * p_scale, map_position.y);
+			}
+		}
+	}
+}
+
+void CountryLabels::_rebuild(CountryEntity p_country) {
+	if (!p_country.has<LocKey>()) {
+		if (CountryLabel *existing_label = labels.getptr(p_country)) {
+			_free_label(*existing_label);
+			labels.erase(p_country);
+		}
+		return;
+	}
+
+	if (!labels.has(p_country))
+		labels.insert(p_country, CountryLabel());
+	CountryLabel &label = *labels.getptr(p_country);
+
+	// A new name is shaped on worker threads and placed in apply_shaped_text, until then the old label stays where it is.
+	const String text = NM::map->atr(p_country.get<LocKey>());
+	if (text != label.text) {
+		label.text = text;
+		label.version = ++shape_version;
+		MapLabelShaper::self->queue(this, p_country, label.version, text);
+		return;
+	}
+
+	if (label.shaped)
+		_place(p_country, label);
+}
+
+void CountryLabels::apply_shaped_text(CountryEntity p_country, uint32_t p_version, const LabelGlyphSurfaces &p_surfaces, const AABB &p_aabb) {
+	CountryLabel *label = labels.getptr(p_country);
+	if (label == nullptr or label->version != p_version)
+		return;
+
+	label->surfaces = p_surfaces;
+	label->aabb = p_aabb;
+	label->shaped = true;
+	_place(p_country, *label);
+}
+
+void CountryLabels::_place(CountryEntity p_country, CountryLabel &p_label) {
+	float thickness = 0.0;
+	Vec<Vector2> spine = _calc_spine(p_country, thickness);
+	p_label.placed = spine.size() >= 2 and p_label.aabb.size.x > 0.0 and p_label.aabb.size.y > 0.0;
+	if (!p_label.placed) {
+		// The country has no land left to draw its name on, the label is kept hidden so it can be reused.
+		if (p_label.label_id != MapLabelBatch::INVALID_LABEL)
+			MapLabelBatch::self->set_label_visible(p_label.label_id, false);
+		return;
+	}
+
+	float spine_length = 0.0;
+	for (uint32_t i = 1; i < spine.size(); ++i)
+		spine_length += spine[i - 1].distance_to(spine[i]);
+
+	// Stretch the text along the spine but don't let it get taller than the provinces it's drawn over.
+	const float scale = MIN(spine_length * spine_fill / p_label.aabb.size.x, thickness * spine_thickness_fill / p_label.aabb.size.y);
+
+	// Glyphs are relative to the first spine point so the batch puts the label in the chunk of the spine start.
+	const Vector2 origin = spine[0];
+	for (Vector2 &point : spine)
+		point -= origin;
+
+	LabelGlyphSurfaces surfaces = p_label.surfaces;
+	_bend_glyphs(surfaces, spine, spine_length * 0.5, scale);
+
+	Transform3D transform;
+	transform.origin = Vector3(origin.x, label_map_layer, origin.y);
+
+	// The label is reused so its quad ranges are rewritten in place instead of rebuilding the chunk.
+	if (p_label.label_id == MapLabelBatch::INVALID_LABEL)
+		p_label.label_id = MapLabelBatch::self->create_label(transform);
+	else
+		MapLabelBatch::self->set_label_transform(p_label.label_id, transform);
+	MapLabelBatch::self->set_label_glyphs(p_label.label_id, surfaces);
+	MapLabelBatch::self->set_label_visible(p_label.label_id, visible);
+}
+
+void CountryLabels::_free_label(CountryLabel &p_label) {
+	if (p_label.label_id != MapLabelBatch::INVALID_LABEL and MapLabelBatch::self != nullptr)
+		MapLabelBatch::self->free_label(p_label.label_id);
+	p_label.label_id = MapLabelBatch::INVALID_LABEL;
+}
+
+CountryLabels::~CountryLabels() { clear(); }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "core/templates/a_hash_map.h"
+
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
+
+#include "MapLabel.hpp"
+
+namespace CG {
+
+// Country name labels that follow the shape of the country instead of sitting on the capital.
+// The spine of a country is the longest path through the spanning tree of its provinces, using the text locator of each province and the province adjacencies.
+// It only uses per-province data so when a province changes owner only the labels of the two countries are rebuilt, no pixels are touched.
+// Names are shaped once on the MapLabelShaper and kept unbent, rebuilding a label only bends the cached glyphs along the new spine. The old label stays visible while a new name is shaped.
+class CountryLabels {
+public:
+	// Rebuild the label of a country in the next update().
+	void invalidate(CountryEntity p_country);
+	void invalidate_all();
+
+	// Rebuild the labels of up to max_rebuilds_per_update invalidated countries, the oldest first. Changes are sent to the MapLabelBatch but not flushed.
+	void update();
+	// True while invalidated countries are waiting for a later update().
+	bool is_dirty() const;
+	void set_visible(bool p_visible);
+	void clear();
+
+	// Called on the main thread by the MapLabelShaper when the name of a country has been shaped.
+	void apply_shaped_text(CountryEntity p_country, uint32_t p_version, const LabelGlyphSurfaces &p_surfaces, const AABB &p_aabb);
+
+	~CountryLabels();
+
+private:
+	static constexpr int spine_smooth_iterations = 2;
+	static constexpr float spine_fill = 0.8; // Part of the spine the text is stretched over.
+	static constexpr float spine_thickness_fill = 0.6; // Max text height relative to the average province size.
+	static constexpr uint32_t max_rebuilds_per_update = 64; // Many transfers in one tick spread their label rebuilds over the next frames.
+
+	struct CountryLabel {
+		MapLabelBatch::LabelID label_id = MapLabelBatch::INVALID_LABEL;
+		String text; // Name that was last queued for shaping
+		uint32_t version = 0; // Version of the queued text, stale shaping results are dropped
+		bool shaped = false;
+		bool placed = false; // False while the country has no land to draw its name on
+		bool dirty = false; // Already in dirty_countries
+		LabelGlyphSurfaces surfaces; // Shaped name in label space before bending
+		AABB aabb;
+	};
+
+	// Prim's open list entry, SortArray heaps keep the largest element on top so comparing with > makes it a min heap.
+	struct OpenNode {
+		float distance = 0.0;
+		uint32_t node = 0;
+	};
+
+	struct OpenNodeComparator {
+		bool operator()(const OpenNode &p_a, const OpenNode &p_b) const { return p_a.distance > p_b.distance; }
+	};
+
+	AHashMap<CountryEntity, CountryLabel, EntityHasher> labels;
+	Vec<CountryEntity> dirty_countries; // In invalidation order
+	uint32_t shape_version = 0; // Shared by all labels so a label created again after clear() never reuses a pending version
+	bool visible = true;
+	bool dirty_all = false;
+
+	static Vec<Vector2> _calc_spine(CountryEntity p_country, float &r_thickness);
+	static void _bend_glyphs(LabelGlyphSurfaces &r_surfaces, const Vec<Vector2> &p_spine, float p_text_offset, float p_scale);
+	void _rebuild(CountryEntity p_country);
+	// Bend the shaped name along the current spine of the country.
+	void _place(CountryEntity p_country, CountryLabel &p_label);
+	void _free_label(CountryLabel &p_label);
+};
+
+} // namespace CG
@@ -0,0 +1,55 @@
+#include "CountryProvinces.hpp"
+
+using namespace CG;
+
+void CountryProvinces::clear() {
+	country_provinces.clear();
+	province_owners.clear();
+	province_slots.clear();
+}
+
+void CountryProvinces::set_owner(ProvinceIndex p_province, CountryEntity p_owner) {
+	ERR_FAIL_COND(p_province <= 0);
+
+	if (uint32_t(p_province) >= province_owners.size()) {
+		const uint32_t old_size = province_owners.size();
+		province_owners.resize(p_province + 1);
+		province_slots.resize(p_province + 1);
+		for (uint32_t i = old_size; i < province_owners.size(); ++i) {
+			province_owners[i] = CountryEntity();
+			province_slots[i] = 0;
+		}
+	}
+
+	const CountryEntity old_owner = province_owners[p_province];
+	if (old_owner == p_owner)
+		return;
+
+	// Fill the hole with the last province of the old owner.
+	if (old_owner.is_valid()) {
+		Vec<ProvinceIndex> &old_provinces = country_provinces[old_owner];
+		const uint32_t slot = province_slots[p_province];
+		const ProvinceIndex moved_province = old_provinces[old_provinces.size() - 1];
+		old_provinces[slot] = moved_province;
+		province_slots[moved_province] = slot;
+		old_provinces.remove_at(old_provinces.size() - 1);
+	}
+
+	province_owners[p_province] = p_owner;
+	if (p_owner.is_valid()) {
+		Vec<ProvinceIndex> &new_provinces = country_provinces[p_owner];
+		province_slots[p_province] = new_provinces.size();
+		new_provinces.push_back(p_province);
+	}
+}
+
+CountryEntity CountryProvinces::get_owner(ProvinceIndex p_province) const {
+	if (p_province <= 0 or uint32_t(p_province) >= province_owners.size())
+		return CountryEntity();
+	return province_owners[p_province];
+}
+
+const Vec<ProvinceIndex> &CountryProvinces::get_provinces(CountryEntity p_country) const {
+	const Vec<ProvinceIndex> *provinces = country_provinces.getptr(p_country);
+	return provinces != nullptr ? *provinces : no_provinces;
+}
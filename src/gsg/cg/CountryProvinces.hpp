@@ -0,0 +1,32 @@
+#pragma once
+
+#include "core/templates/a_hash_map.h"
+
+#include "ecs/entity.hpp"
+#include "ecs/Provinces.hpp"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+// The provinces owned by every country as a list of province ids.
+// Every province remembers its position in the list of its owner so changing the owner of a province is O(1) and enumerating the provinces of a country is O(provinces owned).
+// The order of a country's provinces changes when one of them is removed.
+class CountryProvinces {
+public:
+	void clear();
+
+	// Set the owner of a province, an invalid owner removes the province from its current owner.
+	void set_owner(ProvinceIndex p_province, CountryEntity p_owner);
+	CountryEntity get_owner(ProvinceIndex p_province) const;
+	const Vec<ProvinceIndex> &get_provinces(CountryEntity p_country) const;
+
+private:
+	static inline const Vec<ProvinceIndex> no_provinces;
+
+	AHashMap<CountryEntity, Vec<ProvinceIndex>, EntityHasher> country_provinces;
+	Vec<CountryEntity> province_owners; // Province id -> owner
+	Vec<uint32_t> province_slots; // Province id -> index in the province list of its owner
+};
+
+} // namespace CG
@@ -0,0 +1,240 @@
+#include "DistanceFields.hpp"
+
+#include <limits>
+
+#include "core/templates/sort_array.h"
+
+using namespace CG;
+
+void DistanceFields::init(const ProvinceGraph *p_graph) {
+	clear();
+	graph = p_graph;
+}
+
+void DistanceFields::clear() {
+	fields.clear();
+	free_fields.clear();
+	changed_fields.clear();
+}
+
+DistanceFields::FieldID DistanceFields::create_field(MovementDomain p_domain) {
+	FieldID field_id;
+	if (!free_fields.is_empty()) {
+		field_id = free_fields[free_fields.size() - 1];
+		free_fields.remove_at(free_fields.size() - 1);
+	} else {
+		field_id = fields.size();
+		fields.push_back(Field());
+	}
+
+	Field &field = fields[field_id];
+	field = Field();
+	field.domain = p_domain;
+	field.used = true;
+	return field_id;
+}
+
+void DistanceFields::free_field(FieldID p_field) {
+	ERR_FAIL_UNSIGNED_INDEX(p_field, fields.size());
+	ERR_FAIL_COND(!fields[p_field].used);
+	fields[p_field] = Field();
+	free_fields.push_back(p_field);
+}
+
+void DistanceFields::set_sources(FieldID p_field, const Vec<ProvinceGraph::Node> &p_sources) {
+	ERR_FAIL_UNSIGNED_INDEX(p_field, fields.size());
+	Field &field = fields[p_field];
+	field.sources = p_sources;
+	field.added_sources.clear();
+	field.removed_sources.clear();
+	field.rebuild = true;
+}
+
+void DistanceFields::add_source(FieldID p_field, ProvinceGraph::Node p_source) {
+	ERR_FAIL_UNSIGNED_INDEX(p_field, fields.size());
+	Field &field = fields[p_field];
+	if (field.sources.has(p_source))
+		return;
+
+	field.sources.push_back(p_source);
+	if (field.removed_sources.has(p_source))
+		field.removed_sources.erase_unordered(p_source);
+	else
+		field.added_sources.push_back(p_source);
+}
+
+void DistanceFields::remove_source(FieldID p_field, ProvinceGraph::Node p_source) {
+	ERR_FAIL_UNSIGNED_INDEX(p_field, fields.size());
+	Field &field = fields[p_field];
+	if (!field.sources.has(p_source))
+		return;
+
+	field.sources.erase_unordered(p_source);
+	if (field.added_sources.has(p_source))
+		field.added_sources.erase_unordered(p_source);
+	else
+		field.removed_sources.push_back(p_source);
+}
+
+const Vec<ProvinceGraph::Node> &DistanceFields::get_sources(FieldID p_field) const { return fields[p_field].sources; }
+
+void DistanceFields::update() {
+	ERR_FAIL_NULL(graph);
+
+	changed_fields.clear();
+	for (FieldID field_id = 0; field_id < fields.size(); ++field_id)
+		if (_is_changed(fields[field_id]))
+			changed_fields.push_back(field_id);
+
+	if (changed_fields.is_empty())
+		return;
+
+	// Fields don't share any state so every changed field can be refreshed on its own thread.
+	if (changed_fields.size() == 1) {
+		_update_field(0, &changed_fields);
+		return;
+	}
+
+	WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+	const WorkerThreadPool::GroupID group_id = pool->add_template_group_task(this, &DistanceFields::_update_field, &changed_fields, int(changed_fields.size()), -1, true, "Update distance fields");
+	pool->wait_for_group_task_completion(group_id);
+}
+
+float DistanceFields::get_distance(FieldID p_field, ProvinceGraph::Node p_node) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_field, fields.size(), std::numeric_limits<float>::infinity());
+	const Field &field = fields[p_field];
+	ERR_FAIL_UNSIGNED_INDEX_V(p_node, field.distances.size(), std::numeric_limits<float>::infinity());
+	return field.distances[p_node];
+}
+
+ProvinceGraph::Node DistanceFields::get_nearest_source(FieldID p_field, ProvinceGraph::Node p_node) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_field, fields.size(), ProvinceGraph::INVALID_NODE);
+	const Field &field = fields[p_field];
+	ERR_FAIL_UNSIGNED_INDEX_V(p_node, field.nearest_sources.size(), ProvinceGraph::INVALID_NODE);
+	return field.nearest_sources[p_node];
+}
+
+const Vec<float> &DistanceFields::get_distances(FieldID p_field) const { return fields[p_field].distances; }
+
+bool DistanceFields::_is_changed(const Field &p_field) const {
+	return p_field.used and (p_field.rebuild or p_field.graph_version != graph->get_version() or !p_field.added_sources.is_empty() or !p_field.removed_sources.is_empty());
+}
+
+void DistanceFields::_update_field(uint32_t p_index, Vec<FieldID> *p_fields) {
+	Field &field = fields[(*p_fields)[p_index]];
+
+	if (field.rebuild or field.graph_version != graph->get_version() or field.distances.size() != graph->get_node_count()) {
+		_rebuild(field);
+	} else {
+		_remove_sources(field);
+		_add_sources(field);
+	}
+
+	_propagate(field);
+	field.added_sources.clear();
+	field.removed_sources.clear();
+	field.graph_version = graph->get_version();
+	field.rebuild = false;
+}
+
+void DistanceFields::_rebuild(Field &r_field) {
+	const uint32_t node_count = graph->get_node_count();
+	r_field.distances.resize(node_count);
+	r_field.nearest_sources.resize(node_count);
+	for (uint32_t node = 0; node < node_count; ++node) {
+		r_field.distances[node] = std::numeric_limits<float>::infinity();
+		r_field.nearest_sources[node] = ProvinceGraph::INVALID_NODE;
+	}
+
+	r_field.open_nodes.clear();
+	r_field.added_sources = r_field.sources;
+	_add_sources(r_field);
+}
+
+void DistanceFields::_remove_sources(Field &r_field) {
+	if (r_field.removed_sources.is_empty())
+		return;
+
+	// Reset every node whose nearest source was removed.
+	Vec<ProvinceGraph::Node> reset_nodes;
+	for (ProvinceGraph::Node node = 0; node < r_field.nearest_sources.size(); ++node) {
+		if (r_field.nearest_sources[node] == ProvinceGraph::INVALID_NODE or !r_field.removed_sources.has(r_field.nearest_sources[node]))
+			continue;
+
+		r_field.distances[node] = std::numeric_limits<float>::infinity();
+		r_field.nearest_sources[node] = ProvinceGraph::INVALID_NODE;
+		reset_nodes.push_back(node);
+	}
+
+	// Refill the reset nodes from the nodes around them that still have a source, edges cost the same in both directions.
+	for (const ProvinceGraph::Node node : reset_nodes) {
+		const uint32_t edge_end = graph->get_edge_end(node);
+		for (uint32_t edge = graph->get_edge_begin(node); edge < edge_end; ++edge) {
+			const ProvinceGraph::Node neighbor = graph->get_edge_target(edge);
+			const float cost = r_field.distances[neighbor] + graph->get_edge_cost(edge, r_field.domain);
+			if (cost >= r_field.distances[node])
+				continue;
+
+			r_field.distances[node] = cost;
+			r_field.nearest_sources[node] = r_field.nearest_sources[neighbor];
+		}
+
+		if (r_field.distances[node] != std::numeric_limits<float>::infinity())
+			_push_open(r_field, { r_field.distances[node], node });
+	}
+}
+
+void DistanceFields::_add_sources(Field &r_field) {
+	for (const ProvinceGraph::Node source : r_field.added_sources) {
+		ERR_CONTINUE(source >= r_field.distances.size());
+		if (graph->is_node_blocked(source))
+			continue;
+
+		r_field.distances[source] = 0.0;
+		r_field.nearest_sources[source] = source;
+		_push_open(r_field, { 0.0, source });
+	}
+}
+
+void DistanceFields::_propagate(Field &r_field) {
+	// Dijkstra that only lowers distances, so it can continue from any set of nodes whose distance went down.
+	while (!r_field.open_nodes.is_empty()) {
+		const OpenNode open_node = _pop_open(r_field);
+
+		// The open list can have an outdated entry for a node that was reached again with a lower cost.
+		if (open_node.cost > r_field.distances[open_node.node])
+			continue;
+
+		const uint32_t edge_end = graph->get_edge_end(open_node.node);
+		for (uint32_t edge = graph->get_edge_begin(open_node.node); edge < edge_end; ++edge) {
+			const float edge_cost = graph->get_edge_cost(edge, r_field.domain);
+			if (edge_cost == std::numeric_limits<float>::infinity())
+				continue;
+
+			const ProvinceGraph::Node neighbor = graph->get_edge_target(edge);
+			const float cost = open_node.cost + edge_cost;
+			if (graph->is_node_blocked(neighbor) or cost >= r_field.distances[neighbor])
+				continue;
+
+			r_field.distances[neighbor] = cost;
+			r_field.nearest_sources[neighbor] = r_field.nearest_sources[open_node.node];
+			_push_open(r_field, { cost, neighbor });
+		}
+	}
+}
+
+void DistanceFields::_push_open(Field &r_field, const OpenNode &p_open_node) {
+	r_field.open_nodes.push_back(p_open_node);
+	SortArray<OpenNode, OpenNodeComparator> sorter;
+	sorter.push_heap(0, r_field.open_nodes.size() - 1, 0, p_open_node, r_field.open_nodes.ptr());
+}
+
+DistanceFields::OpenNode DistanceFields::_pop_open(Field &r_field) {
+	SortArray<OpenNode, OpenNodeComparator> sorter;
+	sorter.pop_heap(0, r_field.open_nodes.size(), r_field.open_nodes.ptr());
+	const OpenNode open_node = r_field.open_nodes[r_field.open_nodes.size() - 1];
+	r_field.open_nodes.remove_at(r_field.open_nodes.size() - 1);
+	return open_node;
+}
+
+DistanceFields::~DistanceFields() { clear(); }
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "core/object/worker_thread_pool.h"
+
+#include "ProvinceGraph.hpp"
+
+namespace CG {
+
+// Multi-source distance fields over the ProvinceGraph, such as the distance from every province to the nearest enemy province, port or capital.
+// A field stores the cost from every node to its nearest source in a dense array indexed by node, nodes that can't be reached are infinity.
+// Fields are refreshed incrementally: added sources are only propagated from the new sources and removed sources only reset the nodes they were nearest to, which are then refilled from the nodes around them.
+// A field is only recomputed from scratch when its sources are replaced or the graph changed.
+// update() refreshes all changed fields at once on the WorkerThreadPool with one task per field.
+class DistanceFields {
+public:
+	using FieldID = uint32_t;
+	static constexpr FieldID INVALID_FIELD = UINT32_MAX;
+
+	void init(const ProvinceGraph *p_graph);
+	void clear();
+
+	FieldID create_field(MovementDomain p_domain);
+	void free_field(FieldID p_field);
+
+	void set_sources(FieldID p_field, const Vec<ProvinceGraph::Node> &p_sources);
+	void add_source(FieldID p_field, ProvinceGraph::Node p_source);
+	void remove_source(FieldID p_field, ProvinceGraph::Node p_source);
+	const Vec<ProvinceGraph::Node> &get_sources(FieldID p_field) const;
+
+	// Refresh every field whose sources or graph changed since the last update.
+	void update();
+
+	// Distances are only valid after update().
+	float get_distance(FieldID p_field, ProvinceGraph::Node p_node) const;
+	ProvinceGraph::Node get_nearest_source(FieldID p_field, ProvinceGraph::Node p_node) const;
+	const Vec<float> &get_distances(FieldID p_field) const;
+
+	~DistanceFields();
+
+private:
+	struct OpenNode {
+		float cost = 0.0;
+		ProvinceGraph::Node node = ProvinceGraph::INVALID_NODE;
+	};
+
+	// SortArray heaps keep the largest element on top, comparing with > makes the open list a min heap.
+	struct OpenNodeComparator {
+		bool operator()(const OpenNode &p_a, const OpenNode &p_b) const { return p_a.cost > p_b.cost; }
+	};
+
+	struct Field {
+		MovementDomain domain = MovementDomain::Land;
+		Vec<ProvinceGraph::Node> sources;
+		Vec<ProvinceGraph::Node> added_sources; // Sources that haven't been propagated yet
+		Vec<ProvinceGraph::Node> removed_sources; // Sources that still have nodes nearest to them
+		Vec<float> distances; // Node -> cost to the nearest source
+		Vec<ProvinceGraph::Node> nearest_sources; // Node -> nearest source
+		Vec<OpenNode> open_nodes;
+		uint32_t graph_version = 0;
+		bool rebuild = true;
+		bool used = false;
+	};
+
+	const ProvinceGraph *graph = nullptr;
+	Vec<Field> fields;
+	Vec<FieldID> free_fields;
+	Vec<FieldID> changed_fields;
+
+	bool _is_changed(const Field &p_field) const;
+	void _update_field(uint32_t p_index, Vec<FieldID> *p_fields);
+	void _rebuild(Field &r_field);
+	void _remove_sources(Field &r_field);
+	void _add_sources(Field &r_field);
+	void _propagate(Field &r_field);
+	static void _push_open(Field &r_field, const OpenNode &p_open_node);
+	static OpenNode _pop_open(Field &r_field);
+};
+
+} // namespace CG
@@ -0,0 +1,166 @@
+#include "HierarchicalPathFinder.hpp"
+
+#include "core/os/os.h"
+
+#include "ProvinceTable.hpp"
+
+using namespace CG;
+
+void HierarchicalPathFinder::build(const ProvinceGraph &p_graph, const ProvinceTable &p_table) {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	clear();
+
+	// The dense area and region indices of the province table are the cluster nodes.
+	const uint32_t area_count = p_table.get_area_count();
+	area_regions.resize(area_count);
+	for (Node area = 0; area < area_count; ++area)
+		area_regions[area] = ProvinceGraph::INVALID_NODE;
+
+	const uint32_t node_count = p_graph.get_node_count();
+	province_areas.resize(node_count);
+	province_regions.resize(node_count);
+	for (Node node = 0; node < node_count; ++node) {
+		const ProvinceIndex province = p_graph.get_province_id(node);
+		const ProvinceTable::Index area = p_table.get_area(province);
+		const ProvinceTable::Index region = p_table.get_region(province);
+		province_areas[node] = area != ProvinceTable::NO_INDEX ? Node(area) : ProvinceGraph::INVALID_NODE;
+		province_regions[node] = area != ProvinceTable::NO_INDEX and region != ProvinceTable::NO_INDEX ? Node(region) : ProvinceGraph::INVALID_NODE;
+		if (area != ProvinceTable::NO_INDEX)
+			area_regions[area] = province_regions[node];
+	}
+
+	area_graph.build(p_graph, province_areas, area_count);
+	region_graph.build(p_graph, province_regions, p_table.get_region_count());
+
+	area_subpaths.resize(area_count);
+
+	print_line("Built area and region path graphs in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+}
+
+void HierarchicalPathFinder::clear() {
+	province_areas.clear();
+	province_regions.clear();
+	area_regions.clear();
+	area_graph.clear();
+	region_graph.clear();
+	area_subpaths.clear();
+}
+
+bool HierarchicalPathFinder::find_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path) { return find_path(p_graph, p_from, p_to, p_domain, r_path, scratch); }
+
+bool HierarchicalPathFinder::find_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path, SearchScratch &r_scratch) {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_from, province_areas.size(), false);
+	ERR_FAIL_UNSIGNED_INDEX_V(p_to, province_areas.size(), false);
+
+	if (p_from == p_to) {
+		r_path.clear();
+		return true;
+	}
+
+	const Node from_area = province_areas[p_from];
+	const Node to_area = province_areas[p_to];
+	r_scratch.province_path_finder.set_landmark_oracle(landmark_oracle);
+
+	// The allow masks are only ever set for the duration of a search so they can be sized lazily per scratch.
+	if (r_scratch.allowed_areas.size() != area_subpaths.size()) {
+		r_scratch.allowed_areas.resize(area_subpaths.size());
+		r_scratch.allowed_regions.resize(region_graph.get_node_count());
+		for (uint8_t &allowed : r_scratch.allowed_areas)
+			allowed = false;
+		for (uint8_t &allowed : r_scratch.allowed_regions)
+			allowed = false;
+	}
+
+	if (from_area != ProvinceGraph::INVALID_NODE and from_area == to_area and _find_intra_area_path(p_graph, p_from, p_to, p_domain, r_path, r_scratch))
+		return true;
+
+	if (from_area != ProvinceGraph::INVALID_NODE and to_area != ProvinceGraph::INVALID_NODE and from_area != to_area and _find_corridor_path(p_graph, p_from, p_to, p_domain, r_path, r_scratch))
+		return true;
+
+	// Provinces without an area or a corridor that missed a detour can still be reached by searching every province.
+	return r_scratch.province_path_finder.find_path(p_graph, p_from, p_to, p_domain, r_path);
+}
+
+void HierarchicalPathFinder::set_landmark_oracle(const LandmarkOracle *p_landmark_oracle) { landmark_oracle = p_landmark_oracle; }
+
+void HierarchicalPathFinder::set_province_blocked(ProvinceGraph &p_graph, Node p_province, bool p_blocked) {
+	ERR_FAIL_UNSIGNED_INDEX(p_province, province_areas.size());
+	if (p_graph.is_node_blocked(p_province) == p_blocked)
+		return;
+
+	p_graph.set_node_blocked(p_province, p_blocked);
+	area_graph.update_blocked_province(p_graph, province_areas, p_province);
+	region_graph.update_blocked_province(p_graph, province_regions, p_province);
+
+	// Cached subpaths never leave their area so only the area of the province can have paths that changed.
+	const Node area = province_areas[p_province];
+	if (area != ProvinceGraph::INVALID_NODE) {
+		MutexLock lock(subpath_mutex);
+		area_subpaths[area].clear();
+	}
+}
+
+uint32_t HierarchicalPathFinder::get_cached_subpath_count() const {
+	MutexLock lock(subpath_mutex);
+	uint32_t count = 0;
+	for (const SubpathCache &subpaths : area_subpaths)
+		count += subpaths.size();
+	return count;
+}
+
+uint64_t HierarchicalPathFinder::_get_subpath_key(Node p_from, Node p_to, MovementDomain p_domain) { return (uint64_t(p_from) << 33) | (uint64_t(p_to) << 1) | uint64_t(p_domain); }
+
+bool HierarchicalPathFinder::_find_intra_area_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path, SearchScratch &r_scratch) {
+	const Node area = province_areas[p_from];
+	const uint64_t key = _get_subpath_key(p_from, p_to, p_domain);
+
+	{
+		MutexLock lock(subpath_mutex);
+		if (const Vec<Node> *subpath = area_subpaths[area].getptr(key)) {
+			r_path = *subpath;
+			return true;
+		}
+	}
+
+	r_scratch.allowed_areas[area] = true;
+	const bool found = r_scratch.province_path_finder.find_path(p_graph, p_from, p_to, p_domain, r_path, PathCorridor{ &province_areas, &r_scratch.allowed_areas });
+	r_scratch.allowed_areas[area] = false;
+
+	if (found) {
+		MutexLock lock(subpath_mutex);
+		area_subpaths[area].insert(key, r_path);
+	}
+	return found;
+}
+
+bool HierarchicalPathFinder::_find_corridor_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path, SearchScratch &r_scratch) const {
+	const Node from_area = province_areas[p_from];
+	const Node to_area = province_areas[p_to];
+	const Node from_region = province_regions[p_from];
+	const Node to_region = province_regions[p_to];
+	if (from_region == ProvinceGraph::INVALID_NODE or to_region == ProvinceGraph::INVALID_NODE)
+		return false;
+
+	// Regions the path goes through.
+	if (!r_scratch.cluster_path_finder.find_path(region_graph, from_region, to_region, p_domain, r_scratch.region_path))
+		return false;
+
+	// Areas inside those regions.
+	_set_allowed(r_scratch.allowed_regions, from_region, r_scratch.region_path, true);
+	const bool found_areas = r_scratch.cluster_path_finder.find_path(area_graph, from_area, to_area, p_domain, r_scratch.area_path, PathCorridor{ &area_regions, &r_scratch.allowed_regions });
+	_set_allowed(r_scratch.allowed_regions, from_region, r_scratch.region_path, false);
+	if (!found_areas)
+		return false;
+
+	// Provinces inside those areas.
+	_set_allowed(r_scratch.allowed_areas, from_area, r_scratch.area_path, true);
+	const bool found = r_scratch.province_path_finder.find_path(p_graph, p_from, p_to, p_domain, r_path, PathCorridor{ &province_areas, &r_scratch.allowed_areas });
+	_set_allowed(r_scratch.allowed_areas, from_area, r_scratch.area_path, false);
+	return found;
+}
+
+void HierarchicalPathFinder::_set_allowed(Vec<uint8_t> &r_allowed, Node p_start, const Vec<Node> &p_path, bool p_allowed) {
+	r_allowed[p_start] = p_allowed;
+	for (const Node node : p_path)
+		r_allowed[node] = p_allowed;
+}
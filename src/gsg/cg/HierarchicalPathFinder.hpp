@@ -0,0 +1,65 @@
+#pragma once
+
+#include "core/os/mutex.h"
+
+#include "ClusterGraph.hpp"
+#include "PathFinder.hpp"
+
+namespace CG {
+
+class ProvinceTable;
+
+// Finds paths coarse to fine using the area and region hierarchy.
+// A path is first searched on the region graph, then on the area graph limited to those regions and finally on the provinces limited to the areas that were found.
+// Each level only expands nodes inside the corridor of the level above it so long paths expand a small part of the province graph. When a corridor is too narrow the search falls back to flat A*.
+// Paths that start and end in the same area are cached per area. Blocking a province only clears the cache of its area and updates the cluster edges around it.
+// Searches only write to a SearchScratch and the mutex guarded subpath cache, so threads can search at the same time with their own scratch.
+class HierarchicalPathFinder {
+public:
+	// Search state of a single thread.
+	struct SearchScratch {
+		PathFinder province_path_finder;
+		PathFinder cluster_path_finder;
+		Vec<ProvinceGraph::Node> region_path;
+		Vec<ProvinceGraph::Node> area_path;
+		Vec<uint8_t> allowed_regions;
+		Vec<uint8_t> allowed_areas;
+	};
+
+	void build(const ProvinceGraph &p_graph, const ProvinceTable &p_table);
+	void clear();
+
+	// Same as PathFinder::find_path.
+	bool find_path(const ProvinceGraph &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path);
+	// Thread safe version of find_path, p_graph must not be changed while searching.
+	bool find_path(const ProvinceGraph &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path, SearchScratch &r_scratch);
+
+	// Landmark bounds used by the province level searches, can be null.
+	void set_landmark_oracle(const LandmarkOracle *p_landmark_oracle);
+
+	// Block or unblock a province in p_graph and update everything that depends on it.
+	void set_province_blocked(ProvinceGraph &p_graph, ProvinceGraph::Node p_province, bool p_blocked);
+
+	uint32_t get_cached_subpath_count() const;
+
+private:
+	using Node = ProvinceGraph::Node;
+	using SubpathCache = AHashMap<uint64_t, Vec<Node>>;
+
+	Vec<Node> province_areas; // Province node -> area
+	Vec<Node> province_regions; // Province node -> region
+	Vec<Node> area_regions; // Area -> region
+	ClusterGraph area_graph;
+	ClusterGraph region_graph;
+	Vec<SubpathCache> area_subpaths; // Area -> (from, to, domain) -> path
+	mutable Mutex subpath_mutex;
+	const LandmarkOracle *landmark_oracle = nullptr;
+	SearchScratch scratch; // Used by the single threaded find_path
+
+	static uint64_t _get_subpath_key(Node p_from, Node p_to, MovementDomain p_domain);
+	bool _find_intra_area_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path, SearchScratch &r_scratch);
+	bool _find_corridor_path(const ProvinceGraph &p_graph, Node p_from, Node p_to, MovementDomain p_domain, Vec<Node> &r_path, SearchScratch &r_scratch) const;
+	static void _set_allowed(Vec<uint8_t> &r_allowed, Node p_start, const Vec<Node> &p_path, bool p_allowed);
+};
+
+} // namespace CG
@@ -0,0 +1,109 @@
+#include "LabelGlyphCache.hpp"
+
+#include "core/io/file_access.h"
+#include "core/io/resource_loader.h"
+#include "core/io/resource_saver.h"
+#include "core/object/worker_thread_pool.h"
+#include "core/os/os.h"
+#include "core/templates/hash_set.h"
+
+#include "scene/resources/font.h"
+
+#include "cg/NodeManager.hpp"
+
+#include "ecs/components.hpp"
+#include "ecs/ecs.hpp"
+
+#include "nodes/Map3D.hpp"
+
+using namespace CG;
+
+Vec<String> LabelGlyphCache::_collect_strings() {
+	ECS &ecs = *ECS::self;
+	const Entity scopes[] = { ecs.get_scope(Scope::Province), ecs.get_scope(Scope::Area), ecs.get_scope(Scope::Region), ecs.get_scope(Scope::Country) };
+
+	HashSet<String> unique_strings;
+	for (const Entity scope : scopes)
+		scope.children([&unique_strings](Entity p_entity) {
+			if (p_entity.has<LocKey>())
+				unique_strings.insert(NM::map->atr(p_entity.get<LocKey>()));
+		});
+
+	Vec<String> strings;
+	strings.reserve(unique_strings.size());
+	for (const String &string : unique_strings)
+		strings.push_back(string);
+
+	// Sorted so the hash doesn't depend on the order entities were created in.
+	strings.sort();
+	return strings;
+}
+
+void LabelGlyphCache::_prewarm_string(void *p_jobs, uint32_t p_index) {
+	const PrewarmJobs &jobs = *static_cast<PrewarmJobs *>(p_jobs);
+
+	// Shaping generates the glyph quads which asks the TextServer for every glyph texture, this renders the glyphs that aren't cached yet.
+	LabelGlyphSurfaces surfaces;
+	AABB aabb;
+	MapLabel::shape_text((*jobs.strings)[p_index], jobs.font, surfaces, aabb);
+}
+
+String LabelGlyphCache::_get_font_identity(const Ref<Font> &p_font) {
+	String identity = vformat("%s|%s|%s", p_font->get_path(), p_font->get_font_name(), p_font->get_font_style_name());
+
+	const Ref<FontFile> font_file = p_font;
+	if (font_file.is_valid()) {
+		const PackedByteArray data = font_file->get_data();
+		identity += "|" + itos(hash_murmur3_buffer(data.ptr(), data.size()));
+	}
+
+	// The path can be a theme or font resource whose data isn't in a FontFile, its modified time still changes when it is edited.
+	const String path = p_font->get_path();
+	if (path.is_resource_file())
+		identity += "|" + itos(FileAccess::get_modified_time(path));
+
+	return identity;
+}
+
+Ref<Font> LabelGlyphCache::prewarm(bool p_persist) {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+
+	const Ref<Font> font = MapLabel::get_font_or_default();
+	ERR_FAIL_COND_V(font.is_null(), font);
+
+	// The hash covers the source font too so a changed project or theme font doesn't keep loading the old cache.
+	const Vec<String> strings = _collect_strings();
+	String joined_strings = _get_font_identity(font) + "\n";
+	for (const String &string : strings)
+		joined_strings += string + "\n";
+	const int64_t strings_hash = int64_t(joined_strings.hash64());
+
+	if (p_persist and ResourceLoader::exists(cache_path)) {
+		const Ref<FontFile> cached_font = ResourceLoader::load(cache_path, "FontFile");
+		if (cached_font.is_valid() and cached_font->has_meta(hash_meta) and int64_t(cached_font->get_meta(hash_meta)) == strings_hash) {
+			print_line("Loaded label font cache in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+			return cached_font;
+		}
+	}
+
+	PrewarmJobs jobs;
+	jobs.strings = &strings;
+	jobs.font.rids = font->get_rids();
+	jobs.font.opentype_features = font->get_opentype_features();
+
+	WorkerThreadPool *thread_pool = WorkerThreadPool::get_singleton();
+	const WorkerThreadPool::GroupID group_id = thread_pool->add_native_group_task(&LabelGlyphCache::_prewarm_string, &jobs, int(strings.size()), -1, true, "Prewarm label glyphs");
+	thread_pool->wait_for_group_task_completion(group_id);
+
+	print_line("Prewarmed label glyphs for ", strings.size(), " strings in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+
+	// Only FontFiles store their rendered glyph cache when saved.
+	const Ref<FontFile> font_file = font;
+	if (p_persist and font_file.is_valid()) {
+		font_file->set_meta(hash_meta, strings_hash);
+		if (ResourceSaver::save(font_file, cache_path) != OK)
+			WARN_PRINT("Failed to save the label font cache to " + String(cache_path));
+	}
+
+	return font;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "core/object/ref_counted.h"
+
+#include "templates/Vec.hpp"
+
+#include "MapLabel.hpp"
+
+class Font;
+
+namespace CG {
+
+// Rasterizes every glyph a map label can show when the map is loaded so new label text never has to wait for the TextServer to render glyphs.
+// The strings are the translated LocKeys of every province, area, region and country. They are shaped on the WorkerThreadPool which renders their glyphs into the font cache.
+// When persisting, the font with its rendered cache is saved to disk together with a hash of the strings and the source font so the next launch can load it instead of rendering again.
+class LabelGlyphCache {
+public:
+	// Returns the font map labels should use.
+	static Ref<Font> prewarm(bool p_persist);
+
+private:
+	static constexpr const char *cache_path = "user://label_font_cache.res";
+	static constexpr const char *hash_meta = "label_glyph_hash";
+
+	struct PrewarmJobs {
+		const Vec<String> *strings{};
+		MapLabel::LabelFont font;
+	};
+
+	static Vec<String> _collect_strings();
+	// Path, name and data hash of the source font.
+	static String _get_font_identity(const Ref<Font> &p_font);
+	static void _prewarm_string(void *p_jobs, uint32_t p_index);
+};
+
+} // namespace CG
@@ -0,0 +1,134 @@
+#include "LandmarkOracle.hpp"
+
+#include <limits>
+
+#include "core/os/os.h"
+
+#include "DistanceFields.hpp"
+
+using namespace CG;
+
+void LandmarkOracle::build(const ProvinceGraph &p_graph) {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	clear();
+	graph = &p_graph;
+
+	for (int domain = 0; domain < int(MovementDomain::MOVEMENT_DOMAIN_MAX); ++domain)
+		_build_domain(MovementDomain(domain));
+
+	build_time_usec = OS::get_singleton()->get_ticks_usec() - start_time;
+	print_line("Built ", landmarks[int(MovementDomain::Land)].size() + landmarks[int(MovementDomain::Naval)].size(), " path landmarks in ", build_time_usec / 1000.0, " ms using ", get_memory_usage() / 1024.0, " KiB");
+}
+
+void LandmarkOracle::clear() {
+	graph = nullptr;
+	for (int domain = 0; domain < int(MovementDomain::MOVEMENT_DOMAIN_MAX); ++domain) {
+		landmarks[domain].clear();
+		landmark_costs[domain].clear();
+	}
+	build_time_usec = 0;
+}
+
+float LandmarkOracle::get_lower_bound(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain) const {
+	ERR_FAIL_NULL_V(graph, 0.0);
+	ERR_FAIL_UNSIGNED_INDEX_V(p_from, graph->get_node_count(), 0.0);
+	ERR_FAIL_UNSIGNED_INDEX_V(p_to, graph->get_node_count(), 0.0);
+
+	// Edge costs are never smaller than the straight line distance.
+	float bound = graph->get_position(p_from).distance_to(graph->get_position(p_to));
+
+	const Vec<float> &costs = landmark_costs[int(p_domain)];
+	const uint32_t domain_landmark_count = landmarks[int(p_domain)].size();
+	if (costs.is_empty())
+		return bound;
+
+	const float *from_costs = costs.ptr() + p_from * landmark_count;
+	const float *to_costs = costs.ptr() + p_to * landmark_count;
+	for (uint32_t i = 0; i < domain_landmark_count; ++i) {
+		const bool from_reachable = from_costs[i] != std::numeric_limits<float>::infinity();
+		const bool to_reachable = to_costs[i] != std::numeric_limits<float>::infinity();
+		if (!from_reachable and !to_reachable)
+			continue;
+
+		// Only one of them can be reached from the landmark so they are in different components.
+		if (from_reachable != to_reachable)
+			return std::numeric_limits<float>::infinity();
+
+		bound = MAX(bound, Math::abs(from_costs[i] - to_costs[i]));
+	}
+
+	return bound;
+}
+
+const Vec<ProvinceGraph::Node> &LandmarkOracle::get_landmarks(MovementDomain p_domain) const { return landmarks[int(p_domain)]; }
+
+bool LandmarkOracle::is_built() const { return graph != nullptr; }
+
+uint64_t LandmarkOracle::get_memory_usage() const {
+	uint64_t memory = 0;
+	for (int domain = 0; domain < int(MovementDomain::MOVEMENT_DOMAIN_MAX); ++domain)
+		memory += landmarks[domain].size() * sizeof(ProvinceGraph::Node) + landmark_costs[domain].size() * sizeof(float);
+	return memory;
+}
+
+uint64_t LandmarkOracle::get_build_time_usec() const { return build_time_usec; }
+
+void LandmarkOracle::_build_domain(MovementDomain p_domain) {
+	const uint32_t node_count = graph->get_node_count();
+
+	ProvinceGraph::Node start = ProvinceGraph::INVALID_NODE;
+	for (ProvinceGraph::Node node = 0; node < node_count and start == ProvinceGraph::INVALID_NODE; ++node)
+		for (uint32_t edge = graph->get_edge_begin(node); edge < graph->get_edge_end(node); ++edge)
+			if (graph->get_edge_cost(edge, p_domain) != std::numeric_limits<float>::infinity())
+				start = node;
+
+	if (start == ProvinceGraph::INVALID_NODE)
+		return;
+
+	// Farthest point selection: the first landmark is the node farthest from the start and every next landmark is the node farthest from all landmarks picked so far.
+	// The selection field has every picked landmark as a source so each step only propagates the new landmark.
+	DistanceFields fields;
+	fields.init(graph);
+	const DistanceFields::FieldID selection_field = fields.create_field(p_domain);
+	fields.set_sources(selection_field, { start });
+	fields.update();
+
+	Vec<ProvinceGraph::Node> &domain_landmarks = landmarks[int(p_domain)];
+	while (domain_landmarks.size() < landmark_count) {
+		const Vec<float> &distances = fields.get_distances(selection_field);
+		ProvinceGraph::Node farthest = ProvinceGraph::INVALID_NODE;
+		float farthest_cost = 0.0;
+		for (ProvinceGraph::Node node = 0; node < node_count; ++node) {
+			if (distances[node] != std::numeric_limits<float>::infinity() and distances[node] > farthest_cost) {
+				farthest = node;
+				farthest_cost = distances[node];
+			}
+		}
+
+		if (farthest == ProvinceGraph::INVALID_NODE)
+			break;
+
+		if (domain_landmarks.is_empty())
+			fields.set_sources(selection_field, { farthest });
+		else
+			fields.add_source(selection_field, farthest);
+
+		domain_landmarks.push_back(farthest);
+		fields.update();
+	}
+
+	// The cost from every landmark is computed on its own worker thread.
+	Vec<DistanceFields::FieldID> landmark_fields;
+	for (const ProvinceGraph::Node landmark : domain_landmarks) {
+		const DistanceFields::FieldID field = fields.create_field(p_domain);
+		fields.set_sources(field, { landmark });
+		landmark_fields.push_back(field);
+	}
+	fields.update();
+
+	Vec<float> &costs = landmark_costs[int(p_domain)];
+	costs.resize(node_count * landmark_count);
+	for (ProvinceGraph::Node node = 0; node < node_count; ++node)
+		for (uint32_t i = 0; i < landmark_count; ++i)
+			costs[node * landmark_count + i] = i < landmark_fields.size() ? fields.get_distance(landmark_fields[i], node) : std::numeric_limits<float>::infinity();
+}
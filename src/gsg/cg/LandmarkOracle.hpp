@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ProvinceGraph.hpp"
+
+namespace CG {
+
+// Lower bounds for the travel cost between two provinces using landmarks (ALT).
+// Each MovementDomain picks landmark_count landmarks that are far apart and stores the cost from every landmark to every node.
+// By the triangle inequality |d(L, a) - d(L, b)| <= d(a, b) for every landmark L, so a query only reads landmark_count costs per node.
+// The costs are from the graph at build time, blocking provinces afterwards only makes paths longer so the bounds stay valid.
+// The bounds are never smaller than the straight line distance which makes them a tighter A* heuristic.
+class LandmarkOracle {
+public:
+	static constexpr uint32_t landmark_count = 8;
+
+	void build(const ProvinceGraph &p_graph);
+	void clear();
+
+	// Lower bound of the cost from p_from to p_to, infinity if p_to wasn't reachable from p_from when the oracle was built.
+	float get_lower_bound(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain) const;
+	const Vec<ProvinceGraph::Node> &get_landmarks(MovementDomain p_domain) const;
+
+	bool is_built() const;
+	uint64_t get_memory_usage() const; // In bytes
+	uint64_t get_build_time_usec() const;
+
+private:
+	const ProvinceGraph *graph = nullptr;
+	Vec<ProvinceGraph::Node> landmarks[int(MovementDomain::MOVEMENT_DOMAIN_MAX)];
+	Vec<float> landmark_costs[int(MovementDomain::MOVEMENT_DOMAIN_MAX)]; // Node * landmark_count + landmark -> cost, so the costs of a node are next to each other
+	uint64_t build_time_usec = 0;
+
+	void _build_domain(MovementDomain p_domain);
+};
+
+} // namespace CG
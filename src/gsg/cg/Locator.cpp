@@ -137,7 +137,18 @@ void EditorLocators::_load_locators(LocatorMap &p_locator_map, const String &p_c
 			} else {
 				// Generate new locator
 				Locator locator;
-				locator.position = province_data_config->get_value(itos(i), "centroid");
+				const String section = itos(i);
+
+				// Text locators use the label placement from the map data bake when it exists so new labels already fit inside their province.
+				if (p_locator == LocatorType::Text and province_data_config->has_section_key(section, "label_position")) {
+					locator.position = province_data_config->get_value(section, "label_position");
+					locator.orientation = province_data_config->get_value(section, "label_orientation");
+					locator.scale = province_data_config->get_value(section, "label_scale");
+					p_locator_map[i] = locator;
+					continue;
+				}
+
+				locator.position = province_data_config->get_value(section, "centroid");
 
 				// For unit locators only need to generate the position but for text need to also generate the orientation.
 				if (p_locator == LocatorType::Text)
@@ -169,6 +180,31 @@ void EditorLocators::load() {
 	_load_locators(text_locators, "res://data/locators/text.cfg", LocatorType::Text);
 }
 
+int EditorLocators::apply_label_placement() {
+	const Ref<ConfigFile> province_data_config = memnew(ConfigFile());
+	if (province_data_config->load("res://data/gen/province_data.cfg") != OK)
+		return 0;
+
+	int count = 0;
+	for (const Entity entity : get_locator_vec(LocatorType::Text)) {
+		const int i = int(entity) + 1;
+		const String section = itos(i);
+		if (!province_data_config->has_section_key(section, "label_position"))
+			continue;
+
+		Locator locator;
+		locator.position = province_data_config->get_value(section, "label_position");
+		locator.orientation = province_data_config->get_value(section, "label_orientation");
+		locator.scale = province_data_config->get_value(section, "label_scale");
+		text_locators[i] = locator;
+		count++;
+	}
+
+	set_dirty(LocatorType::Text);
+	save(LocatorType::Text);
+	return count;
+}
+
 void EditorLocators::_save_config(const LocatorMap &p_locator_map, const String &p_cfg_path, LocatorType p_locator_type) {
 	switch (p_locator_type) {
 		case LocatorType::Unit: {
@@ -51,6 +51,8 @@ public:
 	bool has_locator(LocatorType p_locator_type, int p_province_id);
 
 	void load();
+	// Replace every text locator with the label placement from the map data bake and save them. Returns the number of replaced locators.
+	int apply_label_placement();
 	void set_dirty(LocatorType p_locator_type);
 	void save(LocatorType p_locator_type);
 	void save_all();
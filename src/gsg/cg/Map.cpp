@@ -1,20 +1,25 @@
 #include "Map.hpp"
 
+#include <iterator>
+
 #include "core/crypto/hashing_context.h"
 #include "core/io/config_file.h"
 #include "core/io/file_access.h"
+#include "core/object/worker_thread_pool.h"
 #include "core/os/memory.h"
+#include "core/os/os.h"
 #include "core/variant/typed_dictionary.h"
 
 #include "scene/3d/node_3d.h"
-#include "scene/3d/sprite_3d.h"
 #include "scene/resources/compressed_texture.h"
+#include "scene/resources/font.h"
 #include "scene/resources/mesh.h"
 #include "scene/resources/shader.h"
 #include "scene/resources/surface_tool.h"
 
 #include "cg/csv.hpp"
 #include "cg/MapMode.hpp"
+#include "cg/SaveGame.hpp"
 
 #include "ecs/components.hpp"
 #include "ecs/ecs.hpp"
@@ -22,15 +27,66 @@
 #include "ecs/Provinces.hpp"
 #include "ecs/tags.hpp"
 
+#include "LabelGlyphCache.hpp"
 #include "MapLabel.hpp"
-#include "MapUnit.hpp"
+#include "MapLabelBatch.hpp"
+#include "MapLabelShaper.hpp"
+#include "MapUnits.hpp"
 #include "MapUtils.hpp"
 
 using namespace CG;
 
 static constexpr int COLOR_TEXTURE_DIMENSIONS = 255;
+static constexpr bool persist_label_glyph_cache = true;
+
+// Label placement baking
+static constexpr float distance_transform_inside = 1e20; // Finite so the distance transform never computes inf - inf.
+static constexpr int label_rect_height_steps = 16;
+static constexpr float label_rect_sample_step = 0.5;
+static constexpr float reference_label_length = 8.0; // Glyphs, the label text isn't known when baking so the scale is fit to a label of this length.
+static constexpr float label_fill = 0.9;
 const Color discard_color = Color(0, 0, 0);
 
+static constexpr const char *province_types[] = { "land", "ocean", "river", "impassable", "uninhabitable" };
+static constexpr int province_type_count = std::size(province_types);
+static constexpr ProvinceType province_type_values[province_type_count] = { ProvinceType::Land, ProvinceType::Ocean, ProvinceType::River, ProvinceType::Impassable, ProvinceType::Uninhabitable };
+
+// Index into province_types, province_type_count if the type is unknown.
+static int get_province_type_index(const String &p_type) {
+	int type_index = 0;
+	while (type_index < province_type_count and province_types[type_index] != p_type)
+		type_index++;
+	return type_index;
+}
+
+static ecs_id_t get_province_type_tag(int p_type_index) {
+	ECS &ecs = *ECS::self;
+	const ecs_id_t province_type_tags[province_type_count] = { ecs.id<LandProvinceTag>(), ecs.id<OceanProvinceTag>(), ecs.id<RiverProvinceTag>(), ecs.id<ImpassableProvinceTag>(), ecs.id<UninhabitableProvinceTag>() };
+	return p_type_index < province_type_count ? province_type_tags[p_type_index] : 0;
+}
+
+static ecs_id_t get_province_type_tag(ProvinceType p_type) {
+	ECS &ecs = *ECS::self;
+	switch (p_type) {
+		case ProvinceType::Land: return ecs.id<LandProvinceTag>();
+		case ProvinceType::Ocean: return ecs.id<OceanProvinceTag>();
+		case ProvinceType::River: return ecs.id<RiverProvinceTag>();
+		case ProvinceType::Lake: return ecs.id<LakeProvinceTag>();
+		case ProvinceType::Impassable: return ecs.id<ImpassableProvinceTag>();
+		case ProvinceType::Uninhabitable: return ecs.id<UninhabitableProvinceTag>();
+		case ProvinceType::None: break;
+	}
+	return 0;
+}
+
+static Transform3D get_text_transform(const TextLocator &p_locator) {
+	Transform3D text_transform;
+	text_transform.origin = Vector3(p_locator.position.x, label_map_layer, p_locator.position.y);
+	text_transform.basis.scale(Vector3(p_locator.scale, p_locator.scale, p_locator.scale));
+	text_transform.basis.rotate(Vector3(-1.570796, p_locator.orientation, 0.0));
+	return text_transform;
+}
+
 Vector2 Map::calculate_centroid(const Polygon &p_polygon) {
 	Vector2 sum = Vector2(0, 0);
 	for (const Vector2 &point : p_polygon)
@@ -64,6 +120,128 @@ Map::CachedMapData Map::calc_map_data(const Polygon &p_polygon, const Vector2 &p
 	return { .orientation = float(Math::rad_to_deg(0.5 * Math::atan2(2 * mu11, mu20 - mu02))), .aabb = AABB(Vector3(min_x, 0, min_y), Vector3(max_x - min_x, 0, max_y - min_y)) };
 }
 
+void Map::distance_transform(Vec<float> &r_grid, int p_width, int p_height) {
+	// Exact squared euclidean distance transform, Felzenszwalb & Huttenlocher. Runs the 1D transform over every column and then every row.
+	const int n = MAX(p_width, p_height);
+	Vec<float> f;
+	Vec<float> d;
+	Vec<float> z;
+	Vec<int> v;
+	f.resize(n);
+	d.resize(n);
+	z.resize(n + 1);
+	v.resize(n);
+
+	const auto transform_1d = [&](int p_count) {
+		int k = 0;
+		v[0] = 0;
+		z[0] = -distance_transform_inside;
+		z[1] = distance_transform_inside;
+
+		for (int q = 1; q < p_count; ++q) {
+			float s = ((f[q] + float(q * q)) - (f[v[k]] + float(v[k] * v[k]))) / float(2 * q - 2 * v[k]);
+			while (s <= z[k]) {
+				k--;
+				s = ((f[q] + float(q * q)) - (f[v[k]] + float(v[k] * v[k]))) / float(2 * q - 2 * v[k]);
+			}
+			k++;
+			v[k] = q;
+			z[k] = s;
+			z[k + 1] = distance_transform_inside;
+		}
+
+		k = 0;
+		for (int q = 0; q < p_count; ++q) {
+			while (z[k + 1] < float(q))
+				k++;
+			d[q] = float((q - v[k]) * (q - v[k])) + f[v[k]];
+		}
+	};
+
+	for (int x = 0; x < p_width; ++x) {
+		for (int y = 0; y < p_height; ++y)
+			f[y] = r_grid[(y * p_width) + x];
+		transform_1d(p_height);
+		for (int y = 0; y < p_height; ++y)
+			r_grid[(y * p_width) + x] = d[y];
+	}
+
+	for (int y = 0; y < p_height; ++y) {
+		for (int x = 0; x < p_width; ++x)
+			f[x] = r_grid[(y * p_width) + x];
+		transform_1d(p_width);
+		for (int x = 0; x < p_width; ++x)
+			r_grid[(y * p_width) + x] = d[x];
+	}
+}
+
+Map::LabelPlacement Map::calc_label_placement(const Vec<Vector2> &p_pixels, const CachedMapData &p_map_data) {
+	// Grid over the province AABB with a 1 pixel border so every province pixel has an outside pixel to measure the distance to.
+	const Vector2 origin = Vector2(p_map_data.aabb.position.x, p_map_data.aabb.position.z) - Vector2(1, 1);
+	const int width = int(p_map_data.aabb.size.x) + 3;
+	const int height = int(p_map_data.aabb.size.z) + 3;
+
+	Vec<float> grid;
+	grid.resize(width * height);
+	for (float &distance : grid)
+		distance = 0.0;
+	for (const Vector2 &pixel : p_pixels)
+		grid[(int(pixel.y - origin.y) * width) + int(pixel.x - origin.x)] = distance_transform_inside;
+
+	distance_transform(grid, width, height);
+
+	// The pole of inaccessibility is the pixel furthest away from the province border.
+	uint32_t pole_index = 0;
+	for (uint32_t i = 1; i < grid.size(); ++i)
+		if (grid[i] > grid[pole_index])
+			pole_index = i;
+
+	const Vector2 pole = Vector2(float(pole_index % width) + 0.5, float(pole_index / width) + 0.5);
+	const float radius = Math::sqrt(grid[pole_index]);
+
+	const auto is_inside = [&](const Vector2 &p_point) {
+		const int x = int(Math::floor(p_point.x));
+		const int y = int(Math::floor(p_point.y));
+		return x >= 0 and y >= 0 and x < width and y < height and grid[(y * width) + x] > 0.0;
+	};
+
+	// Grow rectangles of different heights along the principal axis from the pole and keep the one that fits the largest label.
+	const float angle = Math::deg_to_rad(p_map_data.orientation);
+	const Vector2 axis = Vector2(Math::cos(angle), Math::sin(angle));
+	const Vector2 normal = Vector2(-axis.y, axis.x);
+	const float reference_width = reference_label_length * MapLabel::average_glyph_width;
+
+	LabelPlacement placement;
+	placement.position = origin + pole;
+	placement.orientation = -angle; // Locator rotation is around the up axis so it turns the other way.
+
+	for (int i = 1; i <= label_rect_height_steps; ++i) {
+		const float half_height = radius * float(i) / label_rect_height_steps;
+
+		float half_width = 0.0;
+		while (true) {
+			const float next_half_width = half_width + label_rect_sample_step;
+			bool fits = true;
+			for (float t = -half_height; t <= half_height and fits; t += label_rect_sample_step)
+				fits = is_inside(pole + (axis * next_half_width) + (normal * t)) and is_inside(pole - (axis * next_half_width) + (normal * t));
+
+			if (!fits)
+				break;
+			half_width = next_half_width;
+		}
+
+		const float scale = MIN(2.0 * half_height / MapLabel::line_height, 2.0 * half_width / reference_width) * label_fill;
+		placement.scale = MAX(placement.scale, scale);
+	}
+
+	return placement;
+}
+
+void Map::bake_label_placement(void *p_jobs, uint32_t p_index) {
+	LabelPlacementJob &job = static_cast<LabelPlacementJob *>(p_jobs)[p_index];
+	job.placement = calc_label_placement(*job.pixels, job.map_data);
+}
+
 Color Map::get_random_area_color() { return { CLAMP(Math::randf(), float(76), float(178)), CLAMP(Math::randf(), float(76), float(178)), CLAMP(Math::randf(), float(76), float(178)) }; }
 
 Color Map::get_lookup_color(ProvinceIndex p_province_id) {
@@ -71,29 +249,10 @@ Color Map::get_lookup_color(ProvinceIndex p_province_id) {
 		static_cast<float>(std::floor(float(p_province_id) / COLOR_TEXTURE_DIMENSIONS) / (COLOR_TEXTURE_DIMENSIONS - 1)), 0.0 };
 }
 
-ProvinceColorMap Map::load_map_config() {
-	ECS &ecs = *ECS::self;
-
-	ProvinceColorMap provinces_map{};
-
-	const Ref<ConfigFile> province_config = memnew(ConfigFile());
-	const Ref<ConfigFile> area_config = memnew(ConfigFile());
-	const Ref<ConfigFile> region_config = memnew(ConfigFile());
-	const Ref<ConfigFile> country_config = memnew(ConfigFile());
-
-	if (province_config->load("res://data/provinces.cfg") != OK)
-		return provinces_map;
-	if (country_config->load("res://data/countries.cfg") != OK)
-		return provinces_map;
-	if (region_config->load("res://data/regions.cfg") != OK)
-		return provinces_map;
-	if (area_config->load("res://data/areas.cfg") != OK)
-		return provinces_map;
+Vector2i Map::get_province_texel(ProvinceIndex p_province_id) { return { p_province_id % COLOR_TEXTURE_DIMENSIONS, p_province_id / COLOR_TEXTURE_DIMENSIONS }; }
 
-	const Vector<String> province_sections = province_config->get_sections();
-	const Vector<String> country_sections = country_config->get_sections();
-	const Vector<String> region_sections = region_config->get_sections();
-	const Vector<String> area_sections = area_config->get_sections();
+void Map::register_components() {
+	ECS &ecs = *ECS::self;
 
 	// Register variant components
 	ecs.component<LocKey>();
@@ -101,14 +260,16 @@ ProvinceColorMap Map::load_map_config() {
 	ecs.component<AABB>();
 
 	// Register components
-	ecs.component<CrossingLocator>();
 	ecs.component<ProvinceBorderMeshRID>();
 	ecs.component<UnitLocator>();
 	ecs.component<TextLocator>();
-	ecs.component<ProvinceAdjacencyType>();
 	ecs.component<ProvinceBorderType>();
 	ecs.component<Player>();
+	ecs.component<Treasury>();
 	ecs.component<UnitModel>();
+	ecs.component<UnitPath>();
+	ecs.component<UnitProgress>();
+	ecs.component<UnitPosition>();
 
 	// Register tag components
 	ecs.component<AreaTag>();
@@ -130,138 +291,518 @@ ProvinceColorMap Map::load_map_config() {
 
 	// Create all relationship entities
 	ecs.register_relations();
+}
+
+ProvinceColorMap Map::load_map_config() {
+	ProvinceColorMap provinces_map{};
+
+	const Ref<ConfigFile> province_config = memnew(ConfigFile());
+	const Ref<ConfigFile> area_config = memnew(ConfigFile());
+	const Ref<ConfigFile> region_config = memnew(ConfigFile());
+	const Ref<ConfigFile> country_config = memnew(ConfigFile());
+
+	if (province_config->load(map_config_paths[PROVINCE_CONFIG]) != OK)
+		return provinces_map;
+	if (country_config->load(map_config_paths[COUNTRY_CONFIG]) != OK)
+		return provinces_map;
+	if (region_config->load(map_config_paths[REGION_CONFIG]) != OK)
+		return provinces_map;
+	if (area_config->load(map_config_paths[AREA_CONFIG]) != OK)
+		return provinces_map;
+
+	loaded_configs[PROVINCE_CONFIG] = province_config;
+	loaded_configs[AREA_CONFIG] = area_config;
+	loaded_configs[REGION_CONFIG] = region_config;
+	loaded_configs[COUNTRY_CONFIG] = country_config;
 
-	for (const String &section : province_sections) {
+	// The configs are read into a save so they are created in bulk with their relationship pairs the same way a save is loaded.
+	SaveGame save;
+
+	for (const String &section : province_config->get_sections()) {
 		const ProvinceIndex province_id = section.to_int();
 		if (province_id == 0) // Skip first ID to avoid problems with lookup texture.
 			continue;
 
 		Color map_color = province_config->get_value(section, "color");
 		map_color = Color::from_rgba8(map_color.r, map_color.g, map_color.b);
+		provinces_map[map_color] = province_id;
 
-		const String province_type = province_config->get_value(section, "type", "land");
+		const int type_index = get_province_type_index(province_config->get_value(section, "type", "land"));
+		save.provinces.push_back({ .id = province_id, .type = type_index < province_type_count ? province_type_values[type_index] : ProvinceType::None, .loc_key = String("PROV") + section });
+	}
 
-		const String province_name = uitos(province_id);
-		const ProvinceEntity province_entity = ecs.entity(province_name.utf8().ptr());
-		province_entity.child_of(ecs.get_scope(Scope::Province));
+	AHashMap<String, uint32_t> area_indices;
+	for (const String &section : area_config->get_sections()) {
+		const Color color = area_config->get_value(section, "color", get_random_area_color());
+		SaveGame::Area area{ .name = section, .loc_key = section, .color = Color::from_rgba8(color.r, color.g, color.b), .capital = int(area_config->get_value(section, "capital")) };
 
-		province_entity.set<LocKey>(String("PROV") + section);
-		province_entity.add<ProvinceTag>();
+		const PackedInt32Array area_provinces_config = area_config->get_value(section, "provinces");
+		for (const int province : area_provinces_config)
+			area.provinces.push_back(province);
 
-		if (province_type == "land")
-			province_entity.add<LandProvinceTag>();
-		else if (province_type == "ocean")
-			province_entity.add<OceanProvinceTag>();
-		else if (province_type == "river")
-			province_entity.add<RiverProvinceTag>();
-		else if (province_type == "impassable")
-			province_entity.add<ImpassableProvinceTag>();
-		else if (province_type == "uninhabitable")
-			province_entity.add<UninhabitableProvinceTag>();
+		area_indices.insert(section, save.areas.size());
+		save.areas.push_back(area);
+	}
 
-		provinces_map[map_color] = province_id;
+	for (const String &section : region_config->get_sections()) {
+		const Color color = region_config->get_value(section, "color", get_random_area_color());
+		SaveGame::Region region{ .name = section, .loc_key = section, .color = Color::from_rgba8(color.r, color.g, color.b), .capital = int(region_config->get_value(section, "capital")) };
 
-		const Color lookup_color = get_lookup_color(province_id);
-		color_to_id_map[lookup_color] = province_id;
+		const PackedStringArray region_areas_config = region_config->get_value(section, "areas");
+		for (const String &area : region_areas_config)
+			if (const uint32_t *area_index = area_indices.getptr(area); area_index != nullptr)
+				region.areas.push_back(*area_index);
+		save.regions.push_back(region);
 	}
 
-	for (const String &section : area_sections) {
-		Color color = area_config->get_value(section, "color", get_random_area_color());
-		color = Color::from_rgba8(color.r, color.g, color.b);
+	// Every country starts with a unit at its capital.
+	for (const String &section : country_config->get_sections()) {
+		const Color color = country_config->get_value(section, "color", get_random_area_color());
+		const PackedInt32Array owned_provinces_config = country_config->get_value(section, "provinces");
+		SaveGame::Country country{ .name = section, .loc_key = section, .color = Color::from_rgba8(color.r, color.g, color.b), .capital = int(country_config->get_value(section, "capital")), .treasury = { .income = owned_provinces_config.size() * Simulation::province_income } };
+		for (const int province : owned_provinces_config)
+			country.provinces.push_back(province);
 
-		const String capital = area_config->get_value(section, "capital");
+		save.units.push_back({ .owner = save.countries.size(), .location = country.capital });
+		save.countries.push_back(country);
+	}
 
-		const ProvinceEntity capital_entity = ecs.scope_lookup(Scope::Province, capital);
-		const AreaEntity area_entity = ecs.entity(section.utf8().ptr());
-		area_entity.child_of(ecs.get_scope(Scope::Area));
+	load_save_game(save);
 
-		const PackedInt32Array area_provinces_config = area_config->get_value(section, "provinces");
-		for (const int province : area_provinces_config) {
-			const ProvinceEntity province_entity = ecs.scope_lookup(Scope::Province, uitos(province));
-			province_entity.add(Relationship(InArea), area_entity);
-			area_entity.add(Relationship(ProvinceIn), province_entity);
-		}
+	return provinces_map;
+}
 
-		area_entity.add<AreaTag>();
-		area_entity.add(Relationship(Capital), capital_entity);
+void Map::bulk_create_entities(Scope p_scope, const Vec<String> &p_names, const Vec<ecs_id_t> &p_ids, const Vec<const void *> &p_data, Vec<ecs_entity_t> &r_entities) {
+	ECS &ecs = *ECS::self;
+	ERR_FAIL_COND(p_ids.size() != p_data.size() or p_ids.size() + 2 > FLECS_ID_DESC_MAX);
+	ERR_FAIL_COND(!r_entities.is_empty() and r_entities.size() != p_names.size());
+	if (p_names.is_empty())
+		return;
 
-		area_entity.set<Color>(color);
-		area_entity.set<LocKey>(section);
+	// The name is added as an empty identifier so naming the entities afterwards doesn't move them to another table.
+	ecs_bulk_desc_t desc{};
+	void *data[FLECS_ID_DESC_MAX]{};
+	desc.count = int32_t(p_names.size());
+	desc.entities = r_entities.is_empty() ? nullptr : r_entities.ptr();
+	desc.ids[0] = ecs_childof(ecs.get_scope(p_scope).id());
+	desc.ids[1] = ecs_pair(ecs_id(EcsIdentifier), EcsName);
+
+	for (uint32_t i = 0; i < p_ids.size(); ++i) {
+		desc.ids[i + 2] = p_ids[i];
+		data[i + 2] = const_cast<void *>(p_data[i]);
 	}
+	desc.data = data;
 
-	for (const String &section : region_sections) {
-		Color color = region_config->get_value(section, "color", get_random_area_color());
-		color = Color::from_rgba8(color.r, color.g, color.b);
+	const ecs_entity_t *entities = ecs_bulk_init(ecs.c_ptr(), &desc);
+	if (r_entities.is_empty())
+		for (uint32_t i = 0; i < p_names.size(); ++i)
+			r_entities.push_back(entities[i]);
 
-		const String capital = region_config->get_value(section, "capital");
-		const ProvinceEntity capital_entity = ecs.scope_lookup(Scope::Province, capital);
+	for (uint32_t i = 0; i < p_names.size(); ++i)
+		ecs_set_name(ecs.c_ptr(), r_entities[i], p_names[i].utf8().ptr());
+}
 
-		const RegionEntity region_entity = ecs.entity(section.utf8().ptr());
-		region_entity.child_of(ecs.get_scope(Scope::Region));
+Error Map::save_game(const String &p_path) const {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	ECS &ecs = *ECS::self;
+	SaveGame save;
+
+	const auto province_query = ecs.query_builder<const LocKey, const TextLocator *, const UnitLocator *, const AABB *>().with<ProvinceTag>().build();
+	province_query.each([this, &save](Entity p_province, const LocKey &p_loc_key, const TextLocator *p_text_locator, const UnitLocator *p_unit_locator, const AABB *p_aabb) {
+		SaveGame::Province province;
+		province.id = get_province_index(p_province);
+		province.type = get_province_type(p_province);
+		province.loc_key = p_loc_key;
+		if (p_text_locator != nullptr) {
+			province.flags |= SaveGame::HAS_TEXT_LOCATOR;
+			province.text_locator = *p_text_locator;
+		}
+		if (p_unit_locator != nullptr) {
+			province.flags |= SaveGame::HAS_UNIT_LOCATOR;
+			province.unit_locator = *p_unit_locator;
+		}
+		if (p_aabb != nullptr) {
+			province.flags |= SaveGame::HAS_AABB;
+			province.aabb = *p_aabb;
+		}
+		save.provinces.push_back(province);
+	});
 
-		const PackedStringArray region_areas_config = region_config->get_value(section, "areas");
-		for (const String &area : region_areas_config) {
-			const AreaEntity area_entity = ecs.scope_lookup(Scope::Area, area);
-			area_entity.add(Relationship(InRegion), region_entity);
+	// Entities are referenced by their index in the save, regions first so areas can add themselves to their region.
+	AHashMap<Entity, uint32_t, EntityHasher> region_indices;
+	ecs.get_scope(Scope::Region).children([this, &ecs, &save, &region_indices](Entity p_region) {
+		region_indices.insert(p_region, save.regions.size());
+		save.regions.push_back({ .name = String::utf8(p_region.name().c_str()), .loc_key = p_region.get<LocKey>(), .color = p_region.get<Color>(), .capital = get_province_index(ecs.get_target(p_region, Relation::Capital)) });
+	});
 
-			int idx = 0;
-			Entity province_entity;
-			while ((province_entity = area_entity.target(Relationship(ProvinceIn), idx++)))
-				province_entity.add(Relationship(InRegion), region_entity);
-		}
+	ecs.get_scope(Scope::Area).children([this, &ecs, &save, &region_indices](Entity p_area) {
+		SaveGame::Area area{ .name = String::utf8(p_area.name().c_str()), .loc_key = p_area.get<LocKey>(), .color = p_area.get<Color>(), .capital = get_province_index(ecs.get_target(p_area, Relation::Capital)) };
 
-		region_entity.add<AreaTag>();
-		region_entity.add(Relationship(Capital), capital_entity);
+		int idx = 0;
+		Entity province_entity;
+		while ((province_entity = p_area.target(Relationship(ProvinceIn), idx++)))
+			area.provinces.push_back(get_province_index(province_entity));
 
-		region_entity.set<Color>(color);
-		region_entity.set<LocKey>(section);
+		if (const uint32_t *region_index = region_indices.getptr(ecs.get_target(p_area, Relation::InRegion)); region_index != nullptr)
+			save.regions[*region_index].areas.push_back(save.areas.size());
+		save.areas.push_back(area);
+	});
+
+	AHashMap<Entity, uint32_t, EntityHasher> country_indices;
+	ecs.get_scope(Scope::Country).children([this, &ecs, &save, &country_indices](Entity p_country) {
+		country_indices.insert(p_country, save.countries.size());
+		save.countries.push_back({ .name = String::utf8(p_country.name().c_str()),
+				.loc_key = p_country.get<LocKey>(),
+				.color = p_country.get<Color>(),
+				.capital = get_province_index(ecs.get_target(p_country, Relation::Capital)),
+				.treasury = p_country.get<Treasury>(),
+				.provinces = country_provinces.get_provinces(p_country) });
+	});
+
+	// Units that are moving are saved in the province they are in, their paths are requested again by the player.
+	const auto unit_query = ecs.query_builder<>().with<UnitTag>().build();
+	unit_query.each([this, &ecs, &save, &country_indices](UnitEntity p_unit) {
+		const uint32_t *owner_index = country_indices.getptr(ecs.get_target(p_unit, Relation::Owner));
+		save.units.push_back({ .owner = owner_index != nullptr ? *owner_index : SaveGame::NO_INDEX, .location = get_province_index(ecs.get_target(p_unit, Relation::Location)) });
+	});
+
+	const uint32_t *player_index = country_indices.getptr(ecs.get<Player>());
+	save.player = player_index != nullptr ? *player_index : SaveGame::NO_INDEX;
+
+	const Error error = save.save(p_path);
+	if (error == OK)
+		print_line("Saved ", save.provinces.size(), " provinces and ", save.units.size(), " units to ", p_path, " in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+	return error;
+}
+
+void Map::load_save_game(const SaveGame &p_save) {
+	ECS &ecs = *ECS::self;
+	register_components();
+
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+
+	country_provinces.clear();
+
+	// Areas, regions and countries are created first so provinces and units can be created with their relationship pairs in their final archetype.
+	Vec<String> area_names;
+	Vec<Color> area_colors;
+	Vec<LocKey> area_loc_keys;
+	for (const SaveGame::Area &area : p_save.areas) {
+		area_names.push_back(area.name);
+		area_colors.push_back(area.color);
+		area_loc_keys.push_back(area.loc_key);
+	}
+
+	Vec<ecs_entity_t> area_entities;
+	bulk_create_entities(Scope::Area, area_names, { ecs.id<AreaTag>(), ecs.id<Color>(), ecs.id<LocKey>() }, { nullptr, area_colors.ptr(), area_loc_keys.ptr() }, area_entities);
+
+	Vec<String> region_names;
+	Vec<Color> region_colors;
+	Vec<LocKey> region_loc_keys;
+	for (const SaveGame::Region &region : p_save.regions) {
+		region_names.push_back(region.name);
+		region_colors.push_back(region.color);
+		region_loc_keys.push_back(region.loc_key);
 	}
 
+	Vec<ecs_entity_t> region_entities;
+	bulk_create_entities(Scope::Region, region_names, { ecs.id<RegionTag>(), ecs.id<Color>(), ecs.id<LocKey>() }, { nullptr, region_colors.ptr(), region_loc_keys.ptr() }, region_entities);
+
 	const CountryEntity observer_country_entity = ecs.entity(OBSERVER_TAG);
 	observer_country_entity.set<LocKey>(String(OBSERVER_TAG));
 	ecs.set<Player>(observer_country_entity);
 
-	for (const String &section : country_sections) {
-		Color color = country_config->get_value(section, "color", get_random_area_color());
-		color = Color::from_rgba8(color.r, color.g, color.b);
+	Vec<String> country_names;
+	Vec<Color> country_colors;
+	Vec<LocKey> country_loc_keys;
+	Vec<Treasury> country_treasuries;
+	for (const SaveGame::Country &country : p_save.countries) {
+		country_names.push_back(country.name);
+		country_colors.push_back(country.color);
+		country_loc_keys.push_back(country.loc_key);
+		country_treasuries.push_back(country.treasury);
+	}
 
-		const PackedInt32Array owned_provinces_config = country_config->get_value(section, "provinces");
-		const String capital = country_config->get_value(section, "capital");
-		const ProvinceEntity capital_entity = ecs.scope_lookup(Scope::Province, capital);
+	Vec<ecs_entity_t> country_entities;
+	bulk_create_entities(Scope::Country, country_names, { ecs.id<CountryTag>(), ecs.id<Color>(), ecs.id<LocKey>(), ecs.id<Treasury>() },
+			{ nullptr, country_colors.ptr(), country_loc_keys.ptr(), country_treasuries.ptr() }, country_entities);
+
+	if (p_save.player < country_entities.size())
+		ecs.set<Player>(Entity(ecs, country_entities[p_save.player]));
+
+	// Provinces get a reserved range of entity ids, the entity of a province is province_entity_offset + its id.
+	province_entity_offset = ecs_get_max_id(ecs.c_ptr());
+	max_province_id = 0;
+
+	// The area, region and owner of every province as indices into the save.
+	static constexpr ProvinceIndex max_province_count = COLOR_TEXTURE_DIMENSIONS * COLOR_TEXTURE_DIMENSIONS;
+	Vec<uint32_t> area_regions;
+	area_regions.resize(area_entities.size());
+	for (uint32_t &region : area_regions)
+		region = SaveGame::NO_INDEX;
+	for (uint32_t i = 0; i < p_save.regions.size(); ++i) {
+		for (const uint32_t area_index : p_save.regions[i].areas) {
+			ERR_CONTINUE(area_index >= area_regions.size());
+			area_regions[area_index] = i;
+		}
+	}
 
-		const CountryEntity country_entity = ecs.entity(section.utf8().ptr());
-		country_entity.child_of(ecs.get_scope(Scope::Country));
+	Vec<uint32_t> province_areas;
+	Vec<uint32_t> province_owners;
+	province_areas.resize(max_province_count);
+	province_owners.resize(max_province_count);
+	for (uint32_t i = 0; i < uint32_t(max_province_count); ++i) {
+		province_areas[i] = SaveGame::NO_INDEX;
+		province_owners[i] = SaveGame::NO_INDEX;
+	}
+	for (uint32_t i = 0; i < p_save.areas.size(); ++i)
+		for (const ProvinceIndex province : p_save.areas[i].provinces)
+			if (province > 0 and province < max_province_count)
+				province_areas[province] = i;
+	for (uint32_t i = 0; i < p_save.countries.size(); ++i)
+		for (const ProvinceIndex province : p_save.countries[i].provinces)
+			if (province > 0 and province < max_province_count)
+				province_owners[province] = i;
+
+	// Provinces with the same area, owner, type and optional components end up in the same archetype so each combination is created with a single bulk call.
+	static constexpr int province_flag_combinations = 8;
+	struct ProvinceKey {
+		uint32_t area = SaveGame::NO_INDEX;
+		uint32_t owner = SaveGame::NO_INDEX;
+		const SaveGame::Province *province = nullptr;
+
+		bool is_same_batch(const ProvinceKey &p_other) const { return area == p_other.area and owner == p_other.owner and province->type == p_other.province->type and province->flags == p_other.province->flags; }
+		bool operator<(const ProvinceKey &p_other) const {
+			if (area != p_other.area)
+				return area < p_other.area;
+			if (owner != p_other.owner)
+				return owner < p_other.owner;
+			if (province->type != p_other.province->type)
+				return province->type < p_other.province->type;
+			return province->flags < p_other.province->flags;
+		}
+	};
+
+	// Province ids index the lookup texture, ids outside of it or loaded twice would overlap other province entities.
+	Vec<bool> loaded_provinces;
+	loaded_provinces.resize_initialized(max_province_count);
+	Vec<ProvinceKey> province_keys;
+
+	for (const SaveGame::Province &province : p_save.provinces) {
+		ERR_CONTINUE(province.id <= 0 or province.type > ProvinceType::Uninhabitable or province.flags >= province_flag_combinations);
+		ERR_CONTINUE_MSG(province.id >= max_province_count, vformat("Province id %d doesn't fit in the lookup texture.", province.id));
+		ERR_CONTINUE_MSG(loaded_provinces[province.id], vformat("Province id %d is in the save more than once.", province.id));
+		loaded_provinces[province.id] = true;
+		max_province_id = MAX(max_province_id, province.id);
+
+		province_keys.push_back({ .area = province_areas[province.id], .owner = province_owners[province.id], .province = &province });
+		color_to_id_map[get_lookup_color(province.id)] = province.id;
+	}
 
-		for (const int &province : owned_provinces_config) {
-			const ProvinceEntity province_entity = ecs.scope_lookup(Scope::Province, uitos(province));
-			province_entity.add(Relationship(Owner), country_entity);
-			country_entity.add(Relationship(Province), province_entity);
+	province_keys.sort();
+
+	const auto is_loaded = [&loaded_provinces](ProvinceIndex p_province_id) { return p_province_id > 0 and p_province_id < max_province_count and loaded_provinces[p_province_id]; };
+
+	struct ProvinceBatch {
+		Vec<ecs_entity_t> entities;
+		Vec<String> names;
+		Vec<LocKey> loc_keys;
+		Vec<TextLocator> text_locators;
+		Vec<UnitLocator> unit_locators;
+		Vec<AABB> aabbs;
+	};
+
+	for (uint32_t start = 0, end = 0; start < province_keys.size(); start = end) {
+		const ProvinceKey &key = province_keys[start];
+		ProvinceBatch batch;
+		for (end = start; end < province_keys.size() and key.is_same_batch(province_keys[end]); ++end) {
+			const SaveGame::Province &province = *province_keys[end].province;
+			batch.entities.push_back(province_entity_offset + province.id);
+			batch.names.push_back(uitos(province.id));
+			batch.loc_keys.push_back(province.loc_key);
+			if (province.flags & SaveGame::HAS_TEXT_LOCATOR)
+				batch.text_locators.push_back(province.text_locator);
+			if (province.flags & SaveGame::HAS_UNIT_LOCATOR)
+				batch.unit_locators.push_back(province.unit_locator);
+			if (province.flags & SaveGame::HAS_AABB)
+				batch.aabbs.push_back(province.aabb);
 		}
 
-		country_entity.add<CountryTag>();
-		country_entity.add(Relationship(Capital), capital_entity);
+		Vec<ecs_id_t> ids = { ecs.id<ProvinceTag>(), ecs.id<LocKey>() };
+		Vec<const void *> data = { nullptr, batch.loc_keys.ptr() };
+		if (key.province->type != ProvinceType::None) {
+			ids.push_back(get_province_type_tag(key.province->type));
+			data.push_back(nullptr);
+		}
+		if (key.province->flags & SaveGame::HAS_TEXT_LOCATOR) {
+			ids.push_back(ecs.id<TextLocator>());
+			data.push_back(batch.text_locators.ptr());
+		}
+		if (key.province->flags & SaveGame::HAS_UNIT_LOCATOR) {
+			ids.push_back(ecs.id<UnitLocator>());
+			data.push_back(batch.unit_locators.ptr());
+		}
+		if (key.province->flags & SaveGame::HAS_AABB) {
+			ids.push_back(ecs.id<AABB>());
+			data.push_back(batch.aabbs.ptr());
+		}
+		if (key.area != SaveGame::NO_INDEX) {
+			ids.push_back(ecs_pair(Relationship(InArea).id(), area_entities[key.area]));
+			data.push_back(nullptr);
+			if (area_regions[key.area] != SaveGame::NO_INDEX) {
+				ids.push_back(ecs_pair(Relationship(InRegion).id(), region_entities[area_regions[key.area]]));
+				data.push_back(nullptr);
+			}
+		}
+		if (key.owner != SaveGame::NO_INDEX) {
+			ids.push_back(ecs_pair(Relationship(Owner).id(), country_entities[key.owner]));
+			data.push_back(nullptr);
+		}
 
-		country_entity.set<Color>(color);
-		country_entity.set<LocKey>(section);
+		bulk_create_entities(Scope::Province, batch.names, ids, data, batch.entities);
+	}
 
-		// Add a unit entity at every countries capital
-		const UnitEntity unit_entity = ecs.entity();
+	// Units are created with their owner and location pairs, units with the same owner and location share an archetype.
+	// Units without a valid owner or location are dropped before they are created so no orphan units are left behind.
+	struct UnitKey {
+		uint32_t owner = SaveGame::NO_INDEX;
+		ProvinceIndex location = 0;
 
-		unit_entity.add(Relationship(Owner), country_entity);
-		country_entity.add(Relationship(Unit), unit_entity);
-		unit_entity.add<UnitTag>();
+		bool operator==(const UnitKey &p_other) const { return owner == p_other.owner and location == p_other.location; }
+		bool operator<(const UnitKey &p_other) const { return owner != p_other.owner ? owner < p_other.owner : location < p_other.location; }
+	};
+
+	Vec<UnitKey> unit_keys;
+	for (const SaveGame::Unit &unit : p_save.units) {
+		ERR_CONTINUE(unit.owner >= country_entities.size() or !is_loaded(unit.location));
+		unit_keys.push_back({ .owner = unit.owner, .location = unit.location });
+	}
+	unit_keys.sort();
+
+	Vec<Vec<ecs_id_t>> country_pairs;
+	country_pairs.resize(country_entities.size());
+	for (uint32_t start = 0, end = 0; start < unit_keys.size(); start = end) {
+		const UnitKey &key = unit_keys[start];
+		for (end = start; end < unit_keys.size() and unit_keys[end] == key; ++end) {}
+
+		ecs_bulk_desc_t unit_desc{};
+		unit_desc.count = int32_t(end - start);
+		unit_desc.ids[0] = ecs.id<UnitTag>();
+		unit_desc.ids[1] = ecs_pair(Relationship(Owner).id(), country_entities[key.owner]);
+		unit_desc.ids[2] = ecs_pair(Relationship(Location).id(), province_entity_offset + key.location);
+		const ecs_entity_t *new_units = ecs_bulk_init(ecs.c_ptr(), &unit_desc);
+		for (int32_t i = 0; i < unit_desc.count; ++i)
+			country_pairs[key.owner].push_back(ecs_pair(Relationship(Unit).id(), new_units[i]));
 	}
 
-	return provinces_map;
+	// Areas have a pair per province and countries a pair per unit, so all of them are added at once.
+	for (uint32_t i = 0; i < area_entities.size(); ++i) {
+		const SaveGame::Area &area = p_save.areas[i];
+		Vec<ecs_id_t> pairs;
+		for (const ProvinceIndex province : area.provinces)
+			if (is_loaded(province) and province_areas[province] == i)
+				pairs.push_back(ecs_pair(Relationship(ProvinceIn).id(), province_entity_offset + province));
+		if (is_loaded(area.capital))
+			pairs.push_back(ecs_pair(Relationship(Capital).id(), province_entity_offset + area.capital));
+		if (area_regions[i] != SaveGame::NO_INDEX)
+			pairs.push_back(ecs_pair(Relationship(InRegion).id(), region_entities[area_regions[i]]));
+		add_pairs(Entity(ecs, area_entities[i]), pairs);
+	}
+
+	for (uint32_t i = 0; i < region_entities.size(); ++i)
+		if (const ProvinceEntity capital_entity = get_province_entity(p_save.regions[i].capital); capital_entity.is_valid())
+			Entity(ecs, region_entities[i]).add(Relationship(Capital), capital_entity);
+
+	for (uint32_t i = 0; i < country_entities.size(); ++i) {
+		const SaveGame::Country &country = p_save.countries[i];
+		const CountryEntity country_entity = Entity(ecs, country_entities[i]);
+		Vec<ecs_id_t> &pairs = country_pairs[i];
+
+		for (const ProvinceIndex province : country.provinces)
+			if (is_loaded(province) and province_owners[province] == i)
+				country_provinces.set_owner(province, country_entity);
+
+		if (is_loaded(country.capital))
+			pairs.push_back(ecs_pair(Relationship(Capital).id(), province_entity_offset + country.capital));
+		add_pairs(country_entity, pairs);
+	}
+
+	build_province_table();
+
+	print_line("Created ", p_save.provinces.size(), " provinces, ", p_save.countries.size(), " countries and ", p_save.units.size(), " units in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
 }
 
-bool Map::is_lake_border(const Border &p_border) {
-	if (p_border.first.has<LakeProvinceTag>() or p_border.second.has<LakeProvinceTag>())
-		return true;
-	else
-		return false;
+void Map::add_pairs(Entity p_entity, Vec<ecs_id_t> &r_pairs) {
+	ECS &ecs = *ECS::self;
+	r_pairs.sort();
+
+	// Flecs types are sorted id arrays, the pairs are merged into the current type of the entity.
+	const ecs_type_t *type = ecs_get_type(ecs.c_ptr(), p_entity.id());
+	const int32_t type_count = type != nullptr ? type->count : 0;
+	Vec<ecs_id_t> ids;
+	Vec<ecs_id_t> added;
+	int32_t type_index = 0;
+	for (const ecs_id_t pair : r_pairs) {
+		while (type_index < type_count and type->array[type_index] < pair)
+			ids.push_back(type->array[type_index++]);
+		if ((type_index < type_count and type->array[type_index] == pair) or (!added.is_empty() and added[added.size() - 1] == pair))
+			continue;
+		ids.push_back(pair);
+		added.push_back(pair);
+	}
+	while (type_index < type_count)
+		ids.push_back(type->array[type_index++]);
+
+	if (added.is_empty())
+		return;
+
+	// The final table is looked up directly instead of walking the table graph, which would create a table for every pair in between.
+	ecs_table_t *table = ecs_table_find(ecs.c_ptr(), ids.ptr(), int32_t(ids.size()));
+	const ecs_type_t added_type = { added.ptr(), int32_t(added.size()) };
+	ecs_commit(ecs.c_ptr(), p_entity.id(), nullptr, table, &added_type, nullptr);
+}
+
+ProvinceEntity Map::get_province_entity(ProvinceIndex p_province_id) const {
+	if (p_province_id <= 0 or p_province_id > max_province_id)
+		return Entity();
+	const Entity entity = Entity(*ECS::self, province_entity_offset + ecs_entity_t(p_province_id));
+	return entity.is_alive() ? entity : Entity();
+}
+
+ProvinceIndex Map::get_province_index(ProvinceEntity p_province_entity) const {
+	// Targets read from relationships can be any entity, only ids in the reserved range that are provinces have an index.
+	const ecs_entity_t id = p_province_entity.id();
+	if (id <= province_entity_offset or id > province_entity_offset + ecs_entity_t(max_province_id) or !p_province_entity.is_alive() or !p_province_entity.has<ProvinceTag>())
+		return 0;
+	return ProvinceIndex(id - province_entity_offset);
+}
+
+const Vec<ProvinceIndex> &Map::get_country_provinces(CountryEntity p_country_entity) const { return country_provinces.get_provinces(p_country_entity); }
+
+const ProvinceTable &Map::get_province_table() const { return province_table; }
+
+void Map::build_province_table() {
+	ECS &ecs = *ECS::self;
+	province_table.clear();
+	province_table.set_entity_offset(province_entity_offset);
+
+	ecs.get_scope(Scope::Province).children([this, &ecs](Entity p_province) {
+		const ProvinceIndex province_id = get_province_index(p_province);
+		province_table.set_entity(province_id, p_province);
+		province_table.set_type(province_id, get_province_type(p_province));
+		province_table.set_income(province_id, Simulation::province_income);
+		province_table.set_owner(province_id, ecs.get_target(p_province, Relation::Owner));
+		province_table.set_area(province_id, ecs.get_target(p_province, Relation::InArea));
+		province_table.set_region(province_id, ecs.get_target(p_province, Relation::InRegion));
+		if (p_province.has<UnitLocator>())
+			province_table.set_position(province_id, p_province.get<UnitLocator>().position);
+		else if (p_province.has<AABB>())
+			province_table.set_position(province_id, Vector2(p_province.get<AABB>().get_center().x, p_province.get<AABB>().get_center().z));
+	});
 }
 
+bool Map::is_lake_border(ProvinceIndex p_first, ProvinceIndex p_second) const { return province_table.get_type(p_first) == ProvinceType::Lake or province_table.get_type(p_second) == ProvinceType::Lake; }
+
 void Map::create_border_materials() {
 	const int material_count = static_cast<int>(ProvinceBorderType::PROVINCE_BORDER_TYPE_MAX);
 	border_materials.reserve(material_count);
@@ -298,50 +839,15 @@ void Map::create_border_materials() {
 	}
 }
 
-void Map::fill_province_adjacency_data(const Border &p_border) {
-	ProvinceAdjacencyType adjacency_type = ProvinceAdjacencyType::Land;
-
-	if (is_navigable_water_province(p_border.first) and is_navigable_water_province(p_border.second))
-		adjacency_type = ProvinceAdjacencyType::Water;
-	else if (is_impassable_province(p_border.first) or is_impassable_province(p_border.second))
-		adjacency_type = ProvinceAdjacencyType::Impassable;
-	else if ((p_border.first.has<OceanProvinceTag>() and p_border.second.has<LandProvinceTag>()) or (p_border.first.has<LandProvinceTag>() and p_border.second.has<OceanProvinceTag>()))
-		adjacency_type = ProvinceAdjacencyType::Coastal;
-
-	ECS &ecs = *ECS::self;
-
-	const Entity adjacency_entity = ecs.entity();
-	adjacency_entity.add(Relationship(AdjacencyTo), p_border.first);
-	adjacency_entity.add(Relationship(AdjacencyFrom), p_border.second);
-	adjacency_entity.set<ProvinceAdjacencyType>(adjacency_type);
-
-	p_border.first.add(Relationship(Adjacency), adjacency_entity);
-	p_border.second.add(Relationship(Adjacency), adjacency_entity);
+ProvinceBorderType Map::get_province_border_type(const Border &p_border) const {
+	// Country borders take precedence so they follow provinces that change owner.
+	return province_table.get_border_type(get_province_index(p_border.first), get_province_index(p_border.second));
 }
 
 ProvinceBorderType Map::fill_province_border_data(const Border &p_border, const RID &p_rid) {
-	ProvinceBorderType border_type = ProvinceBorderType::Country;
+	const ProvinceBorderType border_type = get_province_border_type(p_border);
 	ECS &ecs = *ECS::self;
 
-	if ((ecs.has_relation(p_border.first, Relation::Owner) and ecs.has_relation(p_border.second, Relation::Owner) and
-				ecs.get_target(p_border.first, Relation::Owner) != ecs.get_target(p_border.second, Relation::Owner)))
-		border_type = ProvinceBorderType::Country;
-	else if (is_navigable_water_province(p_border.first) and is_navigable_water_province(p_border.second))
-		border_type = ProvinceBorderType::Water;
-	else if (is_impassable_province(p_border.first) or is_impassable_province(p_border.second))
-		border_type = ProvinceBorderType::Impassable;
-	else if ((p_border.first.has<OceanProvinceTag>() and p_border.second.has<LandProvinceTag>()) or (p_border.first.has<LandProvinceTag>() and p_border.second.has<OceanProvinceTag>()))
-		border_type = ProvinceBorderType::Coastal;
-
-	const AreaEntity to_area = ecs.get_target(p_border.first, Relation::InArea);
-	const AreaEntity from_area = ecs.get_target(p_border.second, Relation::InArea);
-	if (to_area.is_valid() and from_area.is_valid()) {
-		if (from_area != to_area)
-			border_type = ProvinceBorderType::Area;
-		else
-			border_type = ProvinceBorderType::Province;
-	}
-
 	const Entity border_entity = ecs.entity();
 	border_entity.add(Relationship(AdjacencyTo), p_border.first);
 	border_entity.add(Relationship(AdjacencyFrom), p_border.second);
@@ -398,51 +904,54 @@ Ref<ArrayMesh> Map::create_border_mesh(const Vec<Vector4> &p_segments, float p_b
 	return st->commit();
 }
 
-void Map::create_unit_models(Node3D *p_map) {
+void Map::create_unit_models(const RID &p_scenario) {
+	MapUnits::self = memnew(MapUnits(p_scenario));
+	MapUnits &map_units = *MapUnits::self;
+
+	unit_stacks.create(p_scenario);
+
 	const auto unit_query = ECS::self->query_builder<>().with<UnitTag>().build();
 
-	unit_query.each([p_map](UnitEntity unit_entity) {
+	unit_query.each([this, &map_units](UnitEntity unit_entity) {
 		const CountryEntity owner = ECS::self->get_target(unit_entity, Relation::Owner);
-		const ProvinceEntity capital = ECS::self->get_target(owner, Relation::Capital);
-		const UnitLocator locator = capital.get<UnitLocator>();
-
-		MapUnit *unit_mesh = memnew(MapUnit());
-		unit_entity.set<UnitModel>(unit_mesh);
+		const ProvinceEntity location = ECS::self->get_target(unit_entity, Relation::Location);
+		const UnitLocator locator = location.get<UnitLocator>();
 
+		// Units are drawn in world space which is the same as map space.
 		Transform3D unit_transform;
-		unit_transform.origin = Vector3((locator.position.x - (map_dimensions.x / 2.0)), unit_map_layer, (locator.position.y - (map_dimensions.y / 2.0)));
+		unit_transform.origin = Vector3(locator.position.x, unit_map_layer, locator.position.y);
 		unit_transform.basis.scale(Vector3(locator.scale, locator.scale, locator.scale));
 		unit_transform.basis.rotate(Vector3(unit_x_rotation, locator.orientation, 0.0));
 
-		unit_mesh->set_transform(unit_transform);
-		unit_mesh->set_texture(ResourceLoader::load("res://gfx/icon.svg"));
-		unit_mesh->set_draw_flag(Sprite3D::DrawFlags::FLAG_SHADED, true);
-		unit_mesh->set_draw_flag(Sprite3D::DrawFlags::FLAG_DOUBLE_SIDED, false);
-		unit_mesh->set_alpha_cut_mode(Sprite3D::AlphaCutMode::ALPHA_CUT_DISCARD);
-
-		p_map->add_child(unit_mesh);
+		unit_entity.set<UnitModel>(map_units.add_unit(unit_entity, unit_transform, owner.get<Color>()));
+		unit_stacks.add_unit(unit_entity, location);
 	});
+
+	map_units.flush();
 }
 
-void Map::create_map_labels() {
+void Map::create_map_labels(const RID &p_scenario) {
+	// Render every glyph labels can show now instead of when a map mode first shows them.
+	MapLabel::set_font(LabelGlyphCache::prewarm(persist_label_glyph_cache));
+
+	MapLabelBatch::self = memnew(MapLabelBatch(p_scenario));
+	MapLabelShaper::self = memnew(MapLabelShaper);
+
 	const auto province_query = ECS::self->query_builder<TextLocator, AABB>().with<LandProvinceTag>().build();
 
 	province_query.each([this](Entity entity, const TextLocator &locator, const AABB &aabb) {
 		MapLabel *label = memnew(MapLabel());
-
-		Transform3D text_transform;
-		text_transform.origin = Vector3(locator.position.x, label_map_layer, locator.position.y);
-		text_transform.basis.scale(Vector3(locator.scale, locator.scale, locator.scale));
-		text_transform.basis.rotate(Vector3(-1.570796, locator.orientation, 0.0));
-
 		label->set_province_aabb(aabb);
-		label->set_transform(text_transform);
+		label->set_transform(get_text_transform(locator));
 
 		map_labels[entity] = label;
+		label_manager.add_label(label);
 	});
+
+	country_labels.invalidate_all();
 }
 
-void Map::create_border_meshes(const RID &p_scenario, const Dictionary &p_border_dict, bool is_map_editor) {
+void Map::create_border_meshes(const RID &p_scenario, const Dictionary &p_border_dict) {
 	// Create border materials
 	create_border_materials();
 	RenderingServer &rs = *RS::get_singleton();
@@ -465,8 +974,6 @@ void Map::create_border_meshes(const RID &p_scenario, const Dictionary &p_border
 		border_meshes.push_back(border_mesh_storage);
 
 		const ProvinceBorderType border_type = fill_province_border_data(border, border_mesh);
-		if (!is_map_editor)
-			fill_province_adjacency_data(border);
 
 		const Transform3D mesh_transform = Transform3D(Basis().rotated(Vector3(1, 0, 0), 1.570796), Vector3(0, border_map_layer, 0));
 		rs.instance_set_transform(mesh_instance, mesh_transform);
@@ -474,8 +981,35 @@ void Map::create_border_meshes(const RID &p_scenario, const Dictionary &p_border
 	}
 }
 
-template void Map::load_map<false>(Node3D *p_map);
-template void Map::load_map<true>(Node3D *p_map);
+void Map::load_province_adjacencies(const PackedInt32Array &p_adjacencies) {
+	province_adjacencies.clear();
+	ERR_FAIL_COND_MSG(p_adjacencies.size() % 4 != 0, "Province adjacency table is corrupt, regenerate the map data in the map editor.");
+
+	// Each row of the baked table is (province, province, ProvinceAdjacencyType, shared border length).
+	province_adjacencies.reserve(p_adjacencies.size() / 4);
+	for (int i = 0; i < p_adjacencies.size(); i += 4) {
+		ProvinceAdjacency adjacency;
+		adjacency.first = get_province_entity(p_adjacencies[i]);
+		adjacency.second = get_province_entity(p_adjacencies[i + 1]);
+		adjacency.type = ProvinceAdjacencyType(p_adjacencies[i + 2]);
+		adjacency.border_length = p_adjacencies[i + 3];
+		province_adjacencies.push_back(adjacency);
+	}
+
+	// Crossings are hand authored so they are read from their own file instead of being baked.
+	const Vector<Vector<Variant>> crossings = CSV::parse_file("res://data/crossings.txt");
+	for (const Vector<Variant> &crossing : crossings) {
+		ProvinceAdjacency adjacency;
+		adjacency.first = get_province_entity(int(crossing[0]));
+		adjacency.second = get_province_entity(int(crossing[1]));
+		adjacency.type = ProvinceAdjacencyType::Crossing;
+		adjacency.crossing_locator = Vector4(crossing[2], crossing[3], crossing[4], crossing[5]);
+		province_adjacencies.push_back(adjacency);
+	}
+}
+
+template void Map::load_map<false>(Node3D *p_map, const String &p_save_path, const String &p_map_data_path);
+template void Map::load_map<true>(Node3D *p_map, const String &p_save_path, const String &p_map_data_path);
 
 #ifdef TOOLS_ENABLED
 
@@ -565,7 +1099,7 @@ void Map::load_map_editor(Node3D *p_map) {
 
 					// Filter out borders and adjacencies with lakes
 					// movement to/from lakes is impossible and borders should never be draw on lake provinces.
-					if (is_lake_border(Border(province_entity, ecs.scope_lookup(Scope::Province, uitos(from)))))
+					if (is_lake_border(province_id, from))
 						continue;
 
 					PackedVector4Array borders_arr = borders_dict[arr];
@@ -588,7 +1122,7 @@ void Map::load_map_editor(Node3D *p_map) {
 						arr.push_back(province_id);
 					}
 
-					if (is_lake_border(Border(province_entity, ecs.scope_lookup(Scope::Province, uitos(from)))))
+					if (is_lake_border(province_id, from))
 						continue;
 
 					PackedVector4Array borders_arr = borders_dict[arr];
@@ -602,10 +1136,13 @@ void Map::load_map_editor(Node3D *p_map) {
 	// Create lookup image from bytes
 	lookup_image = Image::create_from_data(province_image_width, province_image_height, false, Image::FORMAT_RGF, lookup_image_data);
 	lookup_image->save_exr("res://gfx/gen/province_lookup.exr");
+	create_selection_texture();
 
 	// Fill in Provinces data from pixel data
 	const Ref<ConfigFile> province_data_config = memnew(ConfigFile());
 	const Ref<ConfigFile> runtime_province_data_config = memnew(ConfigFile());
+	Vec<LabelPlacementJob> label_placement_jobs;
+	Vec<String> label_placement_sections;
 
 	for (const KeyValue<ProvinceEntity, Vec<Vector2>> &kv : pixel_dict) {
 		const Vector2 centroid = calculate_centroid(kv.value);
@@ -615,24 +1152,60 @@ void Map::load_map_editor(Node3D *p_map) {
 			return;
 
 		const String province_id_string = uitos(province_id);
-		if (kv.key.has<LandProvinceTag>()) {
+		if (province_table.get_type(province_id) == ProvinceType::Land) {
 			const CachedMapData map_data = calc_map_data(kv.value, centroid);
 			province_data_config->set_value(province_id_string, "orientation", map_data.orientation);
 			runtime_province_data_config->set_value(province_id_string, "aabb", map_data.aabb);
+
+			label_placement_jobs.push_back(LabelPlacementJob{ .pixels = &kv.value, .map_data = map_data });
+			label_placement_sections.push_back(province_id_string);
 		}
 
 		province_data_config->set_value(province_id_string, "centroid", centroid);
 	}
 
+	// Every land province needs a distance transform to place its label so they are baked in parallel.
+	WorkerThreadPool *thread_pool = WorkerThreadPool::get_singleton();
+	const WorkerThreadPool::GroupID label_group_id =
+			thread_pool->add_native_group_task(&Map::bake_label_placement, label_placement_jobs.ptr(), int(label_placement_jobs.size()), -1, true, "Bake label placement");
+	thread_pool->wait_for_group_task_completion(label_group_id);
+
+	for (uint32_t i = 0; i < label_placement_jobs.size(); ++i) {
+		const LabelPlacement &placement = label_placement_jobs[i].placement;
+		const String &section = label_placement_sections[i];
+		province_data_config->set_value(section, "label_position", placement.position);
+		province_data_config->set_value(section, "label_orientation", placement.orientation);
+		province_data_config->set_value(section, "label_scale", placement.scale);
+	}
+
 	province_data_config->save("res://data/gen/province_data.cfg");
 	runtime_province_data_config->save("res://data/gen/runtime_province_data.cfg");
 
+	// Bake one adjacency per border, every border segment is one pixel long so the shared border length is the segment count.
+	PackedInt32Array adjacencies;
+	for (const Variant &border_key : borders_dict.keys()) {
+		const PackedInt32Array key = border_key;
+		const PackedVector4Array segments = borders_dict[key];
+		adjacencies.push_back(key[0]);
+		adjacencies.push_back(key[1]);
+		adjacencies.push_back(int(province_table.get_adjacency_type(key[0], key[1])));
+		adjacencies.push_back(segments.size());
+	}
+
 	map_data_config->set_value("map_data", "borders", borders_dict);
-	map_data_config->save("res://data/gen/map_data.cfg");
+	map_data_config->set_value("map_data", "adjacencies", adjacencies);
+	map_data_config->save(default_map_data_path);
 }
 
 #endif
 
+void Map::create_selection_texture() {
+	selection_image = Image::create_empty(COLOR_TEXTURE_DIMENSIONS, COLOR_TEXTURE_DIMENSIONS, false, Image::FORMAT_R8);
+	selection_texture = ImageTexture::create_from_image(selection_image);
+	selected_provinces.clear();
+	selection_dirty = false;
+}
+
 void Map::load_map_data() {
 	const Ref<ConfigFile> config = memnew(ConfigFile());
 	config->load("res://data/gen/runtime_province_data.cfg");
@@ -643,6 +1216,8 @@ void Map::load_map_data() {
 
 		const AABB aabb = config->get_value(section, "aabb");
 		entity.set<AABB>(aabb);
+		if (!entity.has<UnitLocator>())
+			province_table.set_position(section.to_int(), Vector2(aabb.get_center().x, aabb.get_center().z));
 	}
 }
 
@@ -650,8 +1225,10 @@ void Map::load_locators() {
 	const Ref<ConfigFile> text_config = memnew(ConfigFile());
 	const Ref<ConfigFile> unit_config = memnew(ConfigFile());
 
-	text_config->load("res://data/locators/text.cfg");
-	unit_config->load("res://data/locators/unit.cfg");
+	text_config->load(map_config_paths[TEXT_LOCATOR_CONFIG]);
+	unit_config->load(map_config_paths[UNIT_LOCATOR_CONFIG]);
+	loaded_configs[TEXT_LOCATOR_CONFIG] = text_config;
+	loaded_configs[UNIT_LOCATOR_CONFIG] = unit_config;
 
 	const Vector<String> text_sections = text_config->get_sections();
 	const Vector<String> unit_sections = unit_config->get_sections();
@@ -680,20 +1257,26 @@ void Map::load_locators() {
 		locator.scale = unit_config->get_value(section, "scale");
 
 		entity.set<UnitLocator>(locator);
+		province_table.set_position(province_id, locator.position);
 	}
 }
 
-template <bool is_map_editor> void Map::load_map(Node3D *p_map) {
+template <bool is_map_editor> void Map::load_map(Node3D *p_map, const String &p_save_path, const String &p_map_data_path) {
 	ECS &ecs = *ECS::self;
 
-	// TODO - need to clear some data on reload but most data probably doesn't change
-	// probably just add a "bool reloading" parameter to load_map but it's tough because some parts of load_map write to the registry.
+	// Loading always starts from an empty world, reload_map_config() applies config changes to the loaded map instead.
 	ecs.reset();
 
-	const ProvinceColorMap provinces_map = load_map_config();
+	// A save has the locators and AABBs of the provinces so neither the map configs nor the map data have to be read.
+	SaveGame save;
+	const bool from_save = !p_save_path.is_empty() and save.load(p_save_path) == OK;
+	if (from_save)
+		load_save_game(save);
+	else
+		load_map_config();
 
 	const Ref<ConfigFile> map_data_config = memnew(ConfigFile());
-	map_data_config->load("res://data/gen/map_data.cfg");
+	map_data_config->load(p_map_data_path);
 
 	const int province_image_width = map_data_config->get_value("map_data", "width");
 	const int province_image_height = map_data_config->get_value("map_data", "height");
@@ -705,118 +1288,93 @@ template <bool is_map_editor> void Map::load_map(Node3D *p_map) {
 	const Ref<CompressedTexture2D> compressed_lookup_texture = ResourceLoader::load("res://gfx/gen/province_lookup.exr");
 	lookup_image = compressed_lookup_texture->get_image();
 	map_mode_image = Image::create_empty(COLOR_TEXTURE_DIMENSIONS, COLOR_TEXTURE_DIMENSIONS, false, Image::FORMAT_RGBF);
+	create_selection_texture();
 
 	if constexpr (!is_map_editor) {
-		load_locators();
-		load_map_data();
-
-		create_map_labels();
-		create_unit_models(p_map);
-
-		// Parse border crossings
-		const Vector<Vector<Variant>> crossings = CSV::parse_file("res://data/crossings.txt");
-
-		// Fill in crossing adjacencies
-		for (const Vector<Variant> &crossing : crossings) {
-			const Entity adjacency_entity = ecs.entity();
-			const ProvinceEntity to_entity = ecs.scope_lookup(Scope::Province, crossing[0]);
-			const ProvinceEntity from_entity = ecs.scope_lookup(Scope::Province, crossing[1]);
-
-			adjacency_entity.add(Relationship(AdjacencyTo), to_entity);
-			adjacency_entity.add(Relationship(AdjacencyFrom), from_entity);
-			adjacency_entity.set<ProvinceAdjacencyType>(ProvinceAdjacencyType::Crossing);
-			adjacency_entity.set<CrossingLocator>(Vector4(crossing[2], crossing[3], crossing[4], crossing[5]));
+		if (!from_save) {
+			load_locators();
+			load_map_data();
 		}
 
-		create_border_meshes(p_map->get_world_3d()->get_scenario(), map_data_config->get_value("map_data", "borders"), false);
+		create_map_labels(p_map->get_world_3d()->get_scenario());
+		create_unit_models(p_map->get_world_3d()->get_scenario());
+		simulation.init(&unit_movement, &Map::begin_simulation_tick, this);
+
+		load_province_adjacencies(map_data_config->get_value("map_data", "adjacencies", PackedInt32Array()));
+		create_border_meshes(p_map->get_world_3d()->get_scenario(), map_data_config->get_value("map_data", "borders"));
+		province_graph.build(province_table, province_adjacencies);
+		landmark_oracle.build(province_graph);
+		path_finder.build(province_graph, province_table);
+		path_finder.set_landmark_oracle(&landmark_oracle);
+		path_service.init(&province_graph, &path_finder);
+		distance_fields.init(&province_graph);
 	}
 
 	if constexpr (is_map_editor)
-		create_border_meshes(p_map->get_world_3d()->get_scenario(), map_data_config->get_value("map_data", "borders"), true);
+		create_border_meshes(p_map->get_world_3d()->get_scenario(), map_data_config->get_value("map_data", "borders"));
 }
 
 Ref<ImageTexture> Map::get_lookup_texture() { return ImageTexture::create_from_image(lookup_image); }
 
 Ref<Image> Map::get_lookup_image() { return lookup_image; }
 
-ProvinceColorMap Map::get_color_to_id_map() { return color_to_id_map; }
+const ProvinceColorMap &Map::get_color_to_id_map() const { return color_to_id_map; }
 
 Color Map::get_area_map_mode(ProvinceEntity p_province_entity) {
-	const bool has_label = map_labels.has(p_province_entity) ? true : false;
-	MapLabel *label{};
-	if (has_label) {
-		label = map_labels[p_province_entity];
-		label->set_visible(false);
-	}
+	MapLabel *label = map_labels.has(p_province_entity) ? map_labels[p_province_entity] : nullptr;
+	String label_text;
 
+	Color color = discard_color;
 	const AreaEntity area_entity = ECS::self->get_target(p_province_entity, Relation::InArea);
 	if (area_entity.is_valid()) {
-		if (has_label) {
-			const ProvinceEntity area_capital_entity = ECS::self->get_target(area_entity, Relation::Capital);
-			// Only draw label on area capital
-			if (area_capital_entity == p_province_entity) {
-				label->set_text(area_entity.get<LocKey>());
-				label->set_visible(true);
-			}
-		}
+		// Only draw label on area capital
+		if (ECS::self->get_target(area_entity, Relation::Capital) == p_province_entity)
+			label_text = area_entity.get<LocKey>();
 
-		return area_entity.get<Color>();
+		color = area_entity.get<Color>();
 	}
 
-	return discard_color;
+	if (label != nullptr)
+		label->set_text(MapMode::Area, label_text);
+
+	return color;
 }
 
 Color Map::get_region_map_mode(ProvinceEntity p_province_entity) {
-	const bool has_label = map_labels.has(p_province_entity) ? true : false;
-	MapLabel *label{};
-	if (has_label) {
-		label = map_labels[p_province_entity];
-		label->set_visible(false);
-	}
+	MapLabel *label = map_labels.has(p_province_entity) ? map_labels[p_province_entity] : nullptr;
+	String label_text;
 
+	Color color = discard_color;
 	const RegionEntity region_entity = ECS::self->get_target(p_province_entity, Relation::InRegion);
 	if (region_entity.is_valid()) {
-		if (has_label) {
-			const ProvinceEntity region_capital_entity = ECS::self->get_target(region_entity, Relation::Capital);
-			// Only draw label on region capital
-			if (region_capital_entity == p_province_entity) {
-				label->set_text(region_entity.get<LocKey>());
-				label->set_visible(true);
-			}
-		}
+		// Only draw label on region capital
+		if (ECS::self->get_target(region_entity, Relation::Capital) == p_province_entity)
+			label_text = region_entity.get<LocKey>();
 
-		return region_entity.get<Color>();
+		color = region_entity.get<Color>();
 	}
 
-	return discard_color;
+	if (label != nullptr)
+		label->set_text(MapMode::Region, label_text);
+
+	return color;
 }
 
 Color Map::get_country_map_mode(ProvinceEntity p_province_entity) {
-	const bool has_label = map_labels.has(p_province_entity) ? true : false;
-	MapLabel *label{};
-	if (has_label) {
-		label = map_labels[p_province_entity];
-		label->set_visible(false);
-	}
-
+	MapLabel *label = map_labels.has(p_province_entity) ? map_labels[p_province_entity] : nullptr;
 	ECS &ecs = *ECS::self;
 
+	Color color = discard_color;
 	if (ecs.has_relation(p_province_entity, Relation::Owner)) {
 		const CountryEntity owner = ecs.get_target(p_province_entity, Relation::Owner);
-
-		if (has_label) {
-			const ProvinceEntity country_capital_entity = ecs.get_target(owner, Relation::Capital);
-
-			// Only draw label on country capital
-			if (country_capital_entity == p_province_entity) {
-				label->set_text(owner.get<LocKey>());
-				label->set_visible(true);
-			}
-		}
-		return owner.get<Color>();
+		color = owner.get<Color>();
 	}
 
-	return discard_color;
+	// Country names are drawn by the CountryLabels so provinces have no label in the country map mode.
+	if (label != nullptr)
+		label->set_text(MapMode::Country, String());
+
+	return color;
 }
 
 template Ref<ImageTexture> Map::get_map_mode<MapMode::Area>();
@@ -827,7 +1385,7 @@ template <MapMode T> Ref<ImageTexture> Map::get_map_mode() {
 	float *write_ptr = reinterpret_cast<float *>(map_mode_image->ptrw());
 
 	for (uint32_t i = 1; i < color_to_id_map.size() + 1; ++i) {
-		const Vector2i uv = Vector2i(i % COLOR_TEXTURE_DIMENSIONS, std::floor(float(i) / COLOR_TEXTURE_DIMENSIONS));
+		const Vector2i uv = get_province_texel(ProvinceIndex(i));
 		const ProvinceEntity province_entity = ECS::self->scope_lookup(Scope::Province, uitos(i));
 		Color color;
 
@@ -844,9 +1402,825 @@ template <MapMode T> Ref<ImageTexture> Map::get_map_mode() {
 		write_ptr[(ofs * 3) + 2] = color.b;
 	}
 
-	return ImageTexture::create_from_image(map_mode_image);
+	// Label text is cached per map mode so this only toggles label visibility unless a label's text changed.
+	// Changed text is shaped on worker threads and shows up in update_labels() when it is done.
+	for (const KeyValue<ProvinceEntity, MapLabel *> &kv : map_labels)
+		kv.value->set_map_mode(T);
+
+	if (MapLabelBatch::self != nullptr) {
+		country_labels.update();
+		country_labels.set_visible(T == MapMode::Country);
+	}
+	if (MapLabelShaper::self != nullptr)
+		MapLabelShaper::self->dispatch();
+	label_manager.invalidate();
+	label_manager.refresh();
+
+	map_mode = T;
+	map_mode_dirty = false;
+	map_mode_texture = ImageTexture::create_from_image(map_mode_image);
+	return map_mode_texture;
+}
+
+void Map::select_province(ProvinceIndex p_province_id) {
+	if (is_province_selected(p_province_id))
+		return;
+
+	selection_image->set_pixelv(get_province_texel(p_province_id), Color(1, 0, 0));
+	selected_provinces.push_back(p_province_id);
+	selection_dirty = true;
+}
+
+void Map::deselect_province(ProvinceIndex p_province_id) {
+	if (!selected_provinces.erase_unordered(p_province_id))
+		return;
+
+	selection_image->set_pixelv(get_province_texel(p_province_id), Color(0, 0, 0));
+	selection_dirty = true;
+}
+
+bool Map::is_province_selected(ProvinceIndex p_province_id) const { return selection_image->get_pixelv(get_province_texel(p_province_id)).r > 0.5; }
+
+void Map::clear_selection() {
+	// Only reset the texels that were set instead of the whole image.
+	for (const ProvinceIndex province_id : selected_provinces)
+		selection_image->set_pixelv(get_province_texel(province_id), Color(0, 0, 0));
+
+	selection_dirty = selection_dirty or !selected_provinces.is_empty();
+	selected_provinces.clear();
+}
+
+void Map::update_selection_texture() {
+	if (!selection_dirty)
+		return;
+
+	selection_texture->update(selection_image);
+	selection_dirty = false;
+}
+
+Ref<ImageTexture> Map::get_selection_texture() { return selection_texture; }
+
+void Map::update_label_lod(float p_camera_distance) { label_manager.update(p_camera_distance); }
+
+void Map::update_unit_lod(float p_camera_distance) { unit_stacks.update(p_camera_distance); }
+
+void Map::update_labels() {
+	if (MapLabelShaper::self == nullptr)
+		return;
+
+	// New label AABBs need to be placed again, this also flushes the MapLabelBatch.
+	if (MapLabelShaper::self->apply_finished() > 0) {
+		label_manager.invalidate();
+		label_manager.refresh();
+	}
 }
 
+void Map::transfer_province(ProvinceEntity p_province_entity, CountryEntity p_new_owner) {
+	ECS &ecs = *ECS::self;
+
+	const ProvinceIndex province_id = get_province_index(p_province_entity);
+	ERR_FAIL_COND_MSG(province_id == 0, "Only provinces can be transferred.");
+	const CountryEntity old_owner = country_provinces.get_owner(province_id);
+	if (old_owner == p_new_owner)
+		return;
+
+	// Relations and the province index. Countries have no pair per province, that would move both countries to a new table on every transfer.
+	if (old_owner.is_valid())
+		p_province_entity.remove(Relationship(Owner), old_owner);
+	if (p_new_owner.is_valid())
+		p_province_entity.add(Relationship(Owner), p_new_owner);
+	country_provinces.set_owner(province_id, p_new_owner);
+	province_table.set_owner(province_id, p_new_owner);
+	update_country_income(old_owner);
+	update_country_income(p_new_owner);
+
+	// A country that loses its capital moves it to another of its provinces, a country without a capital gets this one.
+	if (old_owner.is_valid() and ecs.get_target(old_owner, Relation::Capital) == p_province_entity) {
+		old_owner.remove(Relationship(Capital), p_province_entity);
+		const Vec<ProvinceIndex> &old_provinces = country_provinces.get_provinces(old_owner);
+		if (!old_provinces.is_empty())
+			old_owner.add(Relationship(Capital), get_province_entity(old_provinces[0]));
+	}
+	if (p_new_owner.is_valid() and !ecs.has_relation(p_new_owner, Relation::Capital))
+		p_new_owner.add(Relationship(Capital), p_province_entity);
+
+	// Only the texel of this province changes in the country map mode.
+	if (map_mode == MapMode::Country)
+		set_map_mode_texel(province_id, get_country_map_mode(p_province_entity));
+
+	// Only borders of this province can change between country and other border types.
+	update_province_borders(p_province_entity);
+
+	// Selections are made from owners so a transferred province is no longer part of them.
+	deselect_province(province_id);
+
+	// Only the spines of the two countries depend on this province.
+	if (old_owner.is_valid())
+		country_labels.invalidate(old_owner);
+	if (p_new_owner.is_valid())
+		country_labels.invalidate(p_new_owner);
+	labels_dirty = true;
+}
+
+void Map::set_map_mode_texel(ProvinceIndex p_province_id, const Color &p_color) {
+	const Vector2i texel = get_province_texel(p_province_id);
+	float *write_ptr = reinterpret_cast<float *>(map_mode_image->ptrw());
+	const uint32_t ofs = (texel.y * COLOR_TEXTURE_DIMENSIONS) + texel.x;
+	write_ptr[(ofs * 3) + 0] = p_color.r;
+	write_ptr[(ofs * 3) + 1] = p_color.g;
+	write_ptr[(ofs * 3) + 2] = p_color.b;
+	map_mode_dirty = true;
+}
+
+void Map::update_province_borders(ProvinceEntity p_province_entity) {
+	ECS &ecs = *ECS::self;
+	RenderingServer &rs = *RS::get_singleton();
+	p_province_entity.each(Relationship(Border), [&](Entity p_border_entity) {
+		const Border border = Border(ecs.get_target(p_border_entity, Relation::AdjacencyTo), ecs.get_target(p_border_entity, Relation::AdjacencyFrom));
+		const ProvinceBorderType border_type = get_province_border_type(border);
+		if (border_type == p_border_entity.get<ProvinceBorderType>())
+			return;
+
+		p_border_entity.set<ProvinceBorderType>(border_type);
+		rs.mesh_surface_set_material(p_border_entity.get<ProvinceBorderMeshRID>(), 0, border_materials[static_cast<int>(border_type)]);
+	});
+}
+
+void Map::update_transfers() {
+	if (map_mode_dirty and map_mode_texture.is_valid()) {
+		map_mode_texture->update(map_mode_image);
+		map_mode_dirty = false;
+	}
+
+	update_selection_texture();
+
+	// Renamed countries are shaped on worker threads and show up in update_labels(), moved labels are uploaded here.
+	// Only a few country labels are rebuilt per frame, the rest stay dirty until a later frame.
+	if (labels_dirty) {
+		country_labels.update();
+		if (MapLabelShaper::self != nullptr)
+			MapLabelShaper::self->dispatch();
+		if (MapLabelBatch::self != nullptr)
+			MapLabelBatch::self->flush();
+		labels_dirty = country_labels.is_dirty();
+	}
+}
+
+void Map::benchmark_transfers(uint32_t p_transfers_per_tick, uint32_t p_ticks) {
+	Vec<CountryEntity> countries;
+	ECS::self->get_scope(Scope::Country).children([&countries](Entity p_country) { countries.push_back(p_country); });
+	ERR_FAIL_COND_MSG(countries.size() < 2 or color_to_id_map.is_empty(), "Transfer benchmark needs at least two countries.");
+
+	uint64_t total_usec = 0;
+	uint64_t max_tick_usec = 0;
+	for (uint32_t tick = 0; tick < p_ticks; ++tick) {
+		const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+
+		for (uint32_t i = 0; i < p_transfers_per_tick; ++i) {
+			const ProvinceIndex province_id = ProvinceIndex(Math::rand() % color_to_id_map.size()) + 1;
+			if (uint32_t(province_id) < province_table.size() and province_table.get_type(province_id) == ProvinceType::Land)
+				transfer_province(get_province_entity(province_id), countries[Math::rand() % countries.size()]);
+		}
+		update_transfers();
+
+		const uint64_t tick_usec = OS::get_singleton()->get_ticks_usec() - start_time;
+		total_usec += tick_usec;
+		max_tick_usec = MAX(max_tick_usec, tick_usec);
+	}
+
+	print_line("Transferred ", p_transfers_per_tick, " provinces per tick over ", p_ticks, " ticks with ", color_to_id_map.size(), " provinces, average tick ", total_usec / 1000.0 / MAX(p_ticks, 1u), " ms, slowest tick ", max_tick_usec / 1000.0, " ms");
+}
+
+void Map::benchmark_entity_creation(uint32_t p_province_count, uint32_t p_country_count, uint32_t p_unit_count) {
+	ECS &ecs = *ECS::self;
+	const SaveGame save = SaveGame::generate(p_province_count, p_country_count, p_unit_count);
+
+	// Both passes start from an empty world and create the same components and relationship pairs.
+	uint64_t pass_usec[2]{};
+	for (int pass = 0; pass < 2; ++pass) {
+		ecs.reset();
+		const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+		if (pass == 0)
+			create_entities_one_by_one(save);
+		else
+			load_save_game(save);
+		pass_usec[pass] = OS::get_singleton()->get_ticks_usec() - start_time;
+	}
+
+	print_line("Created ", save.provinces.size(), " provinces, ", save.areas.size(), " areas, ", save.regions.size(), " regions, ", save.countries.size(), " countries and ", save.units.size(), " units one at a time in ", pass_usec[0] / 1000.0, " ms, in bulk in ", pass_usec[1] / 1000.0, " ms");
+}
+
+void Map::create_entities_one_by_one(const SaveGame &p_save) {
+	ECS &ecs = *ECS::self;
+	register_components();
+
+	// Every entity, component and relationship added one at a time with name lookups, the way the map configs were loaded before bulk creation.
+	for (const SaveGame::Province &province : p_save.provinces) {
+		const ProvinceEntity province_entity = ecs.entity(uitos(province.id).utf8().ptr());
+		province_entity.child_of(ecs.get_scope(Scope::Province));
+		province_entity.set<LocKey>(province.loc_key);
+		province_entity.add<ProvinceTag>();
+		if (province.type != ProvinceType::None)
+			province_entity.add(get_province_type_tag(province.type));
+		if (province.flags & SaveGame::HAS_TEXT_LOCATOR)
+			province_entity.set<TextLocator>(province.text_locator);
+		if (province.flags & SaveGame::HAS_UNIT_LOCATOR)
+			province_entity.set<UnitLocator>(province.unit_locator);
+		if (province.flags & SaveGame::HAS_AABB)
+			province_entity.set<AABB>(province.aabb);
+	}
+
+	for (const SaveGame::Area &area : p_save.areas) {
+		const AreaEntity area_entity = ecs.entity(area.name.utf8().ptr());
+		area_entity.child_of(ecs.get_scope(Scope::Area));
+
+		for (const ProvinceIndex province : area.provinces) {
+			const ProvinceEntity province_entity = ecs.scope_lookup(Scope::Province, uitos(province));
+			province_entity.add(Relationship(InArea), area_entity);
+			area_entity.add(Relationship(ProvinceIn), province_entity);
+		}
+
+		area_entity.add<AreaTag>();
+		area_entity.add(Relationship(Capital), ecs.scope_lookup(Scope::Province, uitos(area.capital)));
+		area_entity.set<Color>(area.color);
+		area_entity.set<LocKey>(area.loc_key);
+	}
+
+	for (const SaveGame::Region &region : p_save.regions) {
+		const RegionEntity region_entity = ecs.entity(region.name.utf8().ptr());
+		region_entity.child_of(ecs.get_scope(Scope::Region));
+
+		for (const uint32_t area : region.areas) {
+			const AreaEntity area_entity = ecs.scope_lookup(Scope::Area, p_save.areas[area].name);
+			area_entity.add(Relationship(InRegion), region_entity);
+
+			int idx = 0;
+			Entity province_entity;
+			while ((province_entity = area_entity.target(Relationship(ProvinceIn), idx++)))
+				province_entity.add(Relationship(InRegion), region_entity);
+		}
+
+		region_entity.add<RegionTag>();
+		region_entity.add(Relationship(Capital), ecs.scope_lookup(Scope::Province, uitos(region.capital)));
+		region_entity.set<Color>(region.color);
+		region_entity.set<LocKey>(region.loc_key);
+	}
+
+	const CountryEntity observer_country_entity = ecs.entity(OBSERVER_TAG);
+	observer_country_entity.set<LocKey>(String(OBSERVER_TAG));
+	ecs.set<Player>(observer_country_entity);
+
+	for (const SaveGame::Country &country : p_save.countries) {
+		const CountryEntity country_entity = ecs.entity(country.name.utf8().ptr());
+		country_entity.child_of(ecs.get_scope(Scope::Country));
+
+		for (const ProvinceIndex province : country.provinces)
+			ecs.scope_lookup(Scope::Province, uitos(province)).add(Relationship(Owner), country_entity);
+
+		country_entity.add<CountryTag>();
+		country_entity.add(Relationship(Capital), ecs.scope_lookup(Scope::Province, uitos(country.capital)));
+		country_entity.set<Color>(country.color);
+		country_entity.set<LocKey>(country.loc_key);
+		country_entity.set<Treasury>(country.treasury);
+	}
+
+	if (p_save.player < p_save.countries.size())
+		ecs.set<Player>(ecs.scope_lookup(Scope::Country, p_save.countries[p_save.player].name));
+
+	for (const SaveGame::Unit &unit : p_save.units) {
+		const CountryEntity country_entity = ecs.scope_lookup(Scope::Country, p_save.countries[unit.owner].name);
+		const UnitEntity unit_entity = ecs.entity();
+		unit_entity.add(Relationship(Owner), country_entity);
+		unit_entity.add(Relationship(Location), ecs.scope_lookup(Scope::Province, uitos(unit.location)));
+		country_entity.add(Relationship(Unit), unit_entity);
+		unit_entity.add<UnitTag>();
+	}
+}
+
+Vec<String> Map::get_changed_sections(const Ref<ConfigFile> &p_old_config, const Ref<ConfigFile> &p_new_config) {
+	Vec<String> changed_sections;
+	for (const String &section : p_new_config->get_sections()) {
+		if (!p_old_config->has_section(section)) {
+			changed_sections.push_back(section);
+			continue;
+		}
+
+		const Vector<String> keys = p_new_config->get_section_keys(section);
+		bool changed = keys.size() != p_old_config->get_section_keys(section).size();
+		for (int i = 0; i < keys.size() and !changed; ++i)
+			changed = !p_old_config->has_section_key(section, keys[i]) or p_old_config->get_value(section, keys[i]) != p_new_config->get_value(section, keys[i]);
+
+		if (changed)
+			changed_sections.push_back(section);
+	}
+
+	for (const String &section : p_old_config->get_sections())
+		if (!p_new_config->has_section(section))
+			changed_sections.push_back(section);
+
+	return changed_sections;
+}
+
+void Map::set_province_area(ProvinceEntity p_province_entity, AreaEntity p_area_entity) {
+	ECS &ecs = *ECS::self;
+	const AreaEntity old_area_entity = ecs.get_target(p_province_entity, Relation::InArea);
+	if (old_area_entity == p_area_entity)
+		return;
+
+	if (old_area_entity.is_valid()) {
+		p_province_entity.remove(Relationship(InArea), old_area_entity);
+		old_area_entity.remove(Relationship(ProvinceIn), p_province_entity);
+	}
+
+	const RegionEntity old_region_entity = ecs.get_target(p_province_entity, Relation::InRegion);
+	if (old_region_entity.is_valid())
+		p_province_entity.remove(Relationship(InRegion), old_region_entity);
+
+	if (!p_area_entity.is_valid())
+		return;
+
+	// Provinces are in the region of their area.
+	p_province_entity.add(Relationship(InArea), p_area_entity);
+	p_area_entity.add(Relationship(ProvinceIn), p_province_entity);
+
+	const RegionEntity region_entity = ecs.get_target(p_area_entity, Relation::InRegion);
+	if (region_entity.is_valid())
+		p_province_entity.add(Relationship(InRegion), region_entity);
+}
+
+void Map::set_area_region(AreaEntity p_area_entity, RegionEntity p_region_entity) {
+	ECS &ecs = *ECS::self;
+	const RegionEntity old_region_entity = ecs.get_target(p_area_entity, Relation::InRegion);
+	if (old_region_entity == p_region_entity)
+		return;
+
+	Vec<ProvinceEntity> provinces;
+	p_area_entity.each(Relationship(ProvinceIn), [&provinces](Entity p_province) { provinces.push_back(p_province); });
+
+	if (old_region_entity.is_valid()) {
+		p_area_entity.remove(Relationship(InRegion), old_region_entity);
+		for (const ProvinceEntity province_entity : provinces)
+			province_entity.remove(Relationship(InRegion), old_region_entity);
+	}
+
+	if (!p_region_entity.is_valid())
+		return;
+
+	p_area_entity.add(Relationship(InRegion), p_region_entity);
+	for (const ProvinceEntity province_entity : provinces)
+		province_entity.add(Relationship(InRegion), p_region_entity);
+}
+
+void Map::set_capital(Entity p_entity, ProvinceEntity p_capital_entity) {
+	ECS &ecs = *ECS::self;
+	const ProvinceEntity old_capital_entity = ecs.get_target(p_entity, Relation::Capital);
+	if (old_capital_entity == p_capital_entity)
+		return;
+
+	if (old_capital_entity.is_valid())
+		p_entity.remove(Relationship(Capital), old_capital_entity);
+	if (p_capital_entity.is_valid())
+		p_entity.add(Relationship(Capital), p_capital_entity);
+}
+
+void Map::remove_country(CountryEntity p_country_entity) {
+	ECS &ecs = *ECS::self;
+
+	// Copied because every transfer changes the provinces of the country.
+	const Vec<ProvinceIndex> provinces = country_provinces.get_provinces(p_country_entity);
+	for (const ProvinceIndex province_id : provinces)
+		transfer_province(get_province_entity(province_id), CountryEntity());
+
+	Vec<UnitEntity> units;
+	p_country_entity.each(Relationship(Unit), [&units](Entity p_unit) { units.push_back(p_unit); });
+	for (const UnitEntity unit_entity : units) {
+		on_unit_location_changed(unit_entity, ecs.get_target(unit_entity, Relation::Location), ProvinceEntity());
+		if (MapUnits::self != nullptr and unit_entity.has<UnitModel>())
+			MapUnits::self->remove_unit(unit_entity.get<UnitModel>());
+		unit_entity.destruct();
+	}
+
+	const CountryEntity player = ecs.get<Player>();
+	if (player == p_country_entity)
+		ecs.set<Player>(ecs.lookup(OBSERVER_TAG));
+
+	p_country_entity.destruct();
+}
+
+void Map::update_country_income(CountryEntity p_country_entity) {
+	if (!p_country_entity.is_valid() or !p_country_entity.has<Treasury>())
+		return;
+
+	Treasury treasury = p_country_entity.get<Treasury>();
+	treasury.income = province_table.get_total_income(country_provinces.get_provinces(p_country_entity));
+	p_country_entity.set<Treasury>(treasury);
+}
+
+void Map::rebuild_province_graph() {
+	// Blocked provinces aren't part of the configs so they are blocked again in the new graph.
+	Vec<ProvinceEntity> blocked_provinces;
+	for (ProvinceGraph::Node node = 0; node < province_graph.get_node_count(); ++node)
+		if (province_graph.is_node_blocked(node))
+			blocked_provinces.push_back(province_graph.get_province(node));
+
+	path_service.wait();
+	province_graph.build(province_table, province_adjacencies);
+	landmark_oracle.build(province_graph);
+	path_finder.build(province_graph, province_table);
+	path_service.init(&province_graph, &path_finder);
+
+	for (const ProvinceEntity province_entity : blocked_provinces)
+		set_province_passable(province_entity, false);
+}
+
+void Map::refresh_map_modes() {
+	// Label text is cached per map mode so every map mode is evaluated, only the current one is written to the texture.
+	for (uint32_t i = 1; i < color_to_id_map.size() + 1; ++i) {
+		const ProvinceEntity province_entity = get_province_entity(ProvinceIndex(i));
+		if (!province_entity.is_valid())
+			continue;
+
+		const Color area_color = get_area_map_mode(province_entity);
+		const Color region_color = get_region_map_mode(province_entity);
+		const Color country_color = get_country_map_mode(province_entity);
+
+		switch (map_mode) {
+			case MapMode::Country: {
+				set_map_mode_texel(ProvinceIndex(i), country_color);
+			} break;
+			case MapMode::Area: {
+				set_map_mode_texel(ProvinceIndex(i), area_color);
+			} break;
+			case MapMode::Region: {
+				set_map_mode_texel(ProvinceIndex(i), region_color);
+			} break;
+			case MapMode::MAP_MODE_MAX: break;
+		}
+	}
+
+	if (MapLabelShaper::self != nullptr)
+		MapLabelShaper::self->dispatch();
+}
+
+void Map::reload_map_config() {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	ECS &ecs = *ECS::self;
+
+	Ref<ConfigFile> configs[MAP_CONFIG_MAX];
+	Vec<String> changed_sections[MAP_CONFIG_MAX];
+	uint32_t changed_section_count = 0;
+	for (int i = 0; i < MAP_CONFIG_MAX; ++i) {
+		ERR_FAIL_COND_MSG(loaded_configs[i].is_null(), "The map has to be loaded from its configs before they can be reloaded.");
+		configs[i].instantiate();
+		ERR_FAIL_COND_MSG(configs[i]->load(map_config_paths[i]) != OK, vformat("Failed to reload %s.", map_config_paths[i]));
+		changed_sections[i] = get_changed_sections(loaded_configs[i], configs[i]);
+		changed_section_count += changed_sections[i].size();
+	}
+
+	if (changed_section_count == 0) {
+		print_line("Map configs haven't changed");
+		return;
+	}
+
+	// Workers solving paths read the graph and the area and region relations.
+	path_service.wait();
+
+	bool graph_changed = false;
+	bool map_modes_changed = false;
+	Vec<ProvinceEntity> changed_provinces; // Provinces whose borders have to be checked again
+
+	// Provinces can only change their type, everything else about them is baked.
+	const Ref<ConfigFile> &province_config = configs[PROVINCE_CONFIG];
+	for (const String &section : changed_sections[PROVINCE_CONFIG]) {
+		const ProvinceEntity province_entity = get_province_entity(section.to_int());
+		if (!province_entity.is_valid() or !province_config->has_section(section) or
+				province_config->get_value(section, "color", Color()) != loaded_configs[PROVINCE_CONFIG]->get_value(section, "color", Color())) {
+			WARN_PRINT(vformat("Province %s was added, removed or changed color, open the map editor to bake the map data again.", section));
+			continue;
+		}
+
+		const int type_index = get_province_type_index(province_config->get_value(section, "type", "land"));
+		for (int i = 0; i < province_type_count; ++i)
+			province_entity.remove(get_province_type_tag(i));
+		if (type_index < province_type_count)
+			province_entity.add(get_province_type_tag(type_index));
+		province_table.set_type(get_province_index(province_entity), type_index < province_type_count ? province_type_values[type_index] : ProvinceType::None);
+
+		changed_provinces.push_back(province_entity);
+		graph_changed = true;
+		map_modes_changed = true;
+	}
+
+	// Baked adjacency types depend on the province types.
+	if (!changed_provinces.is_empty())
+		for (ProvinceAdjacency &adjacency : province_adjacencies)
+			if (adjacency.type != ProvinceAdjacencyType::Crossing and (changed_provinces.has(adjacency.first) or changed_provinces.has(adjacency.second)))
+				adjacency.type = province_table.get_adjacency_type(get_province_index(adjacency.first), get_province_index(adjacency.second));
+
+	// Areas. A province that is listed by another area now has already left this one, so only provinces that are still in the area are removed from it.
+	const Ref<ConfigFile> &area_config = configs[AREA_CONFIG];
+	const Ref<ConfigFile> &old_area_config = loaded_configs[AREA_CONFIG];
+	for (const String &section : changed_sections[AREA_CONFIG]) {
+		AreaEntity area_entity = ecs.scope_lookup(Scope::Area, section);
+		graph_changed = true;
+		map_modes_changed = true;
+
+		if (!area_config->has_section(section)) {
+			if (!area_entity.is_valid())
+				continue;
+
+			Vec<ProvinceEntity> provinces;
+			area_entity.each(Relationship(ProvinceIn), [&provinces](Entity p_province) { provinces.push_back(p_province); });
+			for (const ProvinceEntity province_entity : provinces) {
+				set_province_area(province_entity, AreaEntity());
+				changed_provinces.push_back(province_entity);
+			}
+
+			area_entity.destruct();
+			continue;
+		}
+
+		Color color = area_config->get_value(section, "color", get_random_area_color());
+		color = Color::from_rgba8(color.r, color.g, color.b);
+		if (!area_entity.is_valid()) {
+			const LocKey loc_key = section;
+			Vec<ecs_entity_t> area_entities;
+			bulk_create_entities(Scope::Area, { section }, { ecs.id<AreaTag>(), ecs.id<Color>(), ecs.id<LocKey>() }, { nullptr, &color, &loc_key }, area_entities);
+			area_entity = Entity(ecs, area_entities[0]);
+		}
+		area_entity.set<Color>(color);
+
+		const PackedInt32Array provinces = area_config->get_value(section, "provinces", PackedInt32Array());
+		const PackedInt32Array old_provinces = old_area_config->get_value(section, "provinces", PackedInt32Array());
+		for (const int province : old_provinces) {
+			const ProvinceEntity province_entity = get_province_entity(province);
+			if (!provinces.has(province) and province_entity.is_valid() and ecs.get_target(province_entity, Relation::InArea) == area_entity) {
+				set_province_area(province_entity, AreaEntity());
+				changed_provinces.push_back(province_entity);
+			}
+		}
+
+		for (const int province : provinces) {
+			const ProvinceEntity province_entity = get_province_entity(province);
+			if (province_entity.is_valid() and ecs.get_target(province_entity, Relation::InArea) != area_entity) {
+				set_province_area(province_entity, area_entity);
+				changed_provinces.push_back(province_entity);
+			}
+		}
+
+		set_capital(area_entity, get_province_entity(int(area_config->get_value(section, "capital", 0))));
+	}
+
+	// Regions, areas move between regions the same way provinces move between areas.
+	const Ref<ConfigFile> &region_config = configs[REGION_CONFIG];
+	const Ref<ConfigFile> &old_region_config = loaded_configs[REGION_CONFIG];
+	for (const String &section : changed_sections[REGION_CONFIG]) {
+		RegionEntity region_entity = ecs.scope_lookup(Scope::Region, section);
+		graph_changed = true;
+		map_modes_changed = true;
+
+		const PackedStringArray areas = region_config->get_value(section, "areas", PackedStringArray());
+		const PackedStringArray old_areas = old_region_config->get_value(section, "areas", PackedStringArray());
+		if (region_entity.is_valid()) {
+			for (const String &area : old_areas) {
+				const AreaEntity area_entity = ecs.scope_lookup(Scope::Area, area);
+				if (!areas.has(area) and area_entity.is_valid() and ecs.get_target(area_entity, Relation::InRegion) == region_entity)
+					set_area_region(area_entity, RegionEntity());
+			}
+		}
+
+		if (!region_config->has_section(section)) {
+			if (region_entity.is_valid())
+				region_entity.destruct();
+			continue;
+		}
+
+		Color color = region_config->get_value(section, "color", get_random_area_color());
+		color = Color::from_rgba8(color.r, color.g, color.b);
+		if (!region_entity.is_valid()) {
+			const LocKey loc_key = section;
+			Vec<ecs_entity_t> region_entities;
+			bulk_create_entities(Scope::Region, { section }, { ecs.id<RegionTag>(), ecs.id<Color>(), ecs.id<LocKey>() }, { nullptr, &color, &loc_key }, region_entities);
+			region_entity = Entity(ecs, region_entities[0]);
+		}
+		region_entity.set<Color>(color);
+
+		for (const String &area : areas) {
+			const AreaEntity area_entity = ecs.scope_lookup(Scope::Area, area);
+			if (area_entity.is_valid())
+				set_area_region(area_entity, region_entity);
+		}
+
+		set_capital(region_entity, get_province_entity(int(region_config->get_value(section, "capital", 0))));
+	}
+
+	// Types, areas and regions are copied again, owners are kept in sync by the transfers.
+	build_province_table();
+
+	// Countries take their provinces before any country releases the provinces it lost, so a province that moved between two countries is only transferred once.
+	// New countries start without units.
+	const Ref<ConfigFile> &country_config = configs[COUNTRY_CONFIG];
+	for (const String &section : changed_sections[COUNTRY_CONFIG]) {
+		if (!country_config->has_section(section))
+			continue;
+
+		CountryEntity country_entity = ecs.scope_lookup(Scope::Country, section);
+		map_modes_changed = true;
+
+		Color color = country_config->get_value(section, "color", get_random_area_color());
+		color = Color::from_rgba8(color.r, color.g, color.b);
+		if (!country_entity.is_valid()) {
+			const LocKey loc_key = section;
+			const Treasury treasury;
+			Vec<ecs_entity_t> country_entities;
+			bulk_create_entities(Scope::Country, { section }, { ecs.id<CountryTag>(), ecs.id<Color>(), ecs.id<LocKey>(), ecs.id<Treasury>() }, { nullptr, &color, &loc_key, &treasury }, country_entities);
+			country_entity = Entity(ecs, country_entities[0]);
+		}
+		country_entity.set<Color>(color);
+
+		if (MapUnits::self != nullptr)
+			country_entity.each(Relationship(Unit), [&color](Entity p_unit) {
+				if (p_unit.has<UnitModel>())
+					MapUnits::self->set_owner_color(p_unit.get<UnitModel>(), color);
+			});
+
+		const PackedInt32Array provinces = country_config->get_value(section, "provinces", PackedInt32Array());
+		for (const int province : provinces) {
+			const ProvinceEntity province_entity = get_province_entity(province);
+			if (province_entity.is_valid() and country_provinces.get_owner(province) != country_entity)
+				transfer_province(province_entity, country_entity);
+		}
+	}
+
+	for (const String &section : changed_sections[COUNTRY_CONFIG]) {
+		const CountryEntity country_entity = ecs.scope_lookup(Scope::Country, section);
+		if (!country_entity.is_valid())
+			continue;
+
+		if (!country_config->has_section(section)) {
+			remove_country(country_entity);
+			continue;
+		}
+
+		const PackedInt32Array provinces = country_config->get_value(section, "provinces", PackedInt32Array());
+		const Vec<ProvinceIndex> owned_provinces = country_provinces.get_provinces(country_entity);
+		for (const ProvinceIndex province_id : owned_provinces)
+			if (!provinces.has(province_id))
+				transfer_province(get_province_entity(province_id), CountryEntity());
+
+		set_capital(country_entity, get_province_entity(int(country_config->get_value(section, "capital", 0))));
+	}
+
+	// Locators of sections that were removed keep their last value.
+	const Ref<ConfigFile> &text_config = configs[TEXT_LOCATOR_CONFIG];
+	for (const String &section : changed_sections[TEXT_LOCATOR_CONFIG]) {
+		const ProvinceEntity province_entity = get_province_entity(section.to_int());
+		if (!province_entity.is_valid() or !text_config->has_section(section))
+			continue;
+
+		TextLocator locator;
+		locator.position = text_config->get_value(section, "position");
+		locator.orientation = text_config->get_value(section, "orientation");
+		locator.scale = text_config->get_value(section, "scale");
+		province_entity.set<TextLocator>(locator);
+
+		if (MapLabel **label = map_labels.getptr(province_entity); label != nullptr)
+			(*label)->set_transform(get_text_transform(locator));
+	}
+
+	// Units that are standing still keep their position until they move again.
+	const Ref<ConfigFile> &unit_config = configs[UNIT_LOCATOR_CONFIG];
+	for (const String &section : changed_sections[UNIT_LOCATOR_CONFIG]) {
+		const ProvinceEntity province_entity = get_province_entity(section.to_int());
+		if (!province_entity.is_valid() or !unit_config->has_section(section))
+			continue;
+
+		UnitLocator locator;
+		locator.position = unit_config->get_value(section, "position");
+		locator.orientation = unit_config->get_value(section, "orientation");
+		locator.scale = unit_config->get_value(section, "scale");
+		province_entity.set<UnitLocator>(locator);
+		province_table.set_position(section.to_int(), locator.position);
+		graph_changed = true;
+	}
+
+	for (const ProvinceEntity province_entity : changed_provinces)
+		update_province_borders(province_entity);
+
+	if (graph_changed)
+		rebuild_province_graph();
+
+	if (map_modes_changed)
+		refresh_map_modes();
+
+	if (!changed_sections[TEXT_LOCATOR_CONFIG].is_empty()) {
+		label_manager.invalidate();
+		label_manager.refresh();
+	}
+
+	// Country labels follow the text locators and owners of provinces.
+	country_labels.invalidate_all();
+	labels_dirty = true;
+
+	if (MapUnits::self != nullptr)
+		MapUnits::self->flush();
+
+	for (int i = 0; i < MAP_CONFIG_MAX; ++i)
+		loaded_configs[i] = configs[i];
+
+	print_line("Reloaded ", changed_section_count, " changed map config sections in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+}
+
+const Vec<ProvinceAdjacency> &Map::get_province_adjacencies() const { return province_adjacencies; }
+
+const ProvinceGraph &Map::get_province_graph() const { return province_graph; }
+
+DistanceFields &Map::get_distance_fields() { return distance_fields; }
+
+const LandmarkOracle &Map::get_landmark_oracle() const { return landmark_oracle; }
+
+void Map::set_province_passable(ProvinceEntity p_province_entity, bool p_passable) {
+	const ProvinceGraph::Node node = province_graph.get_node(p_province_entity);
+	ERR_FAIL_COND(node == ProvinceGraph::INVALID_NODE);
+	path_service.wait();
+	path_finder.set_province_blocked(province_graph, node, !p_passable);
+}
+
+void Map::update_units(double p_delta) {
+	simulation.update(p_delta);
+
+	// Paths requested this frame are solved while it renders and published by the next tick.
+	path_service.flush();
+}
+
+void Map::begin_simulation_tick(void *p_map) {
+	Map &map = *static_cast<Map *>(p_map);
+	map.path_service.tick();
+
+	Vec<ProvinceEntity> path;
+	for (uint32_t i = 0; i < map.pending_moves.size();) {
+		const PendingMove &pending_move = map.pending_moves[i];
+		const PathService::PathResult *result = map.path_service.get_result(pending_move.request);
+		if (result == nullptr) {
+			++i;
+			continue;
+		}
+
+		if (result->found and pending_move.unit.is_alive()) {
+			// A unit that is already in the province still walks back to its locator.
+			path.clear();
+			if (result->path.is_empty())
+				path.push_back(pending_move.goal);
+			for (const ProvinceGraph::Node node : result->path)
+				path.push_back(map.province_graph.get_province(node));
+
+			map.unit_movement.move_unit(pending_move.unit, path);
+		}
+
+		map.pending_moves.remove_at_unordered(i);
+	}
+}
+
+bool Map::move_selected_units(ProvinceEntity p_province_entity) {
+	if (MapUnits::self == nullptr)
+		return false;
+
+	ECS &ecs = *ECS::self;
+	const CountryEntity player = ecs.get<Player>();
+
+	const ProvinceGraph::Node goal = province_graph.get_node(p_province_entity);
+	if (goal == ProvinceGraph::INVALID_NODE)
+		return false;
+
+	bool moved = false;
+
+	// Only the tables of units owned by the player are matched, the selection is read from the unit models.
+	const auto unit_query = ecs.query_builder<const UnitModel>().with<UnitTag>().with(Relationship(Owner), player).build();
+	unit_query.each([this, &ecs, &moved, &p_province_entity, goal](UnitEntity p_unit, const UnitModel &p_model) {
+		if (!MapUnits::self->is_selected(p_model))
+			return;
+
+		const ProvinceGraph::Node start = province_graph.get_node(ecs.get_target(p_unit, Relation::Location));
+		if (start == ProvinceGraph::INVALID_NODE)
+			return;
+
+		// A newer order replaces a move that is still waiting for its path.
+		for (uint32_t i = 0; i < pending_moves.size(); ++i) {
+			if (pending_moves[i].unit == p_unit) {
+				pending_moves.remove_at_unordered(i);
+				break;
+			}
+		}
+
+		pending_moves.push_back({ p_unit, p_province_entity, path_service.request_path(start, goal, MovementDomain::Land) });
+		moved = true;
+	});
+
+	return moved;
+}
+
+void Map::on_unit_location_changed(UnitEntity p_unit_entity, ProvinceEntity p_old_location, ProvinceEntity p_new_location) { unit_stacks.move_unit(p_unit_entity, p_old_location, p_new_location); }
+
 Map::~Map() {
 	for (const BorderMeshStorage &border_mesh : border_meshes)
 		RS::get_singleton()->free(border_mesh.instance);
@@ -858,4 +2232,14 @@ Map::~Map() {
 		if (kv.value != nullptr)
 			memdelete(kv.value);
 	map_labels.clear();
+	label_manager.clear();
+	country_labels.clear();
+	unit_stacks.clear();
+	memdelete_notnull(MapLabelShaper::self);
+	memdelete_notnull(MapLabelBatch::self);
+	memdelete_notnull(MapUnits::self);
+	MapLabelShaper::self = nullptr;
+	MapLabelBatch::self = nullptr;
+	MapUnits::self = nullptr;
+	MapLabel::set_font(Ref<Font>());
 }
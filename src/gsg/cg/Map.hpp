@@ -1,14 +1,29 @@
 #pragma once
 
+#include "core/io/config_file.h"
 #include "core/io/image.h"
 #include "core/templates/a_hash_map.h"
 
 #include "scene/resources/image_texture.h"
 
 #include "ecs/entity.hpp"
+#include "ecs/Provinces.hpp"
 
 #include "templates/Vec.hpp"
 
+#include "cg/CountryLabels.hpp"
+#include "cg/CountryProvinces.hpp"
+#include "cg/DistanceFields.hpp"
+#include "cg/MapLabelManager.hpp"
+#include "cg/HierarchicalPathFinder.hpp"
+#include "cg/LandmarkOracle.hpp"
+#include "cg/PathService.hpp"
+#include "cg/ProvinceGraph.hpp"
+#include "cg/ProvinceTable.hpp"
+#include "cg/Simulation.hpp"
+#include "cg/UnitMovement.hpp"
+#include "cg/UnitStacks.hpp"
+
 #include "defs/singleton.hpp"
 
 class SurfaceTool;
@@ -19,10 +34,9 @@ class Node3D;
 namespace CG {
 
 class MapLabel;
-enum class ProvinceBorderType : uint8_t;
+struct SaveGame;
 enum class MapMode : uint8_t;
 
-using ProvinceIndex = int; // Index into the province lookup texture.
 using ProvinceColorMap = AHashMap<Color, ProvinceIndex>;
 
 static constexpr float border_map_layer = 0.01;
@@ -41,32 +55,77 @@ private:
 		AABB aabb;
 	};
 
+	// Where the label of a province fits best, in map pixels. orientation is in radians like Locator::orientation.
+	struct LabelPlacement {
+		Vector2 position;
+		float orientation{};
+		float scale{};
+	};
+
+	struct LabelPlacementJob {
+		const Vec<Vector2> *pixels{};
+		CachedMapData map_data;
+		LabelPlacement placement;
+	};
+
 	static Vector2 calculate_centroid(const Polygon &p_polygon);
 	static CachedMapData calc_map_data(const Polygon &p_polygon, const Vector2 &p_centroid);
+	static void distance_transform(Vec<float> &r_grid, int p_width, int p_height);
+	static LabelPlacement calc_label_placement(const Vec<Vector2> &p_pixels, const CachedMapData &p_map_data);
+	static void bake_label_placement(void *p_jobs, uint32_t p_index);
 
 	static Color get_random_area_color();
 	static Color get_lookup_color(ProvinceIndex p_province_id);
+	static Vector2i get_province_texel(ProvinceIndex p_province_id);
+	static void register_components();
 	ProvinceColorMap load_map_config();
+	void load_save_game(const SaveGame &p_save);
+	// Create one named child of p_scope per name directly in the archetype of p_ids, p_data has an array per id or null for tags.
+	// Ids already in r_entities are used for the new entities, otherwise r_entities is filled with new ids.
+	static void bulk_create_entities(Scope p_scope, const Vec<String> &p_names, const Vec<ecs_id_t> &p_ids, const Vec<const void *> &p_data, Vec<ecs_entity_t> &r_entities);
+	// Add all pairs to p_entity with a single move to its final table, adding many pairs one by one creates a table for every pair in between.
+	static void add_pairs(Entity p_entity, Vec<ecs_id_t> &r_pairs);
+	// Create the entities of a save one entity, component and relationship at a time, only used to benchmark against load_save_game().
+	static void create_entities_one_by_one(const SaveGame &p_save);
 
-	static bool is_lake_border(const Border &p_border);
-	static void fill_province_adjacency_data(const Border &p_border);
-	static ProvinceBorderType fill_province_border_data(const Border &p_border, const RID &p_rid);
+	bool is_lake_border(ProvinceIndex p_first, ProvinceIndex p_second) const;
+	ProvinceBorderType get_province_border_type(const Border &p_border) const;
+	ProvinceBorderType fill_province_border_data(const Border &p_border, const RID &p_rid);
+	void build_province_table();
 
 	static void add_rounded_border_corners(Ref<SurfaceTool> &p_st, const Vector2 &p_v1, const Vector2 &p_v2, float p_radius);
 	void create_border_materials();
 	static Ref<ArrayMesh> create_border_mesh(const Vec<Vector4> &p_segments, float p_border_thickness, float p_border_rounding);
-	void create_map_labels();
-	static void create_unit_models(Node3D *p_map);
-	void create_border_meshes(const RID &p_scenario, const Dictionary &p_border_dict, bool is_map_editor);
-	static void load_locators();
-	static void load_map_data();
+	void create_map_labels(const RID &p_scenario);
+	void create_unit_models(const RID &p_scenario);
+	void create_border_meshes(const RID &p_scenario, const Dictionary &p_border_dict);
+	void load_province_adjacencies(const PackedInt32Array &p_adjacencies);
+	void load_locators();
+	void load_map_data();
+	void create_selection_texture();
 
 	Color get_country_map_mode(ProvinceEntity p_province_entity);
 	Color get_area_map_mode(ProvinceEntity p_province_entity);
 	Color get_region_map_mode(ProvinceEntity p_province_entity);
+	void set_map_mode_texel(ProvinceIndex p_province_id, const Color &p_color);
+	void update_province_borders(ProvinceEntity p_province_entity);
+
+	// Sections that were added, removed or have a different value in p_new_config.
+	static Vec<String> get_changed_sections(const Ref<ConfigFile> &p_old_config, const Ref<ConfigFile> &p_new_config);
+	static void set_province_area(ProvinceEntity p_province_entity, AreaEntity p_area_entity);
+	static void set_area_region(AreaEntity p_area_entity, RegionEntity p_region_entity);
+	static void set_capital(Entity p_entity, ProvinceEntity p_capital_entity);
+	void remove_country(CountryEntity p_country_entity);
+	void update_country_income(CountryEntity p_country_entity);
+	void rebuild_province_graph();
+	void refresh_map_modes();
 
 public:
-	template <bool is_map_editor> void load_map(Node3D *p_map);
+	static constexpr const char *default_map_data_path = "res://data/gen/map_data.cfg";
+
+	// Create the map entities from the map configs, or from p_save_path if it is a save file that can be read.
+	// Borders and adjacencies are read from p_map_data_path, benchmarks pass the map data of their synthetic world.
+	template <bool is_map_editor> void load_map(Node3D *p_map, const String &p_save_path = String(), const String &p_map_data_path = default_map_data_path);
 
 #ifdef TOOLS_ENABLED
 	void load_map_editor(Node3D *p_map);
@@ -74,15 +133,93 @@ public:
 
 	Ref<Image> get_lookup_image();
 	Ref<ImageTexture> get_lookup_texture();
-	ProvinceColorMap get_color_to_id_map();
+	const ProvinceColorMap &get_color_to_id_map() const;
 	template <MapMode T> Ref<ImageTexture> get_map_mode();
 
+	// Read the map configs and locators again and apply only the sections that changed to the running game, without resetting the ECS.
+	// Province sections can only change their type, new provinces and province colors need the map data to be baked again in the map editor.
+	void reload_map_config();
+	// Write the provinces, areas, regions, countries and units to a binary save file that load_map can create the map from.
+	Error save_game(const String &p_path) const;
+
+	// Province selection. Each province has a flag in the selection texture at the same texel as its map mode color so the map shader can check it with a single lookup.
+	// Changes are only uploaded to the GPU when calling update_selection_texture().
+	void select_province(ProvinceIndex p_province_id);
+	void deselect_province(ProvinceIndex p_province_id);
+	bool is_province_selected(ProvinceIndex p_province_id) const;
+	void clear_selection();
+	void update_selection_texture();
+	Ref<ImageTexture> get_selection_texture();
+
+	// Hide labels that are too small or overlap larger labels at this camera distance.
+	void update_label_lod(float p_camera_distance);
+	// Replace units with per province stacks when the camera is far away.
+	void update_unit_lod(float p_camera_distance);
+	// Apply label text that finished shaping on worker threads, called every frame.
+	void update_labels();
+	// Give a province to p_new_owner. The relations and the province index change immediately, the map mode texels, borders, capitals and selection of the province are patched in place.
+	// Textures are uploaded once per frame in update_transfers() so many transfers in one tick only pay for the upload once, country labels are rebuilt a few countries per frame.
+	void transfer_province(ProvinceEntity p_province_entity, CountryEntity p_new_owner);
+	// Upload what changed from transfers since the last call, called every frame.
+	void update_transfers();
+	// Run p_ticks ticks of p_transfers_per_tick random transfers and print the transfer and update times.
+	void benchmark_transfers(uint32_t p_transfers_per_tick, uint32_t p_ticks);
+	// Create a synthetic world one entity and relationship at a time and again in bulk like load_save_game() and print both times, the world is reset by both.
+	void benchmark_entity_creation(uint32_t p_province_count, uint32_t p_country_count, uint32_t p_unit_count);
+	// Entity of a province id, provinces have a reserved id range so this doesn't need a name lookup.
+	ProvinceEntity get_province_entity(ProvinceIndex p_province_id) const;
+	// Id of a province entity, 0 for any entity that isn't a loaded province.
+	ProvinceIndex get_province_index(ProvinceEntity p_province_entity) const;
+	// Ids of the provinces owned by a country.
+	const Vec<ProvinceIndex> &get_country_provinces(CountryEntity p_country_entity) const;
+	// Dense per province columns of the province types, owners, areas, regions and unit locator positions.
+	const ProvinceTable &get_province_table() const;
+	// Baked adjacencies between provinces and the crossings between them.
+	const Vec<ProvinceAdjacency> &get_province_adjacencies() const;
+	const ProvinceGraph &get_province_graph() const;
+	// Distance fields over the province graph, call DistanceFields::update after changing sources.
+	DistanceFields &get_distance_fields();
+	// Lower bounds for the travel cost between provinces without searching a path.
+	const LandmarkOracle &get_landmark_oracle() const;
+	// Stop units from pathing through a province, cached paths and the area and region graphs are updated for only this province.
+	void set_province_passable(ProvinceEntity p_province_entity, bool p_passable);
+
+	// Run simulation ticks, draw moving units and start solving the paths requested this frame, called every frame.
+	void update_units(double p_delta);
+	// Request paths for the selected units of the player to p_province_entity, the units start moving once their paths are solved. Returns false if no unit was selected.
+	bool move_selected_units(ProvinceEntity p_province_entity);
+	// Move a unit between the stacks of two provinces after its Location changed, either province can be invalid when the unit is created or destroyed.
+	void on_unit_location_changed(UnitEntity p_unit_entity, ProvinceEntity p_old_location, ProvinceEntity p_new_location);
+
 	~Map();
 
 private:
 	ProvinceColorMap color_to_id_map; // lookup image color -> province id
 	Ref<Image> lookup_image;
 	Ref<Image> map_mode_image;
+	Ref<ImageTexture> map_mode_texture; // Texture of the last map mode returned by get_map_mode
+	MapMode map_mode{};
+	bool map_mode_dirty = false;
+	bool labels_dirty = false;
+	Ref<Image> selection_image;
+	Ref<ImageTexture> selection_texture;
+	Vec<ProvinceIndex> selected_provinces;
+	ecs_entity_t province_entity_offset = 0;
+	ProvinceIndex max_province_id = 0; // Largest loaded province id, entities after province_entity_offset + max_province_id aren't provinces.
+	bool selection_dirty = false;
+
+	enum MapConfig : uint8_t {
+		PROVINCE_CONFIG,
+		AREA_CONFIG,
+		REGION_CONFIG,
+		COUNTRY_CONFIG,
+		TEXT_LOCATOR_CONFIG,
+		UNIT_LOCATOR_CONFIG,
+		MAP_CONFIG_MAX
+	};
+	static constexpr const char *map_config_paths[MAP_CONFIG_MAX] = { "res://data/provinces.cfg", "res://data/areas.cfg", "res://data/regions.cfg", "res://data/countries.cfg",
+		"res://data/locators/text.cfg", "res://data/locators/unit.cfg" };
+	Ref<ConfigFile> loaded_configs[MAP_CONFIG_MAX]; // Configs the entities were last made from
 
 	struct BorderMeshStorage {
 		Ref<ArrayMesh> mesh;
@@ -91,6 +228,29 @@ private:
 	Vec<BorderMeshStorage> border_meshes;
 	Vec<RID> border_materials;
 	AHashMap<ProvinceEntity, MapLabel *, EntityHasher> map_labels;
+	MapLabelManager label_manager;
+	CountryLabels country_labels;
+	CountryProvinces country_provinces;
+	ProvinceTable province_table;
+	UnitStacks unit_stacks;
+	UnitMovement unit_movement;
+	Simulation simulation;
+	Vec<ProvinceAdjacency> province_adjacencies;
+	ProvinceGraph province_graph;
+	LandmarkOracle landmark_oracle;
+	HierarchicalPathFinder path_finder;
+	PathService path_service;
+	DistanceFields distance_fields;
+
+	struct PendingMove {
+		UnitEntity unit;
+		ProvinceEntity goal;
+		PathService::RequestID request = 0;
+	};
+	Vec<PendingMove> pending_moves;
+
+	// Publish the solved paths and start the moves that got one, called by the simulation before every tick.
+	static void begin_simulation_tick(void *p_map);
 };
 
 } // namespace CG
\ No newline at end of file
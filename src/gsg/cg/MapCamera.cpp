@@ -7,6 +7,8 @@
 #include "scene/main/node.h"
 #include "scene/main/viewport.h"
 
+#include "Map.hpp"
+
 using namespace CG;
 
 #define CAMERA_ZOOM_SPEED_DAMP 0.92
@@ -64,6 +66,10 @@ void MapCamera::_notification(int p_what) {
 				return;
 
 			camera_zoom_update();
+			if (Map::self != nullptr) {
+				Map::self->update_label_lod(get_zoom());
+				Map::self->update_unit_lod(get_zoom());
+			}
 			camera_rotate_to_mouse_offsets();
 			camera_base_rotate();
 			camera_base_move();
@@ -134,6 +140,8 @@ void MapCamera::camera_zoom_update() {
 	camera_zoom_direction *= CAMERA_ZOOM_SPEED_DAMP;
 }
 
+float MapCamera::get_zoom() const { return camera->get_position().z; }
+
 void MapCamera::camera_rotate_to_mouse_offsets() {
 	if (mouse_last_position == Vector2(0, 0))
 		return;
@@ -57,6 +57,7 @@ public:
 
 	void camera_base_move();
 	void camera_zoom_update();
+	float get_zoom() const; // Distance from the camera to the map.
 	void camera_rotate_to_mouse_offsets();
 	void camera_base_rotate();
 	void camera_socket_rotate(float direction);
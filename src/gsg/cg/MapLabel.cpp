@@ -7,9 +7,18 @@
 
 #include "nodes/Map3D.hpp"
 
+#include "MapLabelShaper.hpp"
+
 using namespace CG;
 
-Ref<Font> MapLabel::_get_font_or_default() {
+static Ref<Font> label_font;
+
+void MapLabel::set_font(const Ref<Font> &p_font) { label_font = p_font; }
+
+Ref<Font> MapLabel::get_font_or_default() {
+	if (label_font.is_valid())
+		return label_font;
+
 	const StringName theme_name = SceneStringName(font);
 	Vector<StringName> theme_types;
 	ThemeDB::get_singleton()->get_native_type_dependencies("Label3D", theme_types);
@@ -36,7 +45,7 @@ Ref<Font> MapLabel::_get_font_or_default() {
 	return f;
 }
 
-void MapLabel::_generate_glyph_surfaces(const Glyph &p_glyph, Vector2 &r_offset, const Color &p_modulate, int p_priority, int p_outline_size) {
+void MapLabel::_generate_glyph_surfaces(const Glyph &p_glyph, Vector2 &r_offset, const Color &p_modulate, LabelGlyphSurfaces &r_surfaces, int p_priority, int p_outline_size) {
 	if (p_glyph.index == 0) {
 		r_offset.x += p_glyph.advance * pixel_size * p_glyph.repeat; // Non visual character, skip.
 		return;
@@ -67,152 +76,64 @@ void MapLabel::_generate_glyph_surfaces(const Glyph &p_glyph, Vector2 &r_offset,
 		return;
 	}
 
-	const bool msdf = TS->font_is_multichannel_signed_distance_field(p_glyph.font_rid);
+	const LabelSurfaceKey key = LabelSurfaceKey(tex.get_id(), p_priority, p_outline_size);
+	if (!r_surfaces.has(key)) {
+		LabelGlyphSurface surf;
+		surf.texture = tex;
+		surf.texture_size = texs;
+		surf.msdf = TS->font_is_multichannel_signed_distance_field(p_glyph.font_rid);
+		if (surf.msdf)
+			surf.msdf_pixel_range = TS->font_get_msdf_pixel_range(p_glyph.font_rid);
+
+		r_surfaces[key] = surf;
+	}
+	LabelGlyphSurface &s = r_surfaces[key];
+	const float z_shift = p_priority * pixel_size;
 
 	for (int j = 0; j < p_glyph.repeat; j++) {
-		const SurfaceKey key = SurfaceKey(tex.get_id(), p_priority, p_outline_size);
-		if (!surfaces.has(key)) {
-			SurfaceData surf;
-			surf.material = RenderingServer::get_singleton()->material_create();
-			// Set defaults for material, names need to match up those in StandardMaterial3D
-			RS::get_singleton()->material_set_param(surf.material, "albedo", Color(1, 1, 1, 1));
-			RS::get_singleton()->material_set_param(surf.material, "specular", 0.5);
-			RS::get_singleton()->material_set_param(surf.material, "metallic", 0.0);
-			RS::get_singleton()->material_set_param(surf.material, "roughness", 1.0);
-			RS::get_singleton()->material_set_param(surf.material, "uv1_offset", Vector3(0, 0, 0));
-			RS::get_singleton()->material_set_param(surf.material, "uv1_scale", Vector3(1, 1, 1));
-			RS::get_singleton()->material_set_param(surf.material, "uv2_offset", Vector3(0, 0, 0));
-			RS::get_singleton()->material_set_param(surf.material, "uv2_scale", Vector3(1, 1, 1));
-			RS::get_singleton()->material_set_param(surf.material, "alpha_scissor_threshold", alpha_scissor_threshold);
-			RS::get_singleton()->material_set_param(surf.material, "alpha_hash_scale", alpha_hash_scale);
-			RS::get_singleton()->material_set_param(surf.material, "alpha_antialiasing_edge", alpha_antialiasing_edge);
-			if (msdf) {
-				RS::get_singleton()->material_set_param(surf.material, "msdf_pixel_range", TS->font_get_msdf_pixel_range(p_glyph.font_rid));
-				RS::get_singleton()->material_set_param(surf.material, "msdf_outline_size", p_outline_size);
-			}
-
-			const BaseMaterial3D::Transparency mat_transparency = BaseMaterial3D::Transparency::TRANSPARENCY_ALPHA;
-
-			RID shader_rid;
-			StandardMaterial3D::get_material_for_2d(
-					false, mat_transparency, false, false, false, msdf, false, false, StandardMaterial3D::TEXTURE_FILTER_LINEAR, StandardMaterial3D::ALPHA_ANTIALIASING_OFF, &shader_rid);
-
-			RS::get_singleton()->material_set_shader(surf.material, shader_rid);
-			RS::get_singleton()->material_set_param(surf.material, "texture_albedo", tex);
-			RS::get_singleton()->material_set_param(surf.material, "albedo_texture_size", texs);
-			surf.z_shift = p_priority * pixel_size;
-
-			surfaces[key] = surf;
-		}
-		SurfaceData &s = surfaces[key];
-
-		s.mesh_vertices.resize(static_cast<size_t>((s.offset + 1) * 4));
-		s.mesh_normals.resize(static_cast<size_t>((s.offset + 1)) * 4);
-		s.mesh_tangents.resize(static_cast<size_t>((s.offset + 1)) * 16);
-		s.mesh_colors.resize(static_cast<size_t>((s.offset + 1)) * 4);
-		s.mesh_uvs.resize(static_cast<size_t>((s.offset + 1)) * 4);
-
-		s.mesh_vertices.write[(s.offset * 4) + 3] = Vector3(r_offset.x + gl_of.x, r_offset.y - gl_of.y - gl_sz.y, s.z_shift);
-		s.mesh_vertices.write[(s.offset * 4) + 2] = Vector3(r_offset.x + gl_of.x + gl_sz.x, r_offset.y - gl_of.y - gl_sz.y, s.z_shift);
-		s.mesh_vertices.write[(s.offset * 4) + 1] = Vector3(r_offset.x + gl_of.x + gl_sz.x, r_offset.y - gl_of.y, s.z_shift);
-		s.mesh_vertices.write[(s.offset * 4) + 0] = Vector3(r_offset.x + gl_of.x, r_offset.y - gl_of.y, s.z_shift);
-
-		for (int i = 0; i < 4; i++) {
-			s.mesh_normals.write[(s.offset * 4) + i] = Vector3(0.0, 0.0, 1.0);
-			s.mesh_tangents.write[(s.offset * 16) + (i * 4) + 0] = 1.0;
-			s.mesh_tangents.write[(s.offset * 16) + (i * 4) + 1] = 0.0;
-			s.mesh_tangents.write[(s.offset * 16) + (i * 4) + 2] = 0.0;
-			s.mesh_tangents.write[(s.offset * 16) + (i * 4) + 3] = 1.0;
-			s.mesh_colors.write[(s.offset * 4) + i] = p_modulate;
-			s.mesh_uvs.write[(s.offset * 4) + i] = Vector2();
-		}
+		LabelGlyphQuad quad;
+		quad.vertices[3] = Vector3(r_offset.x + gl_of.x, r_offset.y - gl_of.y - gl_sz.y, z_shift);
+		quad.vertices[2] = Vector3(r_offset.x + gl_of.x + gl_sz.x, r_offset.y - gl_of.y - gl_sz.y, z_shift);
+		quad.vertices[1] = Vector3(r_offset.x + gl_of.x + gl_sz.x, r_offset.y - gl_of.y, z_shift);
+		quad.vertices[0] = Vector3(r_offset.x + gl_of.x, r_offset.y - gl_of.y, z_shift);
+		quad.color = p_modulate;
 
 		if (tex.is_valid()) {
-			s.mesh_uvs.write[(s.offset * 4) + 3] = Vector2(gl_uv.position.x / texs.x, (gl_uv.position.y + gl_uv.size.y) / texs.y);
-			s.mesh_uvs.write[(s.offset * 4) + 2] = Vector2((gl_uv.position.x + gl_uv.size.x) / texs.x, (gl_uv.position.y + gl_uv.size.y) / texs.y);
-			s.mesh_uvs.write[(s.offset * 4) + 1] = Vector2((gl_uv.position.x + gl_uv.size.x) / texs.x, gl_uv.position.y / texs.y);
-			s.mesh_uvs.write[(s.offset * 4) + 0] = Vector2(gl_uv.position.x / texs.x, gl_uv.position.y / texs.y);
+			quad.uvs[3] = Vector2(gl_uv.position.x / texs.x, (gl_uv.position.y + gl_uv.size.y) / texs.y);
+			quad.uvs[2] = Vector2((gl_uv.position.x + gl_uv.size.x) / texs.x, (gl_uv.position.y + gl_uv.size.y) / texs.y);
+			quad.uvs[1] = Vector2((gl_uv.position.x + gl_uv.size.x) / texs.x, gl_uv.position.y / texs.y);
+			quad.uvs[0] = Vector2(gl_uv.position.x / texs.x, gl_uv.position.y / texs.y);
 		}
 
-		s.indices.resize(static_cast<size_t>((s.offset + 1)) * 6);
-		s.indices.write[(s.offset * 6) + 0] = (s.offset * 4) + 0;
-		s.indices.write[(s.offset * 6) + 1] = (s.offset * 4) + 1;
-		s.indices.write[(s.offset * 6) + 2] = (s.offset * 4) + 2;
-		s.indices.write[(s.offset * 6) + 3] = (s.offset * 4) + 0;
-		s.indices.write[(s.offset * 6) + 4] = (s.offset * 4) + 2;
-		s.indices.write[(s.offset * 6) + 5] = (s.offset * 4) + 3;
-
-		s.offset++;
+		s.quads.push_back(quad);
 		r_offset.x += p_glyph.advance * pixel_size;
 	}
 }
 
-void MapLabel::_shape() {
-	// When a shaped text is invalidated by an external source, we want to reshape it.
-	if (!TS->shaped_text_is_ready(text_rid))
-		dirty_text = true;
-
-	for (const RID &line_rid : lines_rid) {
-		if (!TS->shaped_text_is_ready(line_rid)) {
-			dirty_lines = true;
-			break;
-		}
-	}
-
-	// Clear mesh.
-	RS::get_singleton()->mesh_clear(mesh);
+void MapLabel::shape_text(const String &p_text, const LabelFont &p_font, LabelGlyphSurfaces &r_surfaces, AABB &r_aabb) {
+	r_surfaces.clear();
+	AABB &aabb = r_aabb;
 	aabb = AABB();
 
-	// Clear materials.
-	for (const KeyValue<SurfaceKey, SurfaceData> &E : surfaces)
-		RenderingServer::get_singleton()->free(E.value.material);
-	surfaces.clear();
-
-	const Ref<Font> font = _get_font_or_default();
-	ERR_FAIL_COND(font.is_null());
-
-	// Update text buffer.
-	if (dirty_text) {
-		TS->shaped_text_clear(text_rid);
-		TS->shaped_text_set_direction(text_rid, TextServer::DIRECTION_AUTO);
-
-		const String txt = (uppercase) ? TS->string_to_upper(xl_text, "") : xl_text;
-		TS->shaped_text_add_string(text_rid, txt, font->get_rids(), font_size, font->get_opentype_features(), "");
+	// Each call uses its own shaped text so labels can be shaped on any thread.
+	const RID text_rid = TS->create_shaped_text();
+	TS->shaped_text_set_direction(text_rid, TextServer::DIRECTION_AUTO);
 
-		TypedArray<Vector3i> stt;
-		stt = TS->parse_structured_text(TextServer::STRUCTURED_TEXT_DEFAULT, Array(), txt);
-		TS->shaped_text_set_bidi_override(text_rid, stt);
+	const String txt = (uppercase) ? TS->string_to_upper(p_text, "") : p_text;
+	TS->shaped_text_add_string(text_rid, txt, p_font.rids, font_size, p_font.opentype_features, "");
 
-		dirty_text = false;
-		dirty_font = false;
-		dirty_lines = true;
-	} else if (dirty_font) {
-		const int spans = TS->shaped_get_span_count(text_rid);
-		for (int i = 0; i < spans; i++)
-			TS->shaped_set_span_update_font(text_rid, i, font->get_rids(), font_size, font->get_opentype_features());
+	TypedArray<Vector3i> stt;
+	stt = TS->parse_structured_text(TextServer::STRUCTURED_TEXT_DEFAULT, Array(), txt);
+	TS->shaped_text_set_bidi_override(text_rid, stt);
 
-		dirty_font = false;
-		dirty_lines = true;
-	}
-
-	if (dirty_lines) {
-		for (const RID i : lines_rid)
-			TS->free_rid(i);
-		lines_rid.clear();
-
-		const BitField<TextServer::LineBreakFlag> autowrap_flags = TextServer::BREAK_MANDATORY | TextServer::BREAK_TRIM_START_EDGE_SPACES | TextServer::BREAK_TRIM_END_EDGE_SPACES;
+	Vec<RID> lines_rid;
+	const BitField<TextServer::LineBreakFlag> autowrap_flags = TextServer::BREAK_MANDATORY | TextServer::BREAK_TRIM_START_EDGE_SPACES | TextServer::BREAK_TRIM_END_EDGE_SPACES;
 
-		const PackedInt32Array line_breaks = TS->shaped_text_get_line_breaks(text_rid, width, 0, autowrap_flags);
-		float max_line_w = 0.0;
-		for (int i = 0; i < line_breaks.size(); i = i + 2) {
-			const RID line = TS->shaped_text_substr(text_rid, line_breaks[i], line_breaks[i + 1] - line_breaks[i]);
-			max_line_w = MAX(max_line_w, TS->shaped_text_get_width(line));
-			lines_rid.push_back(line);
-		}
-		dirty_lines = false;
-	}
+	const PackedInt32Array line_breaks = TS->shaped_text_get_line_breaks(text_rid, width, 0, autowrap_flags);
+	for (int i = 0; i < line_breaks.size(); i = i + 2)
+		lines_rid.push_back(TS->shaped_text_substr(text_rid, line_breaks[i], line_breaks[i + 1] - line_breaks[i]));
 
-	// Generate surfaces and materials.
+	// Generate glyph quads.
 	float total_h = 0.0;
 	for (const RID i : lines_rid)
 		total_h += (TS->shaped_text_get_size(i).y + line_spacing) * pixel_size;
@@ -237,93 +158,94 @@ void MapLabel::_shape() {
 		if (outline_modulate.a != 0.0 && outline_size > 0) {
 			// Outline surfaces.
 			for (int j = 0; j < gl_size; j++)
-				_generate_glyph_surfaces(glyphs[j], offset, outline_modulate, outline_render_priority, outline_size);
+				_generate_glyph_surfaces(glyphs[j], offset, outline_modulate, r_surfaces, outline_render_priority, outline_size);
 		}
 
 		// Main text surfaces.
 		for (int j = 0; j < gl_size; j++)
-			_generate_glyph_surfaces(glyphs[j], offset, modulate, render_priority);
+			_generate_glyph_surfaces(glyphs[j], offset, modulate, r_surfaces, render_priority);
 		offset.y -= (TS->shaped_text_get_descent(i) + line_spacing) * pixel_size;
 	}
 
-	// TODO - scale text based on if it is inside the province borders
-	// I tried to do this with the AABB but that doesn't really work
-	// AABB text_aabb = transform.xform(aabb);
-	// Vector3 text_pos = text_aabb.get_position();
-	// Vector3 text_size = text_aabb.get_size();
-
-	// text_pos.y = 0.0;
-	// text_aabb.set_position(text_pos);
-
-	// text_size.y = 0.0;
-	// text_aabb.set_size(text_size);
-
-	// RID scenario = NM::map->get_world_3d()->get_scenario();
-	// AABBRenderer *aabb_renderer = new AABBRenderer(province_aabb, scenario);
-	// AABBRenderer *aabb_renderer2 = new AABBRenderer(text_aabb, scenario);
+	for (const RID line : lines_rid)
+		TS->free_rid(line);
+	TS->free_rid(text_rid);
+}
 
-	// print_line("Label AABB: ", text_aabb, ". Province AABB: ", province_aabb);
-	// print_line("Province AABB enclodes label AABB: ", province_aabb.encloses(text_aabb));
+void MapLabel::apply_shaped_text(MapMode p_map_mode, uint32_t p_version, const LabelGlyphSurfaces &p_surfaces, const AABB &p_aabb) {
+	MapModeText &map_mode_text = map_mode_texts[size_t(p_map_mode)];
 
-	for (const KeyValue<SurfaceKey, SurfaceData> &E : surfaces) {
-		Array mesh_array;
-		mesh_array.resize(RS::ARRAY_MAX);
-		mesh_array[RS::ARRAY_VERTEX] = E.value.mesh_vertices;
-		mesh_array[RS::ARRAY_NORMAL] = E.value.mesh_normals;
-		mesh_array[RS::ARRAY_TANGENT] = E.value.mesh_tangents;
-		mesh_array[RS::ARRAY_COLOR] = E.value.mesh_colors;
-		mesh_array[RS::ARRAY_TEX_UV] = E.value.mesh_uvs;
-		mesh_array[RS::ARRAY_INDEX] = E.value.indices;
+	// The text changed again while this one was being shaped, a newer result is on the way.
+	if (p_version != map_mode_text.version)
+		return;
 
-		RS::SurfaceData sd;
-		RS::get_singleton()->mesh_create_surface_data_from_arrays(&sd, RS::PRIMITIVE_TRIANGLES, mesh_array);
+	map_mode_text.aabb = p_aabb;
+	if (map_mode_text.label_id == MapLabelBatch::INVALID_LABEL)
+		map_mode_text.label_id = MapLabelBatch::self->create_label(transform);
+	MapLabelBatch::self->set_label_glyphs(map_mode_text.label_id, p_surfaces);
 
-		sd.material = E.value.material;
+	_update_visibility();
+}
 
-		RS::get_singleton()->mesh_add_surface(mesh, sd);
+void MapLabel::_update_visibility() {
+	for (int i = 0; i < int(MapMode::MAP_MODE_MAX); ++i) {
+		const MapModeText &map_mode_text = map_mode_texts[i];
+		if (map_mode_text.label_id != MapLabelBatch::INVALID_LABEL)
+			MapLabelBatch::self->set_label_visible(map_mode_text.label_id, visible and MapMode(i) == map_mode and !map_mode_text.text.is_empty());
 	}
 }
 
-MapLabel::MapLabel() {
-	text_rid = TS->create_shaped_text();
-	mesh = RS::get_singleton()->mesh_create();
-	instance = RS::get_singleton()->instance_create2(mesh, NM::map->get_world_3d()->get_scenario());
+MapLabel::~MapLabel() {
+	if (MapLabelShaper::self != nullptr)
+		MapLabelShaper::self->cancel(this);
 
-	RS::get_singleton()->instance_geometry_set_flag(instance, RS::INSTANCE_FLAG_USE_BAKED_LIGHT, false);
-	RS::get_singleton()->instance_geometry_set_flag(instance, RS::INSTANCE_FLAG_USE_DYNAMIC_GI, false);
-	RS::get_singleton()->instance_geometry_set_cast_shadows_setting(instance, RS::ShadowCastingSetting::SHADOW_CASTING_SETTING_OFF);
+	for (const MapModeText &map_mode_text : map_mode_texts)
+		if (map_mode_text.label_id != MapLabelBatch::INVALID_LABEL)
+			MapLabelBatch::self->free_label(map_mode_text.label_id);
 }
 
-MapLabel::~MapLabel() {
-	for (const RID line : lines_rid)
-		TS->free_rid(line);
-	lines_rid.clear();
-	TS->free_rid(text_rid);
+void MapLabel::set_text(MapMode p_map_mode, const String &p_string) {
+	MapModeText &map_mode_text = map_mode_texts[size_t(p_map_mode)];
+	if (map_mode_text.text == p_string)
+		return;
+
+	map_mode_text.text = p_string;
+	map_mode_text.version++;
 
-	RS::get_singleton()->free(instance);
-	RenderingServer::get_singleton()->free(mesh);
-	for (const KeyValue<SurfaceKey, SurfaceData> &E : surfaces)
-		RenderingServer::get_singleton()->free(E.value.material);
-	surfaces.clear();
+	// The previous text stays visible until the new text has been shaped.
+	if (p_string.is_empty())
+		map_mode_text.aabb = AABB();
+	else
+		MapLabelShaper::self->queue(this, p_map_mode, map_mode_text.version, NM::map->atr(p_string));
+
+	_update_visibility();
 }
 
-void MapLabel::set_text(const String &p_string) {
-	if (text == p_string)
+void MapLabel::set_map_mode(MapMode p_map_mode) {
+	if (p_map_mode == map_mode)
 		return;
 
-	text = p_string;
-	xl_text = NM::map->atr(p_string);
-	dirty_text = true;
-	_shape();
+	map_mode = p_map_mode;
+	_update_visibility();
 }
 
-void MapLabel::set_visible(bool p_visible) { RS::get_singleton()->instance_set_visible(instance, p_visible); }
+void MapLabel::set_visible(bool p_visible) {
+	if (p_visible == visible)
+		return;
+
+	visible = p_visible;
+	_update_visibility();
+}
 
 void MapLabel::set_transform(const Transform3D &p_transform) {
 	transform = p_transform;
-	RS::get_singleton()->instance_set_transform(instance, p_transform);
+	for (const MapModeText &map_mode_text : map_mode_texts)
+		if (map_mode_text.label_id != MapLabelBatch::INVALID_LABEL)
+			MapLabelBatch::self->set_label_transform(map_mode_text.label_id, p_transform);
 }
 
-AABB MapLabel::get_aabb() const { return aabb; }
+const Transform3D &MapLabel::get_transform() const { return transform; }
+
+AABB MapLabel::get_aabb() const { return map_mode == MapMode::MAP_MODE_MAX ? AABB() : map_mode_texts[size_t(map_mode)].aabb; }
 
 void MapLabel::set_province_aabb(const AABB &p_aabb) { province_aabb = p_aabb; }
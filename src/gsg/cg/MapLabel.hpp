@@ -1,65 +1,44 @@
 #pragma once
 
-#include "core/templates/hash_map.h"
+#include <array>
+
+#include "core/variant/typed_array.h"
 #include "core/variant/variant.h"
 
+#include "cg/MapLabelBatch.hpp"
+#include "cg/MapMode.hpp"
+
 struct Glyph;
 class Font;
 
 namespace CG {
 
 // 3D map label. Same as Label3D except it's not a Node and is simpler. Most of this code is stolen from Label3D/GeometryInstance3D
+// The glyphs are drawn by the MapLabelBatch and the text is shaped by the MapLabelShaper, MapLabel only keeps track of what should be visible.
 class MapLabel {
-private:
-	RID instance;
-	RID mesh;
-
-	String text;
-	String xl_text;
-
-	struct SurfaceData {
-		PackedVector3Array mesh_vertices;
-		PackedVector3Array mesh_normals;
-		PackedFloat32Array mesh_tangents;
-		PackedColorArray mesh_colors;
-		PackedVector2Array mesh_uvs;
-		PackedInt32Array indices;
-		int offset = 0;
-		float z_shift = 0.0;
-		RID material;
-	};
-
-	struct SurfaceKey {
-		uint64_t texture_id;
-		int32_t priority;
-		int32_t outline_size;
-
-		bool operator==(const SurfaceKey &p_b) const { return (texture_id == p_b.texture_id) && (priority == p_b.priority) && (outline_size == p_b.outline_size); }
-
-		SurfaceKey(uint64_t p_texture_id, int p_priority, int p_outline_size) :
-				texture_id(p_texture_id),
-				priority(p_priority),
-				outline_size(p_outline_size) {}
+public:
+	// Font data read on the main thread so shape_text() doesn't have to touch the Font resource.
+	struct LabelFont {
+		TypedArray<RID> rids;
+		Dictionary opentype_features;
 	};
 
-	struct SurfaceKeyHasher {
-		_FORCE_INLINE_ static uint32_t hash(const SurfaceKey &p_a) { return hash_murmur3_buffer(&p_a, sizeof(SurfaceKey)); }
+private:
+	// Shaped text for a single map mode. Each map mode has its own label in the MapLabelBatch so switching map modes only toggles visibility and never reshapes text that has been seen before.
+	struct MapModeText {
+		String text;
+		AABB aabb; // AABB of the glyphs in the MapLabelBatch, not of the text that is being shaped.
+		MapLabelBatch::LabelID label_id = MapLabelBatch::INVALID_LABEL;
+		uint32_t version = 0; // Incremented on every text change so stale shaping results are dropped.
 	};
 
-	HashMap<SurfaceKey, SurfaceData, SurfaceKeyHasher> surfaces;
+	std::array<MapModeText, size_t(MapMode::MAP_MODE_MAX)> map_mode_texts;
+	MapMode map_mode = MapMode::MAP_MODE_MAX;
+	bool visible = true;
 
-	RID text_rid;
-	Vector<RID> lines_rid;
-
-	RID base_material;
-	AABB aabb;
 	AABB province_aabb;
 	Transform3D transform;
 
-	bool dirty_lines = true;
-	bool dirty_font = true;
-	bool dirty_text = true;
-
 	static constexpr int font_size = 32;
 	static constexpr int outline_size = 1;
 	inline static Color outline_modulate = Color(0, 0, 0, 0);
@@ -69,26 +48,39 @@ private:
 	static constexpr int outline_render_priority = 1;
 	static constexpr float line_spacing = 0.F;
 	static constexpr float pixel_size = 0.005;
-	static constexpr float alpha_scissor_threshold = 0.5;
-	static constexpr float alpha_hash_scale = 1.0;
-	static constexpr float alpha_antialiasing_edge = 0.0;
 	static constexpr bool uppercase = false;
 	static constexpr float width = 500.0;
 
-	static Ref<Font> _get_font_or_default();
-	void _generate_glyph_surfaces(const Glyph &p_glyph, Vector2 &r_offset, const Color &p_modulate, int p_priority = 0, int p_outline_size = 0);
-	void _shape();
+	static void _generate_glyph_surfaces(const Glyph &p_glyph, Vector2 &r_offset, const Color &p_modulate, LabelGlyphSurfaces &r_surfaces, int p_priority = 0, int p_outline_size = 0);
+	void _update_visibility();
 
 public:
-	void set_text(const String &p_string);
+	static constexpr float line_height = font_size * pixel_size; // Height of a line of text in label space.
+	static constexpr float average_glyph_width = line_height * 0.55;
+
+	// The font set with set_font or the Label3D theme font.
+	static Ref<Font> get_font_or_default();
+	static void set_font(const Ref<Font> &p_font);
+
+	// Shape p_text and generate its glyph quads. Only uses the TextServer so it is safe to call from worker threads.
+	static void shape_text(const String &p_text, const LabelFont &p_font, LabelGlyphSurfaces &r_surfaces, AABB &r_aabb);
+	// Called on the main thread by the MapLabelShaper when the text set with set_text has been shaped.
+	void apply_shaped_text(MapMode p_map_mode, uint32_t p_version, const LabelGlyphSurfaces &p_surfaces, const AABB &p_aabb);
+
+	// Set the text shown in a map mode, an empty string hides the label in that map mode.
+	// Non empty text is shaped asynchronously, the previous text stays visible until it is done.
+	void set_text(MapMode p_map_mode, const String &p_string);
+	// Show the cached text of a map mode.
+	void set_map_mode(MapMode p_map_mode);
 	void set_visible(bool p_visible);
 	void set_transform(const Transform3D &p_transform);
+	const Transform3D &get_transform() const;
+	// Label space AABB of the text in the current map mode.
 	AABB get_aabb() const;
 
 	// Set the province AABB before doing anything else.
 	void set_province_aabb(const AABB &p_aabb);
 
-	MapLabel();
 	~MapLabel();
 };
 
@@ -0,0 +1,465 @@
+#include "MapLabelBatch.hpp"
+
+#include "scene/resources/material.h"
+#include "servers/rendering_server.h"
+
+using namespace CG;
+
+MapLabelBatch::LabelID MapLabelBatch::create_label(const Transform3D &p_transform) {
+	LabelID id;
+	if (free_labels.is_empty()) {
+		id = labels.size();
+		labels.push_back(Label());
+	} else {
+		id = free_labels[free_labels.size() - 1];
+		free_labels.remove_at(free_labels.size() - 1);
+	}
+
+	Label &label = labels[id];
+	label.transform = p_transform;
+	label.ranges.clear();
+	label.chunk = _get_chunk(p_transform.origin);
+	label.visible = false;
+	label.alive = true;
+
+	chunks[label.chunk].labels.push_back(id);
+	return id;
+}
+
+void MapLabelBatch::free_label(LabelID p_label) {
+	ERR_FAIL_UNSIGNED_INDEX(p_label, labels.size());
+	Label &label = labels[p_label];
+	ERR_FAIL_COND(!label.alive);
+
+	Chunk &chunk = chunks[label.chunk];
+	for (const QuadRange &range : label.ranges)
+		_release_range(chunk, range);
+
+	chunk.labels.erase_unordered(p_label);
+	label.ranges.clear();
+	label.alive = false;
+	free_labels.push_back(p_label);
+	_mark_dirty(label.chunk);
+}
+
+void MapLabelBatch::set_label_glyphs(LabelID p_label, const LabelGlyphSurfaces &p_surfaces) {
+	ERR_FAIL_UNSIGNED_INDEX(p_label, labels.size());
+	Label &label = labels[p_label];
+	Chunk &chunk = chunks[label.chunk];
+
+	// Empty the ranges of atlas textures this label doesn't use anymore, the space is reused if the label uses them again.
+	for (QuadRange &range : label.ranges) {
+		if (p_surfaces.has(chunk.surfaces[range.surface].key))
+			continue;
+		range.count = 0;
+		_write_range(chunk, range, label.visible);
+	}
+
+	for (const KeyValue<LabelSurfaceKey, LabelGlyphSurface> &kv : p_surfaces) {
+		const uint32_t surface_index = _get_chunk_surface(chunk, kv.key, _get_material(kv.key, kv.value));
+		ChunkSurface &surface = chunk.surfaces[surface_index];
+		const uint32_t quad_count = kv.value.quads.size();
+
+		QuadRange *range = nullptr;
+		for (QuadRange &label_range : label.ranges) {
+			if (label_range.surface == surface_index) {
+				range = &label_range;
+				break;
+			}
+		}
+
+		// Doesn't fit in the old range, move the label to the end of the surface. The chunk is rebuilt because the surface size changed.
+		if (range == nullptr or range->capacity < quad_count) {
+			if (range != nullptr) {
+				_release_range(chunk, *range);
+			} else {
+				label.ranges.push_back(QuadRange{ .surface = surface_index });
+				range = &label.ranges[label.ranges.size() - 1];
+			}
+
+			range->first = surface.quads.size();
+			range->capacity = quad_count;
+			surface.quads.resize(surface.quads.size() + quad_count);
+			chunk.rebuild = true;
+		}
+
+		range->count = quad_count;
+		for (uint32_t i = 0; i < quad_count; ++i) {
+			LabelGlyphQuad quad = kv.value.quads[i];
+			for (Vector3 &vertex : quad.vertices)
+				vertex = label.transform.xform(vertex);
+			surface.quads[range->first + i] = quad;
+		}
+
+		_write_range(chunk, *range, label.visible);
+	}
+
+	_mark_dirty(label.chunk);
+}
+
+void MapLabelBatch::set_label_transform(LabelID p_label, const Transform3D &p_transform) {
+	ERR_FAIL_UNSIGNED_INDEX(p_label, labels.size());
+	Label &label = labels[p_label];
+	if (label.transform == p_transform)
+		return;
+
+	// Getting the chunk can add a chunk so it is done before holding on to any chunk.
+	const uint32_t new_chunk = _get_chunk(p_transform.origin);
+
+	// Quads are stored in map space so move them from the old transform to the new one.
+	const Transform3D delta = p_transform * label.transform.affine_inverse();
+	label.transform = p_transform;
+
+	Chunk &chunk = chunks[label.chunk];
+	for (const QuadRange &range : label.ranges) {
+		ChunkSurface &surface = chunk.surfaces[range.surface];
+		for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+			for (Vector3 &vertex : surface.quads[i].vertices) {
+				vertex = delta.xform(vertex);
+
+				// The surface AABB is only computed when rebuilding, a quad outside of it could be culled.
+				if (!surface.aabb.grow(CMP_EPSILON).has_point(vertex))
+					chunk.rebuild = true;
+			}
+		}
+
+		_write_range(chunk, range, label.visible);
+	}
+
+	if (new_chunk != label.chunk)
+		_move_label(p_label, new_chunk);
+	else
+		_mark_dirty(label.chunk);
+}
+
+void MapLabelBatch::set_label_visible(LabelID p_label, bool p_visible) {
+	ERR_FAIL_UNSIGNED_INDEX(p_label, labels.size());
+	Label &label = labels[p_label];
+	if (label.visible == p_visible)
+		return;
+
+	label.visible = p_visible;
+	Chunk &chunk = chunks[label.chunk];
+	for (const QuadRange &range : label.ranges)
+		_write_range(chunk, range, p_visible);
+
+	_mark_dirty(label.chunk);
+}
+
+bool MapLabelBatch::is_label_visible(LabelID p_label) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_label, labels.size(), false);
+	return labels[p_label].visible;
+}
+
+void MapLabelBatch::flush() {
+	RenderingServer &rs = *RS::get_singleton();
+
+	for (const uint32_t chunk_index : dirty_chunks) {
+		Chunk &chunk = chunks[chunk_index];
+		chunk.dirty = false;
+
+		if (chunk.rebuild) {
+			_rebuild_chunk(chunk);
+			continue;
+		}
+
+		for (ChunkSurface &surface : chunk.surfaces) {
+			if (surface.dirty_begin >= surface.dirty_end)
+				continue;
+
+			const int byte_begin = int(surface.dirty_begin * 4 * surface.vertex_stride);
+			const int byte_end = int(surface.dirty_end * 4 * surface.vertex_stride);
+			rs.mesh_surface_update_vertex_region(chunk.mesh, surface.surface_index, byte_begin, surface.vertex_data.slice(byte_begin, byte_end));
+
+			surface.dirty_begin = UINT32_MAX;
+			surface.dirty_end = 0;
+		}
+	}
+
+	dirty_chunks.clear();
+}
+
+int MapLabelBatch::get_draw_call_count() const {
+	int count = 0;
+	for (const Chunk &chunk : chunks)
+		for (const ChunkSurface &surface : chunk.surfaces)
+			if (surface.surface_index >= 0)
+				count++;
+	return count;
+}
+
+int MapLabelBatch::get_material_count() const { return int(materials.size()); }
+
+uint32_t MapLabelBatch::_get_chunk(const Vector3 &p_position) {
+	const Vector2i cell = Vector2i(int(Math::floor(p_position.x / chunk_size)), int(Math::floor(p_position.z / chunk_size)));
+	if (const uint32_t *chunk_index = chunk_map.getptr(cell))
+		return *chunk_index;
+
+	RenderingServer &rs = *RS::get_singleton();
+
+	Chunk chunk;
+	chunk.mesh = rs.mesh_create();
+	chunk.instance = rs.instance_create2(chunk.mesh, scenario);
+	rs.instance_geometry_set_flag(chunk.instance, RS::INSTANCE_FLAG_USE_BAKED_LIGHT, false);
+	rs.instance_geometry_set_flag(chunk.instance, RS::INSTANCE_FLAG_USE_DYNAMIC_GI, false);
+	rs.instance_geometry_set_cast_shadows_setting(chunk.instance, RS::ShadowCastingSetting::SHADOW_CASTING_SETTING_OFF);
+
+	const uint32_t chunk_index = chunks.size();
+	chunks.push_back(chunk);
+	chunk_map[cell] = chunk_index;
+	return chunk_index;
+}
+
+uint32_t MapLabelBatch::_get_chunk_surface(Chunk &p_chunk, const LabelSurfaceKey &p_key, const RID &p_material) {
+	for (uint32_t i = 0; i < p_chunk.surfaces.size(); ++i)
+		if (p_chunk.surfaces[i].key == p_key)
+			return i;
+
+	ChunkSurface surface;
+	surface.key = p_key;
+	surface.material = p_material;
+	p_chunk.surfaces.push_back(surface);
+	p_chunk.rebuild = true;
+	return p_chunk.surfaces.size() - 1;
+}
+
+RID MapLabelBatch::_get_material(const LabelSurfaceKey &p_key, const LabelGlyphSurface &p_surface) {
+	if (const RID *material = materials.getptr(p_key))
+		return *material;
+
+	RenderingServer &rs = *RS::get_singleton();
+	const RID material = rs.material_create();
+
+	// Set defaults for material, names need to match up those in StandardMaterial3D
+	rs.material_set_param(material, "albedo", Color(1, 1, 1, 1));
+	rs.material_set_param(material, "specular", 0.5);
+	rs.material_set_param(material, "metallic", 0.0);
+	rs.material_set_param(material, "roughness", 1.0);
+	rs.material_set_param(material, "uv1_offset", Vector3(0, 0, 0));
+	rs.material_set_param(material, "uv1_scale", Vector3(1, 1, 1));
+	rs.material_set_param(material, "uv2_offset", Vector3(0, 0, 0));
+	rs.material_set_param(material, "uv2_scale", Vector3(1, 1, 1));
+	rs.material_set_param(material, "alpha_scissor_threshold", alpha_scissor_threshold);
+	rs.material_set_param(material, "alpha_hash_scale", alpha_hash_scale);
+	rs.material_set_param(material, "alpha_antialiasing_edge", alpha_antialiasing_edge);
+	if (p_surface.msdf) {
+		rs.material_set_param(material, "msdf_pixel_range", p_surface.msdf_pixel_range);
+		rs.material_set_param(material, "msdf_outline_size", p_key.outline_size);
+	}
+
+	const BaseMaterial3D::Transparency mat_transparency = BaseMaterial3D::Transparency::TRANSPARENCY_ALPHA;
+
+	RID shader_rid;
+	StandardMaterial3D::get_material_for_2d(
+			false, mat_transparency, false, false, false, p_surface.msdf, false, false, StandardMaterial3D::TEXTURE_FILTER_LINEAR, StandardMaterial3D::ALPHA_ANTIALIASING_OFF, &shader_rid);
+
+	rs.material_set_shader(material, shader_rid);
+	rs.material_set_param(material, "texture_albedo", p_surface.texture);
+	rs.material_set_param(material, "albedo_texture_size", p_surface.texture_size);
+
+	materials[p_key] = material;
+	return material;
+}
+
+void MapLabelBatch::_mark_dirty(uint32_t p_chunk) {
+	Chunk &chunk = chunks[p_chunk];
+	if (chunk.dirty)
+		return;
+
+	chunk.dirty = true;
+	dirty_chunks.push_back(p_chunk);
+}
+
+void MapLabelBatch::_write_range(Chunk &p_chunk, const QuadRange &p_range, bool p_visible) {
+	// A rebuild writes every quad anyway.
+	if (p_chunk.rebuild)
+		return;
+
+	ChunkSurface &surface = p_chunk.surfaces[p_range.surface];
+	if (surface.surface_index < 0 or p_range.capacity == 0)
+		return;
+
+	uint8_t *write_ptr = surface.vertex_data.ptrw();
+	for (uint32_t i = p_range.first; i < p_range.first + p_range.capacity; ++i) {
+		// Hidden or unused quads are collapsed into a single point so they are never rasterized.
+		const LabelGlyphQuad &quad = surface.quads[i];
+		const bool draw = p_visible and i < p_range.first + p_range.count;
+
+		for (int v = 0; v < 4; ++v) {
+			const Vector3 &vertex = draw ? quad.vertices[v] : quad.vertices[0];
+			const float position[3] = { float(vertex.x), float(vertex.y), float(vertex.z) };
+			memcpy(write_ptr + ((size_t(i) * 4 + v) * surface.vertex_stride) + surface.position_offset, position, sizeof(position));
+		}
+	}
+
+	surface.dirty_begin = MIN(surface.dirty_begin, p_range.first);
+	surface.dirty_end = MAX(surface.dirty_end, p_range.first + p_range.capacity);
+}
+
+void MapLabelBatch::_release_range(Chunk &p_chunk, const QuadRange &p_range) {
+	QuadRange empty_range = p_range;
+	empty_range.count = 0;
+	_write_range(p_chunk, empty_range, false);
+	p_chunk.surfaces[p_range.surface].dead_quads += p_range.capacity;
+}
+
+void MapLabelBatch::_move_label(LabelID p_label, uint32_t p_chunk) {
+	Label &label = labels[p_label];
+	Chunk &old_chunk = chunks[label.chunk];
+	Chunk &new_chunk = chunks[p_chunk];
+
+	// The quads are appended to the surfaces of the new chunk and their old range is released, so both chunks are rebuilt on the next flush.
+	for (QuadRange &range : label.ranges) {
+		const ChunkSurface &old_surface = old_chunk.surfaces[range.surface];
+		const uint32_t surface_index = _get_chunk_surface(new_chunk, old_surface.key, old_surface.material);
+		ChunkSurface &new_surface = new_chunk.surfaces[surface_index];
+
+		const uint32_t first = new_surface.quads.size();
+		new_surface.quads.resize(first + range.capacity);
+		for (uint32_t i = 0; i < range.capacity; ++i)
+			new_surface.quads[first + i] = old_surface.quads[range.first + i];
+
+		_release_range(old_chunk, range);
+		range.surface = surface_index;
+		range.first = first;
+	}
+
+	old_chunk.labels.erase_unordered(p_label);
+	old_chunk.rebuild = true;
+	_mark_dirty(label.chunk);
+
+	new_chunk.labels.push_back(p_label);
+	new_chunk.rebuild = true;
+	label.chunk = p_chunk;
+	_mark_dirty(p_chunk);
+}
+
+void MapLabelBatch::_rebuild_chunk(Chunk &p_chunk) {
+	RenderingServer &rs = *RS::get_singleton();
+	rs.mesh_clear(p_chunk.mesh);
+	p_chunk.rebuild = false;
+
+	int surface_index = 0;
+	for (uint32_t s = 0; s < p_chunk.surfaces.size(); ++s) {
+		ChunkSurface &surface = p_chunk.surfaces[s];
+
+		// Compact the surface so ranges of freed or moved labels are dropped.
+		Vec<LabelGlyphQuad> quads;
+		Vec<bool> quad_visible;
+		quads.reserve(surface.quads.size() - surface.dead_quads);
+		quad_visible.reserve(surface.quads.size() - surface.dead_quads);
+
+		for (const LabelID id : p_chunk.labels) {
+			const Label &label = labels[id];
+			for (QuadRange &range : labels[id].ranges) {
+				if (range.surface != s)
+					continue;
+
+				const uint32_t first = quads.size();
+				for (uint32_t i = 0; i < range.capacity; ++i) {
+					quads.push_back(surface.quads[range.first + i]);
+					quad_visible.push_back(label.visible and i < range.count);
+				}
+				range.first = first;
+			}
+		}
+
+		surface.quads = std::move(quads);
+		surface.dead_quads = 0;
+		surface.surface_index = -1;
+		surface.vertex_data.clear();
+		surface.dirty_begin = UINT32_MAX;
+		surface.dirty_end = 0;
+
+		const uint32_t quad_count = surface.quads.size();
+		if (quad_count == 0)
+			continue;
+
+		PackedVector3Array mesh_vertices;
+		PackedVector3Array mesh_normals;
+		PackedFloat32Array mesh_tangents;
+		PackedColorArray mesh_colors;
+		PackedVector2Array mesh_uvs;
+		PackedInt32Array indices;
+
+		mesh_vertices.resize(quad_count * 4);
+		mesh_normals.resize(quad_count * 4);
+		mesh_tangents.resize(quad_count * 16);
+		mesh_colors.resize(quad_count * 4);
+		mesh_uvs.resize(quad_count * 4);
+		indices.resize(quad_count * 6);
+
+		AABB aabb;
+		for (uint32_t q = 0; q < quad_count; ++q) {
+			const LabelGlyphQuad &quad = surface.quads[q];
+			const Vector3 normal = (quad.vertices[3] - quad.vertices[0]).cross(quad.vertices[1] - quad.vertices[0]).normalized();
+			const Vector3 tangent = (quad.vertices[1] - quad.vertices[0]).normalized();
+
+			for (int i = 0; i < 4; i++) {
+				const uint32_t v = (q * 4) + i;
+				mesh_vertices.write[v] = quad_visible[q] ? quad.vertices[i] : quad.vertices[0];
+				mesh_normals.write[v] = normal;
+				mesh_tangents.write[(v * 4) + 0] = tangent.x;
+				mesh_tangents.write[(v * 4) + 1] = tangent.y;
+				mesh_tangents.write[(v * 4) + 2] = tangent.z;
+				mesh_tangents.write[(v * 4) + 3] = 1.0;
+				mesh_colors.write[v] = quad.color;
+				mesh_uvs.write[v] = quad.uvs[i];
+
+				if (q == 0 and i == 0)
+					aabb.position = quad.vertices[i];
+				else
+					aabb.expand_to(quad.vertices[i]);
+			}
+
+			indices.write[(q * 6) + 0] = int32_t(q * 4) + 0;
+			indices.write[(q * 6) + 1] = int32_t(q * 4) + 1;
+			indices.write[(q * 6) + 2] = int32_t(q * 4) + 2;
+			indices.write[(q * 6) + 3] = int32_t(q * 4) + 0;
+			indices.write[(q * 6) + 4] = int32_t(q * 4) + 2;
+			indices.write[(q * 6) + 5] = int32_t(q * 4) + 3;
+		}
+
+		Array mesh_array;
+		mesh_array.resize(RS::ARRAY_MAX);
+		mesh_array[RS::ARRAY_VERTEX] = mesh_vertices;
+		mesh_array[RS::ARRAY_NORMAL] = mesh_normals;
+		mesh_array[RS::ARRAY_TANGENT] = mesh_tangents;
+		mesh_array[RS::ARRAY_COLOR] = mesh_colors;
+		mesh_array[RS::ARRAY_TEX_UV] = mesh_uvs;
+		mesh_array[RS::ARRAY_INDEX] = indices;
+
+		RS::SurfaceData sd;
+		rs.mesh_create_surface_data_from_arrays(&sd, RS::PRIMITIVE_TRIANGLES, mesh_array);
+		sd.material = surface.material;
+		sd.aabb = aabb; // Use the AABB of every quad so hidden labels that are shown later are not culled.
+		surface.aabb = aabb;
+
+		surface.surface_index = surface_index++;
+		surface.vertex_data = sd.vertex_data;
+		surface.vertex_stride = rs.mesh_surface_get_format_vertex_stride(sd.format, int(sd.vertex_count));
+		surface.position_offset = rs.mesh_surface_get_format_offset(sd.format, int(sd.vertex_count), RS::ARRAY_VERTEX);
+
+		rs.mesh_add_surface(p_chunk.mesh, sd);
+	}
+}
+
+MapLabelBatch::MapLabelBatch(const RID &p_scenario) :
+		scenario(p_scenario) {
+	if (self == nullptr)
+		self = this;
+}
+
+MapLabelBatch::~MapLabelBatch() {
+	RenderingServer &rs = *RS::get_singleton();
+	for (const Chunk &chunk : chunks) {
+		rs.free(chunk.instance);
+		rs.free(chunk.mesh);
+	}
+
+	for (const KeyValue<LabelSurfaceKey, RID> &kv : materials)
+		rs.free(kv.value);
+
+	if (self == this)
+		self = nullptr;
+}
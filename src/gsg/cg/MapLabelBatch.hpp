@@ -0,0 +1,142 @@
+#pragma once
+
+#include "core/templates/a_hash_map.h"
+#include "core/templates/hash_map.h"
+#include "core/variant/variant.h"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+// Glyph quad of a label, vertices are in label space until they are added to a batch.
+struct LabelGlyphQuad {
+	Vector3 vertices[4];
+	Vector2 uvs[4];
+	Color color;
+};
+
+struct LabelSurfaceKey {
+	uint64_t texture_id = 0;
+	int32_t priority = 0;
+	int32_t outline_size = 0;
+
+	bool operator==(const LabelSurfaceKey &p_b) const { return (texture_id == p_b.texture_id) && (priority == p_b.priority) && (outline_size == p_b.outline_size); }
+
+	LabelSurfaceKey() = default;
+	LabelSurfaceKey(uint64_t p_texture_id, int p_priority, int p_outline_size) :
+			texture_id(p_texture_id),
+			priority(p_priority),
+			outline_size(p_outline_size) {}
+};
+
+struct LabelSurfaceKeyHasher {
+	_FORCE_INLINE_ static uint32_t hash(const LabelSurfaceKey &p_a) { return hash_murmur3_buffer(&p_a, sizeof(LabelSurfaceKey)); }
+};
+
+// All glyphs of a label that use the same font atlas texture.
+struct LabelGlyphSurface {
+	RID texture;
+	Size2 texture_size;
+	bool msdf = false;
+	float msdf_pixel_range = 0.0;
+	Vec<LabelGlyphQuad> quads;
+};
+
+using LabelGlyphSurfaces = HashMap<LabelSurfaceKey, LabelGlyphSurface, LabelSurfaceKeyHasher>;
+
+// Draws the glyphs of every MapLabel with a small number of meshes.
+// The map is split into chunks, each chunk is one mesh with a surface per font atlas texture and every chunk shares the same material for an atlas texture.
+// This means the number of draw calls and materials depends on the number of chunks and atlas textures instead of the number of labels.
+// Each label owns a range of quads in the surfaces of its chunk so it can be rewritten or hidden without touching any other label.
+// Changes are only sent to the RenderingServer when calling flush().
+class MapLabelBatch {
+public:
+	using LabelID = uint32_t;
+	static constexpr LabelID INVALID_LABEL = UINT32_MAX;
+
+	static inline MapLabelBatch *self = nullptr;
+
+	// Labels are hidden until set_label_visible is called.
+	LabelID create_label(const Transform3D &p_transform);
+	void free_label(LabelID p_label);
+	void set_label_glyphs(LabelID p_label, const LabelGlyphSurfaces &p_surfaces);
+	void set_label_transform(LabelID p_label, const Transform3D &p_transform);
+	void set_label_visible(LabelID p_label, bool p_visible);
+	bool is_label_visible(LabelID p_label) const;
+
+	// Upload all pending label changes.
+	void flush();
+
+	int get_draw_call_count() const;
+	int get_material_count() const;
+
+	explicit MapLabelBatch(const RID &p_scenario);
+	~MapLabelBatch();
+
+private:
+	static constexpr int chunk_size = 128; // Chunk size in map pixels.
+	static constexpr float alpha_scissor_threshold = 0.5;
+	static constexpr float alpha_hash_scale = 1.0;
+	static constexpr float alpha_antialiasing_edge = 0.0;
+
+	// Range of quads owned by a label in a chunk surface. The range keeps its capacity when a label is rewritten with fewer glyphs so it can be reused without rebuilding the chunk.
+	struct QuadRange {
+		uint32_t surface = 0;
+		uint32_t first = 0;
+		uint32_t count = 0;
+		uint32_t capacity = 0;
+	};
+
+	struct Label {
+		Transform3D transform;
+		Vec<QuadRange> ranges;
+		uint32_t chunk = 0;
+		bool visible = false;
+		bool alive = false;
+	};
+
+	struct ChunkSurface {
+		LabelSurfaceKey key;
+		RID material;
+		Vec<LabelGlyphQuad> quads; // Map space quads
+		uint32_t dead_quads = 0;
+		AABB aabb; // AABB of the RS surface, quads moved outside of it need a rebuild
+
+		// RS surface data, kept so label changes can be uploaded with mesh_surface_update_vertex_region.
+		int surface_index = -1;
+		Vector<uint8_t> vertex_data;
+		uint32_t vertex_stride = 0;
+		uint32_t position_offset = 0;
+		uint32_t dirty_begin = UINT32_MAX;
+		uint32_t dirty_end = 0;
+	};
+
+	struct Chunk {
+		RID mesh;
+		RID instance;
+		Vec<ChunkSurface> surfaces;
+		Vec<LabelID> labels;
+		bool rebuild = false;
+		bool dirty = false;
+	};
+
+	RID scenario;
+	Vec<Label> labels;
+	Vec<LabelID> free_labels;
+	Vec<Chunk> chunks;
+	Vec<uint32_t> dirty_chunks;
+	AHashMap<Vector2i, uint32_t> chunk_map;
+	HashMap<LabelSurfaceKey, RID, LabelSurfaceKeyHasher> materials;
+
+	uint32_t _get_chunk(const Vector3 &p_position);
+	uint32_t _get_chunk_surface(Chunk &p_chunk, const LabelSurfaceKey &p_key, const RID &p_material);
+	RID _get_material(const LabelSurfaceKey &p_key, const LabelGlyphSurface &p_surface);
+	void _mark_dirty(uint32_t p_chunk);
+	void _write_range(Chunk &p_chunk, const QuadRange &p_range, bool p_visible);
+	void _release_range(Chunk &p_chunk, const QuadRange &p_range);
+	// Move the quads of a label to the chunk its origin is in now.
+	void _move_label(LabelID p_label, uint32_t p_chunk);
+	void _rebuild_chunk(Chunk &p_chunk);
+};
+
+} // namespace CG
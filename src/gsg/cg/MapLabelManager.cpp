@@ -0,0 +1,124 @@
+#include "MapLabelManager.hpp"
+
+#include "MapLabel.hpp"
+#include "MapLabelBatch.hpp"
+
+using namespace CG;
+
+void MapLabelManager::add_label(MapLabel *p_label) {
+	LabelEntry entry;
+	entry.label = p_label;
+	entries.push_back(entry);
+	dirty = true;
+}
+
+void MapLabelManager::clear() {
+	entries.clear();
+	placed_rects.clear();
+	cells.clear();
+	lod_level = -1;
+	dirty = true;
+}
+
+void MapLabelManager::invalidate() { dirty = true; }
+
+void MapLabelManager::update(float p_camera_distance) {
+	const int new_lod_level = int(p_camera_distance / lod_distance_step);
+	camera_distance = p_camera_distance;
+	if (!dirty and new_lod_level == lod_level)
+		return;
+
+	if (dirty)
+		_update_entries();
+
+	lod_level = new_lod_level;
+	dirty = false;
+	_place_labels();
+}
+
+void MapLabelManager::refresh() { update(camera_distance); }
+
+void MapLabelManager::_update_entries() {
+	for (LabelEntry &entry : entries) {
+		const AABB aabb = entry.label->get_aabb();
+		if (aabb.size == Vector3()) {
+			entry.rect = Rect2();
+			entry.height = 0.0;
+			continue;
+		}
+
+		const Transform3D &transform = entry.label->get_transform();
+		const AABB map_aabb = transform.xform(aabb);
+		entry.rect = Rect2(map_aabb.position.x, map_aabb.position.z, map_aabb.size.x, map_aabb.size.z);
+		entry.height = aabb.size.y * transform.basis.get_scale_abs().y;
+	}
+
+	// Larger labels are placed first so they win over the small labels they overlap.
+	struct EntryComparator {
+		_FORCE_INLINE_ bool operator()(const LabelEntry &p_a, const LabelEntry &p_b) const { return p_a.height > p_b.height; }
+	};
+	entries.sort_custom<EntryComparator>();
+}
+
+bool MapLabelManager::_overlaps_placed(const Rect2 &p_rect) const {
+	const Vector2i from = Vector2i((p_rect.position / cell_size).floor());
+	const Vector2i to = Vector2i((p_rect.get_end() / cell_size).floor());
+
+	for (int y = from.y; y <= to.y; ++y) {
+		for (int x = from.x; x <= to.x; ++x) {
+			const Vec<uint32_t> *cell = cells.getptr(Vector2i(x, y));
+			if (cell == nullptr)
+				continue;
+
+			for (const uint32_t placed_index : *cell)
+				if (placed_rects[placed_index].intersects(p_rect))
+					return true;
+		}
+	}
+
+	return false;
+}
+
+void MapLabelManager::_place(const Rect2 &p_rect) {
+	const uint32_t placed_index = placed_rects.size();
+	placed_rects.push_back(p_rect);
+
+	const Vector2i from = Vector2i((p_rect.position / cell_size).floor());
+	const Vector2i to = Vector2i((p_rect.get_end() / cell_size).floor());
+
+	for (int y = from.y; y <= to.y; ++y) {
+		for (int x = from.x; x <= to.x; ++x) {
+			const Vector2i cell = Vector2i(x, y);
+			if (Vec<uint32_t> *cell_labels = cells.getptr(cell))
+				cell_labels->push_back(placed_index);
+			else
+				cells.insert(cell, Vec<uint32_t>({ placed_index }));
+		}
+	}
+}
+
+void MapLabelManager::_place_labels() {
+	// Keep the cell vectors so their memory is reused by the next update.
+	for (KeyValue<Vector2i, Vec<uint32_t>> &kv : cells)
+		kv.value.clear();
+	placed_rects.clear();
+
+	const float min_height = min_label_screen_size * camera_distance;
+	const float padding = label_screen_padding * camera_distance;
+
+	for (const LabelEntry &entry : entries) {
+		bool show = entry.height > 0.0 and entry.height >= min_height;
+		if (show) {
+			const Rect2 rect = entry.rect.grow(padding);
+			show = !_overlaps_placed(rect);
+			if (show)
+				_place(rect);
+		}
+
+		// MapLabel only sends labels that changed state to the batch.
+		entry.label->set_visible(show);
+	}
+
+	if (MapLabelBatch::self != nullptr)
+		MapLabelBatch::self->flush();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "core/math/rect2.h"
+#include "core/templates/a_hash_map.h"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+class MapLabel;
+
+// Decides which map labels are drawn at the current camera zoom.
+// Labels that are too small on screen are hidden and the remaining labels are placed from largest to smallest, a label that overlaps a placed label is hidden.
+// Overlap tests use a spatial hash over the map space rect of each label so only nearby labels are compared.
+// All visibility changes of an update are applied together and uploaded with a single MapLabelBatch::flush().
+class MapLabelManager {
+public:
+	void add_label(MapLabel *p_label);
+	void clear();
+
+	// Call when label text or transforms changed, the next update() will place every label again.
+	void invalidate();
+
+	// p_camera_distance is the distance of the MapCamera to the map. Labels are only placed again when the distance moved to another LOD level.
+	void update(float p_camera_distance);
+	// Same as update() with the last camera distance.
+	void refresh();
+
+private:
+	static constexpr int cell_size = 32; // Spatial hash cell size in map pixels.
+	static constexpr float lod_distance_step = 25.0; // Camera distance between two LOD levels.
+	static constexpr float min_label_screen_size = 0.02; // Minimum label height divided by the camera distance.
+	static constexpr float label_screen_padding = 0.005; // Padding around labels divided by the camera distance.
+
+	struct LabelEntry {
+		MapLabel *label = nullptr;
+		Rect2 rect; // Map space rect
+		float height = 0.0;
+	};
+
+	Vec<LabelEntry> entries; // Sorted from largest to smallest label
+	Vec<Rect2> placed_rects;
+	AHashMap<Vector2i, Vec<uint32_t>> cells; // Cell -> indices into placed_rects
+
+	float camera_distance = 0.0;
+	int lod_level = -1;
+	bool dirty = true;
+
+	void _update_entries();
+	bool _overlaps_placed(const Rect2 &p_rect) const;
+	void _place(const Rect2 &p_rect);
+	void _place_labels();
+};
+
+} // namespace CG
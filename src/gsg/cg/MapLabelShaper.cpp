@@ -0,0 +1,135 @@
+#include "MapLabelShaper.hpp"
+
+#include "scene/resources/font.h"
+
+#include "CountryLabels.hpp"
+
+using namespace CG;
+
+void MapLabelShaper::queue(MapLabel *p_label, MapMode p_map_mode, uint32_t p_version, const String &p_text) {
+	// Replace a queued job of the same label and map mode so renaming a label many times before a dispatch only shapes the last text.
+	for (ShapeJob &job : queued_jobs) {
+		if (job.label == p_label and job.map_mode == p_map_mode) {
+			job.version = p_version;
+			job.text = p_text;
+			return;
+		}
+	}
+
+	ShapeJob job;
+	job.label = p_label;
+	job.map_mode = p_map_mode;
+	job.version = p_version;
+	job.text = p_text;
+	queued_jobs.push_back(job);
+}
+
+void MapLabelShaper::queue(CountryLabels *p_country_labels, CountryEntity p_country, uint32_t p_version, const String &p_text) {
+	for (ShapeJob &job : queued_jobs) {
+		if (job.country_labels == p_country_labels and job.country == p_country) {
+			job.version = p_version;
+			job.text = p_text;
+			return;
+		}
+	}
+
+	ShapeJob job;
+	job.country_labels = p_country_labels;
+	job.country = p_country;
+	job.version = p_version;
+	job.text = p_text;
+	queued_jobs.push_back(job);
+}
+
+void MapLabelShaper::cancel(MapLabel *p_label) {
+	for (uint32_t i = 0; i < queued_jobs.size();) {
+		if (queued_jobs[i].label == p_label)
+			queued_jobs.remove_at_unordered(i);
+		else
+			++i;
+	}
+
+	// Running jobs can't be removed while workers write to them.
+	for (ShapeJob &job : running_jobs)
+		if (job.label == p_label)
+			job.label = nullptr;
+}
+
+void MapLabelShaper::cancel(CountryLabels *p_country_labels) {
+	for (uint32_t i = 0; i < queued_jobs.size();) {
+		if (queued_jobs[i].country_labels == p_country_labels)
+			queued_jobs.remove_at_unordered(i);
+		else
+			++i;
+	}
+
+	for (ShapeJob &job : running_jobs)
+		if (job.country_labels == p_country_labels)
+			job.country_labels = nullptr;
+}
+
+void MapLabelShaper::dispatch() {
+	if (group_id != -1 or queued_jobs.is_empty())
+		return;
+
+	// Font resources aren't thread safe so their TextServer data is read here.
+	if (font.rids.is_empty()) {
+		const Ref<Font> default_font = MapLabel::get_font_or_default();
+		ERR_FAIL_COND(default_font.is_null());
+		font.rids = default_font->get_rids();
+		font.opentype_features = default_font->get_opentype_features();
+	}
+
+	running_jobs = std::move(queued_jobs);
+	group_id = WorkerThreadPool::get_singleton()->add_template_group_task(this, &MapLabelShaper::_shape_job, running_jobs.ptr(), running_jobs.size(), -1, true, "Shape map labels");
+}
+
+int MapLabelShaper::apply_finished(bool p_wait) {
+	if (group_id == -1) {
+		dispatch();
+		return 0;
+	}
+
+	WorkerThreadPool &pool = *WorkerThreadPool::get_singleton();
+	if (!p_wait and !pool.is_group_task_completed(group_id))
+		return 0;
+
+	pool.wait_for_group_task_completion(group_id);
+	group_id = -1;
+
+	int changed = 0;
+	for (const ShapeJob &job : running_jobs) {
+		if (job.label != nullptr)
+			job.label->apply_shaped_text(job.map_mode, job.version, job.surfaces, job.aabb);
+		else if (job.country_labels != nullptr)
+			job.country_labels->apply_shaped_text(job.country, job.version, job.surfaces, job.aabb);
+		else
+			continue;
+
+		changed++;
+	}
+	running_jobs.clear();
+
+	dispatch();
+	return changed;
+}
+
+bool MapLabelShaper::is_idle() const { return group_id == -1 and queued_jobs.is_empty(); }
+
+void MapLabelShaper::_shape_job(uint32_t p_index, ShapeJob *p_jobs) {
+	ShapeJob &job = p_jobs[p_index];
+	MapLabel::shape_text(job.text, font, job.surfaces, job.aabb);
+}
+
+MapLabelShaper::MapLabelShaper() {
+	if (self == nullptr)
+		self = this;
+}
+
+MapLabelShaper::~MapLabelShaper() {
+	if (group_id != -1)
+		WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+
+	if (self == this)
+		self = nullptr;
+}
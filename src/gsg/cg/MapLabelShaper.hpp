@@ -0,0 +1,61 @@
+#pragma once
+
+#include "core/object/worker_thread_pool.h"
+
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
+
+#include "MapLabel.hpp"
+
+namespace CG {
+
+class CountryLabels;
+
+// Shapes MapLabel and CountryLabels text on the WorkerThreadPool.
+// Jobs are queued by MapLabel::set_text and started together with dispatch(). Workers only shape the text and generate glyph quads into the job's staging buffers,
+// finished jobs are handed to their labels on the main thread in apply_finished() which is the only place that touches the MapLabelBatch.
+class MapLabelShaper {
+public:
+	static inline MapLabelShaper *self = nullptr;
+
+	void queue(MapLabel *p_label, MapMode p_map_mode, uint32_t p_version, const String &p_text);
+	void queue(CountryLabels *p_country_labels, CountryEntity p_country, uint32_t p_version, const String &p_text);
+	// Drop every job of a label that is being deleted.
+	void cancel(MapLabel *p_label);
+	void cancel(CountryLabels *p_country_labels);
+
+	// Start shaping the queued jobs if no jobs are running.
+	void dispatch();
+	// Apply the jobs that finished shaping and start the next queued jobs. Returns the number of labels that changed.
+	// When p_wait is true this blocks until the running jobs are done.
+	int apply_finished(bool p_wait = false);
+
+	bool is_idle() const;
+
+	MapLabelShaper();
+	~MapLabelShaper();
+
+private:
+	struct ShapeJob {
+		MapLabel *label = nullptr; // Null when the label was deleted while shaping.
+		MapMode map_mode = MapMode::MAP_MODE_MAX;
+		CountryLabels *country_labels = nullptr; // Set instead of label for country names, null when cancelled.
+		CountryEntity country;
+		uint32_t version = 0;
+		String text;
+
+		// Staging buffers written by the worker.
+		LabelGlyphSurfaces surfaces;
+		AABB aabb;
+	};
+
+	MapLabel::LabelFont font;
+	Vec<ShapeJob> queued_jobs;
+	Vec<ShapeJob> running_jobs;
+	WorkerThreadPool::GroupID group_id = -1;
+
+	void _shape_job(uint32_t p_index, ShapeJob *p_jobs);
+};
+
+} // namespace CG
@@ -4,6 +4,6 @@
 
 namespace CG {
 
-enum class MapMode : uint8_t { Country, Area, Region };
+enum class MapMode : uint8_t { Country, Area, Region, MAP_MODE_MAX };
 
 }
@@ -0,0 +1,238 @@
+#include "MapUnits.hpp"
+
+#include "core/io/resource_loader.h"
+
+#include "scene/resources/shader.h"
+#include "scene/resources/texture.h"
+#include "servers/rendering_server.h"
+
+using namespace CG;
+
+MapUnits::UnitSlot MapUnits::add_unit(UnitEntity p_unit, const Transform3D &p_transform, const Color &p_owner_color) {
+	UnitSlot slot;
+	if (free_slots.is_empty()) {
+		slot = slot_count++;
+		_reserve(slot_count);
+		transforms.push_back(p_transform);
+		units.push_back(p_unit);
+		selected.push_back(false);
+		slot_cells.push_back(Vector2i());
+	} else {
+		slot = free_slots[free_slots.size() - 1];
+		free_slots.remove_at(free_slots.size() - 1);
+		transforms[slot] = p_transform;
+		units[slot] = p_unit;
+		selected[slot] = false;
+	}
+
+	_insert_cell(slot, _get_cell(p_transform));
+	_write_transform(slot, p_transform);
+	set_owner_color(slot, p_owner_color);
+	return slot;
+}
+
+void MapUnits::remove_unit(UnitSlot p_slot) {
+	ERR_FAIL_UNSIGNED_INDEX(p_slot, slot_count);
+
+	// A zero basis collapses the instance so the slot draws nothing until it is reused.
+	_write_transform(p_slot, Transform3D(Basis(Vector3(), Vector3(), Vector3()), Vector3()));
+	set_selected(p_slot, false);
+	_erase_cell(p_slot);
+	units[p_slot] = UnitEntity();
+	free_slots.push_back(p_slot);
+}
+
+void MapUnits::set_transform(UnitSlot p_slot, const Transform3D &p_transform) {
+	ERR_FAIL_UNSIGNED_INDEX(p_slot, slot_count);
+	transforms[p_slot] = p_transform;
+	_write_transform(p_slot, p_transform);
+
+	const Vector2i cell = _get_cell(p_transform);
+	if (cell != slot_cells[p_slot]) {
+		_erase_cell(p_slot);
+		_insert_cell(p_slot, cell);
+	}
+}
+
+const Transform3D &MapUnits::get_transform(UnitSlot p_slot) const { return transforms[p_slot]; }
+
+void MapUnits::set_owner_color(UnitSlot p_slot, const Color &p_owner_color) {
+	ERR_FAIL_UNSIGNED_INDEX(p_slot, slot_count);
+	float *write_ptr = buffer.ptrw() + (p_slot * instance_stride) + custom_data_offset;
+	write_ptr[0] = p_owner_color.r;
+	write_ptr[1] = p_owner_color.g;
+	write_ptr[2] = p_owner_color.b;
+	dirty = true;
+}
+
+void MapUnits::set_selected(UnitSlot p_slot, bool p_selected) {
+	ERR_FAIL_UNSIGNED_INDEX(p_slot, slot_count);
+	if (bool(selected[p_slot]) == p_selected)
+		return;
+
+	selected[p_slot] = p_selected;
+	buffer.ptrw()[(p_slot * instance_stride) + custom_data_offset + 3] = p_selected ? 1.0 : 0.0;
+	dirty = true;
+}
+
+bool MapUnits::is_selected(UnitSlot p_slot) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_slot, slot_count, false);
+	return selected[p_slot];
+}
+
+UnitEntity MapUnits::get_unit(UnitSlot p_slot) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_slot, slot_count, UnitEntity());
+	return units[p_slot];
+}
+
+AABB MapUnits::get_aabb(UnitSlot p_slot) const {
+	ERR_FAIL_UNSIGNED_INDEX_V(p_slot, slot_count, AABB());
+	return transforms[p_slot].xform(AABB(Vector3(-unit_size / 2.0, -unit_size / 2.0, 0.0), Vector3(unit_size, unit_size, 0.0)));
+}
+
+void MapUnits::get_units_in_rect(const Rect2 &p_map_rect, Vec<UnitSlot> &r_slots) const {
+	const Vector2i from = Vector2i((p_map_rect.position / cell_size).floor());
+	const Vector2i to = Vector2i((p_map_rect.get_end() / cell_size).floor());
+
+	for (int y = from.y; y <= to.y; ++y) {
+		for (int x = from.x; x <= to.x; ++x) {
+			const Vec<UnitSlot> *cell = cells.getptr(Vector2i(x, y));
+			if (cell == nullptr)
+				continue;
+
+			for (const UnitSlot slot : *cell) {
+				const Vector3 &origin = transforms[slot].origin;
+				if (p_map_rect.has_point(Vector2(origin.x, origin.z)))
+					r_slots.push_back(slot);
+			}
+		}
+	}
+}
+
+void MapUnits::get_units_at_point(const Vector3 &p_point, Vec<UnitSlot> &r_slots) const {
+	// Any unit whose AABB can contain the point has its origin within max_half_extent of it.
+	const Rect2 map_rect = Rect2(p_point.x - max_half_extent, p_point.z - max_half_extent, max_half_extent * 2.0, max_half_extent * 2.0);
+	const uint32_t first = r_slots.size();
+	get_units_in_rect(map_rect, r_slots);
+
+	for (uint32_t i = r_slots.size(); i > first; --i)
+		if (!get_aabb(r_slots[i - 1]).has_point(p_point))
+			r_slots.remove_at_unordered(i - 1);
+}
+
+void MapUnits::set_visible(bool p_visible) { RS::get_singleton()->instance_set_visible(instance, p_visible); }
+
+void MapUnits::flush() {
+	if (!dirty)
+		return;
+
+	RenderingServer &rs = *RS::get_singleton();
+	if (reallocate) {
+		rs.multimesh_allocate_data(multimesh, int(capacity), RS::MULTIMESH_TRANSFORM_3D, false, true);
+		reallocate = false;
+	}
+
+	rs.multimesh_set_buffer(multimesh, buffer);
+	rs.multimesh_set_visible_instances(multimesh, int(slot_count));
+	dirty = false;
+}
+
+void MapUnits::_reserve(uint32_t p_count) {
+	if (p_count <= capacity)
+		return;
+
+	// Grow by doubling, allocating the multimesh again clears it so the whole buffer is uploaded on the next flush.
+	capacity = MAX(min_capacity, next_power_of_2(p_count));
+	const uint32_t old_size = buffer.size();
+	buffer.resize(capacity * instance_stride);
+	memset(buffer.ptrw() + old_size, 0, (buffer.size() - old_size) * sizeof(float));
+	reallocate = true;
+	dirty = true;
+}
+
+void MapUnits::_write_transform(UnitSlot p_slot, const Transform3D &p_transform) {
+	// Same layout as RenderingServer::multimesh_instance_set_transform.
+	float *write_ptr = buffer.ptrw() + (p_slot * instance_stride);
+	write_ptr[0] = p_transform.basis.rows[0][0];
+	write_ptr[1] = p_transform.basis.rows[0][1];
+	write_ptr[2] = p_transform.basis.rows[0][2];
+	write_ptr[3] = p_transform.origin.x;
+	write_ptr[4] = p_transform.basis.rows[1][0];
+	write_ptr[5] = p_transform.basis.rows[1][1];
+	write_ptr[6] = p_transform.basis.rows[1][2];
+	write_ptr[7] = p_transform.origin.y;
+	write_ptr[8] = p_transform.basis.rows[2][0];
+	write_ptr[9] = p_transform.basis.rows[2][1];
+	write_ptr[10] = p_transform.basis.rows[2][2];
+	write_ptr[11] = p_transform.origin.z;
+	dirty = true;
+}
+
+Vector2i MapUnits::_get_cell(const Transform3D &p_transform) { return Vector2i((Vector2(p_transform.origin.x, p_transform.origin.z) / cell_size).floor()); }
+
+void MapUnits::_insert_cell(UnitSlot p_slot, const Vector2i &p_cell) {
+	slot_cells[p_slot] = p_cell;
+	if (Vec<UnitSlot> *cell = cells.getptr(p_cell))
+		cell->push_back(p_slot);
+	else
+		cells.insert(p_cell, Vec<UnitSlot>({ p_slot }));
+
+	const AABB aabb = get_aabb(p_slot);
+	const Vector3 &origin = transforms[p_slot].origin;
+	max_half_extent = MAX(max_half_extent, MAX(MAX(origin.x - aabb.position.x, aabb.get_end().x - origin.x), MAX(origin.z - aabb.position.z, aabb.get_end().z - origin.z)));
+}
+
+void MapUnits::_erase_cell(UnitSlot p_slot) {
+	if (Vec<UnitSlot> *cell = cells.getptr(slot_cells[p_slot]))
+		cell->erase_unordered(p_slot);
+}
+
+MapUnits::MapUnits(const RID &p_scenario) {
+	if (self == nullptr)
+		self = this;
+
+	RenderingServer &rs = *RS::get_singleton();
+
+	// Quad facing +Z, the same as a Sprite3D.
+	const float half_size = unit_size / 2.0;
+	PackedVector3Array vertices = { Vector3(-half_size, half_size, 0), Vector3(half_size, half_size, 0), Vector3(half_size, -half_size, 0), Vector3(-half_size, -half_size, 0) };
+	PackedVector3Array normals = { Vector3(0, 0, 1), Vector3(0, 0, 1), Vector3(0, 0, 1), Vector3(0, 0, 1) };
+	PackedVector2Array uvs = { Vector2(0, 0), Vector2(1, 0), Vector2(1, 1), Vector2(0, 1) };
+	PackedInt32Array indices = { 0, 1, 2, 0, 2, 3 };
+
+	Array mesh_array;
+	mesh_array.resize(RS::ARRAY_MAX);
+	mesh_array[RS::ARRAY_VERTEX] = vertices;
+	mesh_array[RS::ARRAY_NORMAL] = normals;
+	mesh_array[RS::ARRAY_TEX_UV] = uvs;
+	mesh_array[RS::ARRAY_INDEX] = indices;
+
+	mesh = rs.mesh_create();
+	rs.mesh_add_surface_from_arrays(mesh, RS::PRIMITIVE_TRIANGLES, mesh_array);
+
+	shader = ResourceLoader::load("res://gfx/shaders/unit.gdshader", "Shader");
+	texture = ResourceLoader::load("res://gfx/icon.svg");
+	material = rs.material_create();
+	rs.material_set_shader(material, shader->get_rid());
+	rs.material_set_param(material, "unit_texture", texture->get_rid());
+	rs.mesh_surface_set_material(mesh, 0, material);
+
+	multimesh = rs.multimesh_create();
+	rs.multimesh_set_mesh(multimesh, mesh);
+	_reserve(min_capacity);
+	flush();
+
+	instance = rs.instance_create2(multimesh, p_scenario);
+	rs.instance_geometry_set_cast_shadows_setting(instance, RS::ShadowCastingSetting::SHADOW_CASTING_SETTING_OFF);
+}
+
+MapUnits::~MapUnits() {
+	RenderingServer &rs = *RS::get_singleton();
+	rs.free(instance);
+	rs.free(multimesh);
+	rs.free(mesh);
+	rs.free(material);
+
+	if (self == this)
+		self = nullptr;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "core/math/rect2.h"
+#include "core/templates/a_hash_map.h"
+#include "core/templates/rid.h"
+#include "core/variant/variant.h"
+
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
+
+class Shader;
+class Texture2D;
+
+namespace CG {
+
+// Draws every unit on the map with a single RenderingServer multimesh instead of a node per unit.
+// Each unit owns a slot in the multimesh with its transform and custom data, custom data is the owner color in rgb and the selection flag in alpha.
+// Changes are written to a CPU copy of the instance buffer and only sent to the RenderingServer when calling flush().
+// Slots are kept in a uniform grid over their map space position so picking only looks at units near the queried area.
+class MapUnits {
+public:
+	using UnitSlot = uint32_t;
+	static constexpr UnitSlot INVALID_SLOT = UINT32_MAX;
+
+	static inline MapUnits *self = nullptr;
+
+	UnitSlot add_unit(UnitEntity p_unit, const Transform3D &p_transform, const Color &p_owner_color);
+	void remove_unit(UnitSlot p_slot);
+
+	void set_transform(UnitSlot p_slot, const Transform3D &p_transform);
+	const Transform3D &get_transform(UnitSlot p_slot) const;
+	void set_owner_color(UnitSlot p_slot, const Color &p_owner_color);
+	void set_selected(UnitSlot p_slot, bool p_selected);
+	bool is_selected(UnitSlot p_slot) const;
+	UnitEntity get_unit(UnitSlot p_slot) const;
+
+	// World space AABB of the unit icon.
+	AABB get_aabb(UnitSlot p_slot) const;
+
+	// Appends the slots with their origin inside p_map_rect.
+	void get_units_in_rect(const Rect2 &p_map_rect, Vec<UnitSlot> &r_slots) const;
+	// Appends the slots with their AABB containing p_point.
+	void get_units_at_point(const Vector3 &p_point, Vec<UnitSlot> &r_slots) const;
+
+	// Show or hide every unit at once.
+	void set_visible(bool p_visible);
+
+	// Upload the instance buffer if anything changed.
+	void flush();
+
+	// Only the first MapUnits is MapUnits::self, the other ones are used for things that are drawn like units.
+	explicit MapUnits(const RID &p_scenario);
+	~MapUnits();
+
+private:
+	static constexpr int instance_stride = 16; // 12 floats for the transform and 4 for the custom data.
+	static constexpr int custom_data_offset = 12;
+	static constexpr float unit_size = 1.28; // Same size as a Sprite3D with the 128px unit icon.
+	static constexpr uint32_t min_capacity = 64;
+	static constexpr int cell_size = 32; // Grid cell size in map pixels.
+
+	RID mesh;
+	RID material;
+	RID multimesh;
+	RID instance;
+	Ref<Shader> shader;
+	Ref<Texture2D> texture;
+
+	Vector<float> buffer;
+	Vec<Transform3D> transforms;
+	Vec<UnitEntity> units;
+	Vec<uint8_t> selected;
+	Vec<Vector2i> slot_cells;
+	AHashMap<Vector2i, Vec<UnitSlot>> cells; // Cell -> slots with their origin in the cell
+	float max_half_extent = 0.0; // Largest half size of a unit AABB on the map plane, used to grow point queries.
+	Vec<UnitSlot> free_slots;
+	uint32_t slot_count = 0;
+	uint32_t capacity = 0;
+	bool dirty = false;
+	bool reallocate = false;
+
+	void _reserve(uint32_t p_count);
+	void _write_transform(UnitSlot p_slot, const Transform3D &p_transform);
+	static Vector2i _get_cell(const Transform3D &p_transform);
+	void _insert_cell(UnitSlot p_slot, const Vector2i &p_cell);
+	void _erase_cell(UnitSlot p_slot);
+};
+
+} // namespace CG
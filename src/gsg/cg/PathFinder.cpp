@@ -0,0 +1,129 @@
+#include "PathFinder.hpp"
+
+#include <limits>
+#include <type_traits>
+
+#include "core/templates/sort_array.h"
+
+#include "ClusterGraph.hpp"
+#include "LandmarkOracle.hpp"
+
+using namespace CG;
+
+template bool PathFinder::find_path<ProvinceGraph>(const ProvinceGraph &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path, const PathCorridor &p_corridor);
+template bool PathFinder::find_path<ClusterGraph>(const ClusterGraph &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path, const PathCorridor &p_corridor);
+
+template <typename T> bool PathFinder::find_path(const T &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path, const PathCorridor &p_corridor) {
+	r_path.clear();
+	path_cost = 0.0;
+	expanded_count = 0;
+
+	const uint32_t node_count = p_graph.get_node_count();
+	ERR_FAIL_UNSIGNED_INDEX_V(p_from, node_count, false);
+	ERR_FAIL_UNSIGNED_INDEX_V(p_to, node_count, false);
+
+	if (p_from == p_to)
+		return true;
+
+	if (node_states.size() < node_count)
+		node_states.resize(node_count);
+
+	// Starting a new generation invalidates every node state without touching them.
+	if (++generation == 0) {
+		for (NodeState &state : node_states)
+			state.generation = 0;
+		generation = 1;
+	}
+
+	open_nodes.clear();
+
+	NodeState &start_state = _get_state(p_from);
+	start_state.cost = 0.0;
+	_push_open({ _get_heuristic(p_graph, p_from, p_to, p_domain), p_from });
+
+	while (!open_nodes.is_empty()) {
+		const OpenNode open_node = _pop_open();
+		NodeState &state = node_states[open_node.node];
+
+		// The open list can have an outdated entry for a node that was reached again with a lower cost.
+		if (state.closed)
+			continue;
+
+		state.closed = true;
+		expanded_count++;
+
+		if (open_node.node == p_to) {
+			path_cost = state.cost;
+			for (ProvinceGraph::Node node = p_to; node != p_from; node = node_states[node].parent)
+				r_path.push_back(node);
+			r_path.reverse();
+			return true;
+		}
+
+		const uint32_t edge_end = p_graph.get_edge_end(open_node.node);
+		for (uint32_t edge = p_graph.get_edge_begin(open_node.node); edge < edge_end; ++edge) {
+			const float edge_cost = p_graph.get_edge_cost(edge, p_domain);
+			if (edge_cost == std::numeric_limits<float>::infinity())
+				continue;
+
+			const ProvinceGraph::Node neighbor = p_graph.get_edge_target(edge);
+			if (p_graph.is_node_blocked(neighbor) or !p_corridor.allows(neighbor))
+				continue;
+
+			const float cost = state.cost + edge_cost;
+			NodeState &neighbor_state = _get_state(neighbor);
+			if (neighbor_state.closed or (neighbor_state.parent != ProvinceGraph::INVALID_NODE and cost >= neighbor_state.cost))
+				continue;
+
+			// The goal can't be reached from a neighbor the heuristic can't bound.
+			const float heuristic = _get_heuristic(p_graph, neighbor, p_to, p_domain);
+			if (heuristic == std::numeric_limits<float>::infinity())
+				continue;
+
+			neighbor_state.cost = cost;
+			neighbor_state.parent = open_node.node;
+			_push_open({ cost + heuristic, neighbor });
+		}
+	}
+
+	return false;
+}
+
+void PathFinder::set_landmark_oracle(const LandmarkOracle *p_landmark_oracle) { landmark_oracle = p_landmark_oracle; }
+
+float PathFinder::get_path_cost() const { return path_cost; }
+
+uint32_t PathFinder::get_expanded_count() const { return expanded_count; }
+
+template <typename T> float PathFinder::_get_heuristic(const T &p_graph, ProvinceGraph::Node p_node, ProvinceGraph::Node p_goal, MovementDomain p_domain) const {
+	if constexpr (std::is_same_v<T, ProvinceGraph>)
+		if (landmark_oracle != nullptr and landmark_oracle->is_built())
+			return landmark_oracle->get_lower_bound(p_node, p_goal, p_domain);
+
+	return p_graph.get_position(p_node).distance_to(p_graph.get_position(p_goal));
+}
+
+PathFinder::NodeState &PathFinder::_get_state(ProvinceGraph::Node p_node) {
+	NodeState &state = node_states[p_node];
+	if (state.generation != generation) {
+		state.cost = 0.0;
+		state.parent = ProvinceGraph::INVALID_NODE;
+		state.generation = generation;
+		state.closed = false;
+	}
+	return state;
+}
+
+void PathFinder::_push_open(const OpenNode &p_open_node) {
+	open_nodes.push_back(p_open_node);
+	SortArray<OpenNode, OpenNodeComparator> sorter;
+	sorter.push_heap(0, open_nodes.size() - 1, 0, p_open_node, open_nodes.ptr());
+}
+
+PathFinder::OpenNode PathFinder::_pop_open() {
+	SortArray<OpenNode, OpenNodeComparator> sorter;
+	sorter.pop_heap(0, open_nodes.size(), open_nodes.ptr());
+	const OpenNode open_node = open_nodes[open_nodes.size() - 1];
+	open_nodes.remove_at(open_nodes.size() - 1);
+	return open_node;
+}
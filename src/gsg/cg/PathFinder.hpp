@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ProvinceGraph.hpp"
+
+namespace CG {
+
+class LandmarkOracle;
+
+// Limits a search to the nodes whose cluster is allowed, nodes without a cluster are always allowed.
+struct PathCorridor {
+	const Vec<ProvinceGraph::Node> *node_clusters = nullptr;
+	const Vec<uint8_t> *allowed_clusters = nullptr;
+
+	bool allows(ProvinceGraph::Node p_node) const {
+		if (node_clusters == nullptr)
+			return true;
+
+		const ProvinceGraph::Node cluster = (*node_clusters)[p_node];
+		return cluster == ProvinceGraph::INVALID_NODE or (*allowed_clusters)[cluster];
+	}
+};
+
+// A* search over the ProvinceGraph or a ClusterGraph using the straight line distance between unit locators as the heuristic.
+// Edge costs are never smaller than that distance so the heuristic is admissible for every MovementDomain.
+// The search state is kept between queries and reset lazily with a generation counter, so once the arrays have grown to the size of the graph a query doesn't allocate.
+// With a LandmarkOracle the ProvinceGraph heuristic uses its landmark bounds instead, which are never smaller than the straight line distance and expand fewer nodes.
+// A PathFinder can only run one search at a time, use one per thread.
+class PathFinder {
+public:
+	// Replaces r_path with the nodes after p_from up to and including p_to. Returns false if p_to can't be reached.
+	template <typename T> bool find_path(const T &p_graph, ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain, Vec<ProvinceGraph::Node> &r_path, const PathCorridor &p_corridor = PathCorridor());
+
+	// Oracle used for the heuristic of ProvinceGraph searches, can be null.
+	void set_landmark_oracle(const LandmarkOracle *p_landmark_oracle);
+
+	// Cost of the last path that was found.
+	float get_path_cost() const;
+	// Number of nodes expanded by the last search.
+	uint32_t get_expanded_count() const;
+
+private:
+	struct NodeState {
+		float cost = 0.0; // Cost from the start node
+		ProvinceGraph::Node parent = ProvinceGraph::INVALID_NODE;
+		uint32_t generation = 0; // The state is only valid when this is the current generation
+		bool closed = false;
+	};
+
+	struct OpenNode {
+		float estimate = 0.0; // Cost from the start plus the heuristic
+		ProvinceGraph::Node node = ProvinceGraph::INVALID_NODE;
+	};
+
+	// SortArray heaps keep the largest element on top, comparing with > makes the open list a min heap.
+	struct OpenNodeComparator {
+		bool operator()(const OpenNode &p_a, const OpenNode &p_b) const { return p_a.estimate > p_b.estimate; }
+	};
+
+	Vec<NodeState> node_states;
+	Vec<OpenNode> open_nodes;
+	uint32_t generation = 0;
+	const LandmarkOracle *landmark_oracle = nullptr;
+	float path_cost = 0.0;
+	uint32_t expanded_count = 0;
+
+	template <typename T> float _get_heuristic(const T &p_graph, ProvinceGraph::Node p_node, ProvinceGraph::Node p_goal, MovementDomain p_domain) const;
+	NodeState &_get_state(ProvinceGraph::Node p_node);
+	void _push_open(const OpenNode &p_open_node);
+	OpenNode _pop_open();
+};
+
+} // namespace CG
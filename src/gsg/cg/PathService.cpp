@@ -0,0 +1,115 @@
+#include "PathService.hpp"
+
+using namespace CG;
+
+void PathService::init(const ProvinceGraph *p_graph, HierarchicalPathFinder *p_path_finder) {
+	wait();
+	graph = p_graph;
+	path_finder = p_path_finder;
+	cache.clear();
+}
+
+PathService::RequestID PathService::request_path(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain) {
+	if (queued_batch.request_jobs.is_empty())
+		queued_batch.first_request = next_request;
+
+	const uint64_t key = _get_job_key(p_from, p_to, p_domain);
+	const uint32_t *existing_job = queued_job_lookup.getptr(key);
+	if (existing_job != nullptr) {
+		queued_batch.request_jobs.push_back(*existing_job);
+		return next_request++;
+	}
+
+	PathJob job;
+	job.from = p_from;
+	job.to = p_to;
+	job.domain = p_domain;
+
+	if (const CachedPath *cached_path = cache.getptr(key); cached_path != nullptr and cached_path->graph_version == graph->get_version()) {
+		job.result = cached_path->result;
+		job.cached = true;
+		cache_hit_count++;
+	}
+
+	queued_job_lookup.insert(key, queued_batch.jobs.size());
+	queued_batch.request_jobs.push_back(queued_batch.jobs.size());
+	queued_batch.jobs.push_back(job);
+	return next_request++;
+}
+
+void PathService::tick() {
+	_publish_batch();
+	_start_batch();
+}
+
+void PathService::flush() {
+	if (running_batch.jobs.is_empty())
+		_start_batch();
+}
+
+const PathService::PathResult *PathService::get_result(RequestID p_request) const {
+	if (p_request < published_batch.first_request or p_request - published_batch.first_request >= published_batch.request_jobs.size())
+		return nullptr;
+
+	return &published_batch.jobs[published_batch.request_jobs[p_request - published_batch.first_request]].result;
+}
+
+void PathService::wait() { _wait_batch(); }
+
+uint32_t PathService::get_cache_hit_count() const { return cache_hit_count; }
+
+uint64_t PathService::_get_job_key(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain) { return (uint64_t(p_from) << 33) | (uint64_t(p_to) << 1) | uint64_t(p_domain); }
+
+void PathService::_start_batch() {
+	if (queued_batch.jobs.is_empty() or graph == nullptr)
+		return;
+
+	running_batch = std::move(queued_batch);
+	queued_batch = PathBatch();
+	queued_job_lookup.clear();
+	running_graph_version = graph->get_version();
+
+	// Every worker gets a strided share of the jobs and its own scratch.
+	WorkerThreadPool &pool = *WorkerThreadPool::get_singleton();
+	worker_count = MIN(uint32_t(MAX(pool.get_thread_count(), 1)), running_batch.jobs.size());
+	if (scratches.size() < worker_count)
+		scratches.resize(worker_count);
+
+	group_id = pool.add_template_group_task(this, &PathService::_solve_jobs, scratches.ptr(), int(worker_count), -1, true, "Solve path requests");
+}
+
+void PathService::_wait_batch() {
+	if (group_id == -1)
+		return;
+
+	WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+	group_id = -1;
+}
+
+void PathService::_publish_batch() {
+	_wait_batch();
+	if (running_batch.jobs.is_empty())
+		return;
+
+	if (cache.size() + running_batch.jobs.size() > max_cached_paths)
+		cache.clear();
+
+	for (const PathJob &job : running_batch.jobs)
+		if (!job.cached)
+			cache.insert(_get_job_key(job.from, job.to, job.domain), { job.result, running_graph_version });
+
+	published_batch = std::move(running_batch);
+	running_batch = PathBatch();
+}
+
+void PathService::_solve_jobs(uint32_t p_worker, HierarchicalPathFinder::SearchScratch *p_scratches) {
+	HierarchicalPathFinder::SearchScratch &scratch = p_scratches[p_worker];
+
+	for (uint32_t i = p_worker; i < running_batch.jobs.size(); i += worker_count) {
+		PathJob &job = running_batch.jobs[i];
+		if (!job.cached)
+			job.result.found = path_finder->find_path(*graph, job.from, job.to, job.domain, job.result.path, scratch);
+	}
+}
+
+PathService::~PathService() { wait(); }
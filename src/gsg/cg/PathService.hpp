@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core/object/worker_thread_pool.h"
+
+#include "HierarchicalPathFinder.hpp"
+
+namespace CG {
+
+// Solves batches of path requests on the WorkerThreadPool.
+// Requests are deduplicated by their endpoints and domain and started together by flush() at the end of the frame they were made in, the next simulation tick publishes their results.
+// Requests made while a batch is still unpublished are started by the tick that publishes it, so under load their results arrive one tick later.
+// Each worker solves a strided share of the batch with its own search scratch so workers never share search state.
+// Solved paths are cached together with the ProvinceGraph version they were solved on, a cached path is only used while the graph hasn't changed.
+class PathService {
+public:
+	using RequestID = uint32_t;
+
+	struct PathResult {
+		Vec<ProvinceGraph::Node> path; // Nodes after the start up to and including the goal
+		bool found = false;
+	};
+
+	void init(const ProvinceGraph *p_graph, HierarchicalPathFinder *p_path_finder);
+
+	RequestID request_path(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain);
+	// Publish the results of the running batch and start solving the queued requests, called before every simulation tick.
+	void tick();
+	// Start solving the queued requests if no batch is waiting to be published, called every frame after input so the requests are solved while the frame renders.
+	void flush();
+	// Result of a request from the published batch, null when the request isn't done yet.
+	const PathResult *get_result(RequestID p_request) const;
+	// Finish solving the running batch early, call before changing the graph. Its results are still published by the next tick().
+	void wait();
+
+	uint32_t get_cache_hit_count() const;
+
+	~PathService();
+
+private:
+	static constexpr uint32_t max_cached_paths = 4096;
+
+	struct PathJob {
+		ProvinceGraph::Node from = ProvinceGraph::INVALID_NODE;
+		ProvinceGraph::Node to = ProvinceGraph::INVALID_NODE;
+		MovementDomain domain = MovementDomain::Land;
+		bool cached = false; // Result was copied from the cache and doesn't need solving
+		PathResult result;
+	};
+
+	struct PathBatch {
+		Vec<PathJob> jobs;
+		Vec<uint32_t> request_jobs; // Request - first_request -> job
+		RequestID first_request = 0;
+	};
+
+	struct CachedPath {
+		PathResult result;
+		uint32_t graph_version = 0;
+	};
+
+	const ProvinceGraph *graph = nullptr;
+	HierarchicalPathFinder *path_finder = nullptr;
+
+	PathBatch queued_batch;
+	AHashMap<uint64_t, uint32_t> queued_job_lookup; // (from, to, domain) -> job
+	PathBatch running_batch;
+	PathBatch published_batch;
+	RequestID next_request = 0;
+
+	Vec<HierarchicalPathFinder::SearchScratch> scratches; // One per worker task
+	uint32_t worker_count = 0;
+	uint32_t running_graph_version = 0;
+	WorkerThreadPool::GroupID group_id = -1;
+
+	AHashMap<uint64_t, CachedPath> cache;
+	uint32_t cache_hit_count = 0;
+
+	static uint64_t _get_job_key(ProvinceGraph::Node p_from, ProvinceGraph::Node p_to, MovementDomain p_domain);
+	void _start_batch();
+	void _wait_batch();
+	void _publish_batch();
+	void _solve_jobs(uint32_t p_worker, HierarchicalPathFinder::SearchScratch *p_scratches);
+};
+
+} // namespace CG
@@ -0,0 +1,149 @@
+#include "ProvinceGraph.hpp"
+
+#include <limits>
+
+#include "core/os/os.h"
+
+#include "ecs/Provinces.hpp"
+
+#include "ProvinceTable.hpp"
+
+using namespace CG;
+
+namespace {
+
+struct GraphEdge {
+	ProvinceGraph::Node from = ProvinceGraph::INVALID_NODE;
+	ProvinceGraph::Node to = ProvinceGraph::INVALID_NODE;
+	ProvinceAdjacencyType type = ProvinceAdjacencyType::Land;
+	uint32_t border_length = 0;
+};
+
+} // namespace
+
+void ProvinceGraph::build(const ProvinceTable &p_table, const Vec<ProvinceAdjacency> &p_adjacencies) {
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	clear();
+	table = &p_table;
+
+	// Nodes are in province id order, types and positions come from the table columns.
+	province_nodes.resize(p_table.size());
+	for (uint32_t i = 0; i < p_table.size(); ++i) {
+		province_nodes[i] = INVALID_NODE;
+		const ProvinceEntity province = p_table.get_entity(ProvinceIndex(i));
+		if (!province.is_valid())
+			continue;
+
+		province_nodes[i] = provinces.size();
+		provinces.push_back(province);
+		province_ids.push_back(ProvinceIndex(i));
+		positions.push_back(p_table.get_position(ProvinceIndex(i)));
+		blocked_nodes.push_back(false);
+	}
+
+	const uint32_t node_count = provinces.size();
+
+	// Every adjacency is an undirected edge.
+	Vec<GraphEdge> edges;
+	edges.reserve(p_adjacencies.size() * 2);
+	for (const ProvinceAdjacency &adjacency : p_adjacencies) {
+		const Node first = get_node(adjacency.first);
+		const Node second = get_node(adjacency.second);
+		if (first == INVALID_NODE or second == INVALID_NODE or first == second)
+			continue;
+
+		edges.push_back({ first, second, adjacency.type, adjacency.border_length });
+		edges.push_back({ second, first, adjacency.type, adjacency.border_length });
+	}
+
+	// Count the edges of each node and turn the counts into offsets.
+	edge_offsets.resize(node_count + 1);
+	for (uint32_t i = 0; i <= node_count; ++i)
+		edge_offsets[i] = 0;
+	for (const GraphEdge &edge : edges)
+		edge_offsets[edge.from + 1]++;
+	for (uint32_t i = 0; i < node_count; ++i)
+		edge_offsets[i + 1] += edge_offsets[i];
+
+	edge_targets.resize(edges.size());
+	edge_types.resize(edges.size());
+	edge_border_lengths.resize(edges.size());
+	for (Vec<float> &domain_costs : edge_costs)
+		domain_costs.resize(edges.size());
+
+	Vec<uint32_t> next_edge;
+	next_edge.resize(node_count);
+	for (uint32_t i = 0; i < node_count; ++i)
+		next_edge[i] = edge_offsets[i];
+
+	constexpr float impassable_cost = std::numeric_limits<float>::infinity();
+	for (const GraphEdge &edge : edges) {
+		const uint32_t edge_index = next_edge[edge.from]++;
+		const float distance = positions[edge.from].distance_to(positions[edge.to]);
+		const bool land_edge = p_table.is_passable_land(province_ids[edge.from]) and p_table.is_passable_land(province_ids[edge.to]);
+
+		edge_targets[edge_index] = edge.to;
+		edge_types[edge_index] = edge.type;
+		edge_border_lengths[edge_index] = edge.border_length;
+
+		float land_cost = impassable_cost;
+		float naval_cost = impassable_cost;
+		switch (edge.type) {
+			case ProvinceAdjacencyType::Land: {
+				if (land_edge)
+					land_cost = distance;
+			} break;
+			case ProvinceAdjacencyType::Crossing: {
+				if (land_edge)
+					land_cost = distance * crossing_cost_multiplier;
+			} break;
+			case ProvinceAdjacencyType::Water: {
+				naval_cost = distance;
+			} break;
+			case ProvinceAdjacencyType::Coastal:
+			case ProvinceAdjacencyType::Impassable: break;
+		}
+
+		edge_costs[int(MovementDomain::Land)][edge_index] = land_cost;
+		edge_costs[int(MovementDomain::Naval)][edge_index] = naval_cost;
+	}
+
+	version++;
+	print_line("Built province graph with ", node_count, " nodes and ", edges.size(), " edges in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+}
+
+void ProvinceGraph::clear() {
+	provinces.clear();
+	province_ids.clear();
+	province_nodes.clear();
+	positions.clear();
+	edge_offsets.clear();
+	edge_targets.clear();
+	edge_types.clear();
+	edge_border_lengths.clear();
+	for (Vec<float> &domain_costs : edge_costs)
+		domain_costs.clear();
+	blocked_nodes.clear();
+	version++;
+}
+
+void ProvinceGraph::set_node_blocked(Node p_node, bool p_blocked) {
+	ERR_FAIL_UNSIGNED_INDEX(p_node, provinces.size());
+	if (bool(blocked_nodes[p_node]) == p_blocked)
+		return;
+
+	blocked_nodes[p_node] = p_blocked;
+	version++;
+}
+
+uint32_t ProvinceGraph::get_node_count() const { return provinces.size(); }
+
+ProvinceGraph::Node ProvinceGraph::get_node(ProvinceEntity p_province) const { return table != nullptr ? get_province_node(table->get_index(p_province)) : INVALID_NODE; }
+
+ProvinceGraph::Node ProvinceGraph::get_province_node(ProvinceIndex p_province) const { return p_province > 0 and uint32_t(p_province) < province_nodes.size() ? province_nodes[p_province] : INVALID_NODE; }
+
+ProvinceEntity ProvinceGraph::get_province(Node p_node) const { return provinces[p_node]; }
+
+const Vector2 &ProvinceGraph::get_position(Node p_node) const { return positions[p_node]; }
+
+uint32_t ProvinceGraph::get_version() const { return version; }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ecs/entity.hpp"
+#include "ecs/Provinces.hpp"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+class ProvinceTable;
+
+enum class MovementDomain : uint8_t {
+	Land, // Land and crossing adjacencies between passable land provinces
+	Naval, // Water adjacencies between navigable water provinces
+	MOVEMENT_DOMAIN_MAX
+};
+
+// Province adjacency stored in compressed sparse row form for pathfinding.
+// Each province is a node, the edges of a node are the contiguous range [get_edge_begin(node), get_edge_end(node)) of the edge arrays.
+// Every edge has a cost for each MovementDomain, the cost is the distance between the unit locators of the two provinces times a multiplier for the adjacency type and infinity when the domain can't use the edge.
+// Built once from the baked adjacency table and the ProvinceTable after the map is loaded so neither building nor searching has to touch flecs.
+class ProvinceGraph {
+public:
+	using Node = uint32_t;
+	static constexpr Node INVALID_NODE = UINT32_MAX;
+	static constexpr float crossing_cost_multiplier = 1.5;
+
+	void build(const ProvinceTable &p_table, const Vec<ProvinceAdjacency> &p_adjacencies);
+	void clear();
+
+	uint32_t get_node_count() const;
+	Node get_node(ProvinceEntity p_province) const;
+	Node get_province_node(ProvinceIndex p_province) const;
+	ProvinceEntity get_province(Node p_node) const;
+	ProvinceIndex get_province_id(Node p_node) const { return province_ids[p_node]; }
+	const Vector2 &get_position(Node p_node) const;
+
+	uint32_t get_edge_begin(Node p_node) const { return edge_offsets[p_node]; }
+	uint32_t get_edge_end(Node p_node) const { return edge_offsets[p_node + 1]; }
+	Node get_edge_target(uint32_t p_edge) const { return edge_targets[p_edge]; }
+	float get_edge_cost(uint32_t p_edge, MovementDomain p_domain) const { return edge_costs[int(p_domain)][p_edge]; }
+	ProvinceAdjacencyType get_edge_type(uint32_t p_edge) const { return edge_types[p_edge]; }
+	uint32_t get_edge_border_length(uint32_t p_edge) const { return edge_border_lengths[p_edge]; } // Shared border in pixels
+
+	// Blocked provinces can't be entered by any MovementDomain, used when passability changes at runtime.
+	void set_node_blocked(Node p_node, bool p_blocked);
+	bool is_node_blocked(Node p_node) const { return blocked_nodes[p_node]; }
+
+	// Incremented every time the graph changes.
+	uint32_t get_version() const;
+
+private:
+	const ProvinceTable *table = nullptr;
+	Vec<ProvinceEntity> provinces; // Node -> province
+	Vec<ProvinceIndex> province_ids; // Node -> province id
+	Vec<Node> province_nodes; // Province id -> node
+	Vec<Vector2> positions; // Node -> unit locator position
+	Vec<uint32_t> edge_offsets; // Node -> first edge, has one more entry than there are nodes
+	Vec<Node> edge_targets;
+	Vec<ProvinceAdjacencyType> edge_types;
+	Vec<uint32_t> edge_border_lengths;
+	Vec<float> edge_costs[int(MovementDomain::MOVEMENT_DOMAIN_MAX)];
+	Vec<uint8_t> blocked_nodes;
+	uint32_t version = 0;
+};
+
+} // namespace CG
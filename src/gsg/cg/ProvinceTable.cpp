@@ -0,0 +1,168 @@
+#include "ProvinceTable.hpp"
+
+using namespace CG;
+
+void ProvinceTable::clear() {
+	entities.clear();
+	types.clear();
+	owners.clear();
+	areas.clear();
+	regions.clear();
+	positions_x.clear();
+	positions_y.clear();
+	incomes.clear();
+	entity_offset = 0;
+	countries.clear();
+	area_indices.clear();
+	region_indices.clear();
+}
+
+void ProvinceTable::set_entity_offset(ecs_entity_t p_offset) { entity_offset = p_offset; }
+
+void ProvinceTable::set_entity(ProvinceIndex p_province, ProvinceEntity p_entity) {
+	_ensure_size(p_province);
+	entities[p_province] = p_entity;
+}
+
+void ProvinceTable::set_type(ProvinceIndex p_province, ProvinceType p_type) {
+	_ensure_size(p_province);
+	types[p_province] = p_type;
+}
+
+void ProvinceTable::set_owner(ProvinceIndex p_province, CountryEntity p_owner) {
+	_ensure_size(p_province);
+	owners[p_province] = countries.get_or_add(p_owner);
+}
+
+void ProvinceTable::set_area(ProvinceIndex p_province, AreaEntity p_area) {
+	_ensure_size(p_province);
+	areas[p_province] = area_indices.get_or_add(p_area);
+}
+
+void ProvinceTable::set_region(ProvinceIndex p_province, RegionEntity p_region) {
+	_ensure_size(p_province);
+	regions[p_province] = region_indices.get_or_add(p_region);
+}
+
+void ProvinceTable::set_position(ProvinceIndex p_province, const Vector2 &p_position) {
+	_ensure_size(p_province);
+	positions_x[p_province] = p_position.x;
+	positions_y[p_province] = p_position.y;
+}
+
+void ProvinceTable::set_income(ProvinceIndex p_province, float p_income) {
+	_ensure_size(p_province);
+	incomes[p_province] = p_income;
+}
+
+ProvinceIndex ProvinceTable::get_index(ProvinceEntity p_entity) const {
+	const ecs_entity_t id = p_entity.id();
+	if (id <= entity_offset or id - entity_offset >= entities.size())
+		return 0;
+
+	const ProvinceIndex province = ProvinceIndex(id - entity_offset);
+	return entities[province] == p_entity ? province : 0;
+}
+
+float ProvinceTable::get_total_income(const Vec<ProvinceIndex> &p_provinces) const {
+	float income = 0.0;
+	for (const ProvinceIndex province : p_provinces)
+		income += incomes[province];
+	return income;
+}
+
+ProvinceBorderType ProvinceTable::get_border_type(ProvinceIndex p_first, ProvinceIndex p_second) const {
+	const Index first_owner = owners[p_first];
+	const Index second_owner = owners[p_second];
+	if (first_owner != NO_INDEX and second_owner != NO_INDEX and first_owner != second_owner)
+		return ProvinceBorderType::Country;
+
+	const ProvinceType first_type = types[p_first];
+	const ProvinceType second_type = types[p_second];
+
+	ProvinceBorderType border_type = ProvinceBorderType::Country;
+	if (is_navigable_water(p_first) and is_navigable_water(p_second))
+		border_type = ProvinceBorderType::Water;
+	else if (is_impassable(p_first) or is_impassable(p_second))
+		border_type = ProvinceBorderType::Impassable;
+	else if ((first_type == ProvinceType::Ocean and second_type == ProvinceType::Land) or (first_type == ProvinceType::Land and second_type == ProvinceType::Ocean))
+		border_type = ProvinceBorderType::Coastal;
+
+	if (areas[p_first] != NO_INDEX and areas[p_second] != NO_INDEX)
+		border_type = areas[p_first] != areas[p_second] ? ProvinceBorderType::Area : ProvinceBorderType::Province;
+
+	return border_type;
+}
+
+ProvinceAdjacencyType ProvinceTable::get_adjacency_type(ProvinceIndex p_first, ProvinceIndex p_second) const {
+	const ProvinceType first_type = types[p_first];
+	const ProvinceType second_type = types[p_second];
+
+	if (is_navigable_water(p_first) and is_navigable_water(p_second))
+		return ProvinceAdjacencyType::Water;
+	else if (is_impassable(p_first) or is_impassable(p_second))
+		return ProvinceAdjacencyType::Impassable;
+	else if ((first_type == ProvinceType::Ocean and second_type == ProvinceType::Land) or (first_type == ProvinceType::Land and second_type == ProvinceType::Ocean))
+		return ProvinceAdjacencyType::Coastal;
+	else
+		return ProvinceAdjacencyType::Land;
+}
+
+CountryEntity ProvinceTable::get_country(Index p_country) const { return p_country < countries.entities.size() ? countries.entities[p_country] : CountryEntity(); }
+
+AreaEntity ProvinceTable::get_area_entity(Index p_area) const { return p_area < area_indices.entities.size() ? area_indices.entities[p_area] : AreaEntity(); }
+
+RegionEntity ProvinceTable::get_region_entity(Index p_region) const { return p_region < region_indices.entities.size() ? region_indices.entities[p_region] : RegionEntity(); }
+
+ProvinceTable::Index ProvinceTable::get_country_index(CountryEntity p_country) const { return countries.get(p_country); }
+
+ProvinceTable::Index ProvinceTable::EntityIndices::get_or_add(Entity p_entity) {
+	if (!p_entity.is_valid())
+		return NO_INDEX;
+
+	if (const Index *index = indices.getptr(p_entity); index != nullptr)
+		return *index;
+
+	ERR_FAIL_COND_V_MSG(entities.size() >= NO_INDEX, NO_INDEX, "Too many entities for a province table column.");
+	const Index index = entities.size();
+	indices.insert(p_entity, index);
+	entities.push_back(p_entity);
+	return index;
+}
+
+ProvinceTable::Index ProvinceTable::EntityIndices::get(Entity p_entity) const {
+	const Index *index = indices.getptr(p_entity);
+	return index != nullptr ? *index : NO_INDEX;
+}
+
+void ProvinceTable::EntityIndices::clear() {
+	indices.clear();
+	entities.clear();
+}
+
+void ProvinceTable::_ensure_size(ProvinceIndex p_province) {
+	ERR_FAIL_COND(p_province < 0);
+	if (uint32_t(p_province) < types.size())
+		return;
+
+	const uint32_t old_size = types.size();
+	const uint32_t new_size = p_province + 1;
+	entities.resize(new_size);
+	types.resize(new_size);
+	owners.resize(new_size);
+	areas.resize(new_size);
+	regions.resize(new_size);
+	positions_x.resize(new_size);
+	positions_y.resize(new_size);
+	incomes.resize(new_size);
+	for (uint32_t i = old_size; i < new_size; ++i) {
+		entities[i] = ProvinceEntity();
+		types[i] = ProvinceType::None;
+		owners[i] = NO_INDEX;
+		areas[i] = NO_INDEX;
+		regions[i] = NO_INDEX;
+		positions_x[i] = 0.0;
+		positions_y[i] = 0.0;
+		incomes[i] = 0.0;
+	}
+}
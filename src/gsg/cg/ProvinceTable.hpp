@@ -0,0 +1,100 @@
+#pragma once
+
+#include "core/math/vector2.h"
+#include "core/templates/a_hash_map.h"
+
+#include "ecs/entity.hpp"
+#include "ecs/Provinces.hpp"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+// Struct of arrays copy of the province data that is read in tight loops, every column is indexed by ProvinceIndex.
+// Owners, areas and regions are stored as dense 16 bit indices instead of entities so a column is a few bytes per province and comparing two provinces doesn't traverse any relationships.
+// The ECS stays the source of truth, Map writes every change it makes to the province type tags and relationships to the table as well.
+// Province entities have reserved ids so the table also maps between entities and province ids without a hash lookup.
+class ProvinceTable {
+public:
+	using Index = uint16_t; // Index of a country, area or region
+	static constexpr Index NO_INDEX = UINT16_MAX;
+
+	void clear();
+
+	// Province entities are p_offset + their province id.
+	void set_entity_offset(ecs_entity_t p_offset);
+	void set_entity(ProvinceIndex p_province, ProvinceEntity p_entity);
+	void set_type(ProvinceIndex p_province, ProvinceType p_type);
+	void set_owner(ProvinceIndex p_province, CountryEntity p_owner);
+	void set_area(ProvinceIndex p_province, AreaEntity p_area);
+	void set_region(ProvinceIndex p_province, RegionEntity p_region);
+	void set_position(ProvinceIndex p_province, const Vector2 &p_position);
+	void set_income(ProvinceIndex p_province, float p_income);
+
+	ProvinceEntity get_entity(ProvinceIndex p_province) const { return entities[p_province]; }
+	// Province id of an entity, 0 if it isn't a province in the table.
+	ProvinceIndex get_index(ProvinceEntity p_entity) const;
+	ProvinceType get_type(ProvinceIndex p_province) const { return types[p_province]; }
+	Index get_owner(ProvinceIndex p_province) const { return owners[p_province]; }
+	Index get_area(ProvinceIndex p_province) const { return areas[p_province]; }
+	Index get_region(ProvinceIndex p_province) const { return regions[p_province]; }
+	Vector2 get_position(ProvinceIndex p_province) const { return Vector2(positions_x[p_province], positions_y[p_province]); }
+	float get_income(ProvinceIndex p_province) const { return incomes[p_province]; }
+	// Gold per tick of a country that owns p_provinces.
+	float get_total_income(const Vec<ProvinceIndex> &p_provinces) const;
+
+	bool is_navigable_water(ProvinceIndex p_province) const { return types[p_province] == ProvinceType::Ocean or types[p_province] == ProvinceType::River; }
+	bool is_impassable(ProvinceIndex p_province) const { return types[p_province] == ProvinceType::Impassable or types[p_province] == ProvinceType::Uninhabitable; }
+	bool is_passable_land(ProvinceIndex p_province) const { return types[p_province] == ProvinceType::Land; }
+
+	// Same rules as the province relationships, country borders take precedence.
+	ProvinceBorderType get_border_type(ProvinceIndex p_first, ProvinceIndex p_second) const;
+	// Adjacency baked between two provinces that share a border.
+	ProvinceAdjacencyType get_adjacency_type(ProvinceIndex p_first, ProvinceIndex p_second) const;
+
+	CountryEntity get_country(Index p_country) const;
+	AreaEntity get_area_entity(Index p_area) const;
+	RegionEntity get_region_entity(Index p_region) const;
+	Index get_country_index(CountryEntity p_country) const;
+	uint32_t get_area_count() const { return area_indices.entities.size(); }
+	uint32_t get_region_count() const { return region_indices.entities.size(); }
+
+	// Whole columns for loops over every province, index 0 is never a province.
+	uint32_t size() const { return types.size(); }
+	const Vec<ProvinceType> &get_types() const { return types; }
+	const Vec<Index> &get_owners() const { return owners; }
+	const Vec<Index> &get_areas() const { return areas; }
+	const Vec<Index> &get_regions() const { return regions; }
+	const Vec<float> &get_positions_x() const { return positions_x; }
+	const Vec<float> &get_positions_y() const { return positions_y; }
+	const Vec<float> &get_incomes() const { return incomes; }
+
+private:
+	// Dense indices of the entities a column refers to.
+	struct EntityIndices {
+		AHashMap<Entity, Index, EntityHasher> indices;
+		Vec<Entity> entities;
+
+		Index get_or_add(Entity p_entity);
+		Index get(Entity p_entity) const;
+		void clear();
+	};
+
+	Vec<ProvinceEntity> entities; // Invalid for ids that aren't provinces
+	Vec<ProvinceType> types;
+	Vec<Index> owners;
+	Vec<Index> areas;
+	Vec<Index> regions;
+	Vec<float> positions_x; // Unit locator position, the AABB center for provinces without one
+	Vec<float> positions_y;
+	Vec<float> incomes; // Gold per tick for the owner
+	ecs_entity_t entity_offset = 0;
+
+	EntityIndices countries;
+	EntityIndices area_indices;
+	EntityIndices region_indices;
+
+	void _ensure_size(ProvinceIndex p_province);
+};
+
+} // namespace CG
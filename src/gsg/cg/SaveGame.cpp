@@ -0,0 +1,443 @@
+#include "SaveGame.hpp"
+
+#include "core/io/file_access.h"
+#include "core/io/marshalls.h"
+#include "core/math/math_funcs.h"
+#include "core/templates/a_hash_map.h"
+
+#include "Simulation.hpp"
+
+using namespace CG;
+
+namespace {
+
+constexpr uint32_t save_magic = 0x53475347; // "GSGS"
+constexpr uint32_t save_version = 1;
+
+// Size and columns of the province grid of generated worlds.
+constexpr float generated_province_size = 16.0;
+uint32_t get_generated_grid_width(uint32_t p_province_count) { return MAX(uint32_t(Math::ceil(Math::sqrt(double(p_province_count)))), 1u); }
+
+// Writes the body of the save and collects its strings, the string table is put in front of the body when finishing.
+class SaveWriter {
+public:
+	void write_u8(uint8_t p_value) { data.push_back(p_value); }
+	void write_u32(uint32_t p_value) { encode_uint32(p_value, _grow(4)); }
+	void write_float(float p_value) { encode_float(p_value, _grow(4)); }
+	void write_double(double p_value) { encode_double(p_value, _grow(8)); }
+
+	void write_string(const String &p_string) {
+		const uint32_t *index = string_indices.getptr(p_string);
+		if (index != nullptr) {
+			write_u32(*index);
+			return;
+		}
+
+		string_indices.insert(p_string, strings.size());
+		write_u32(strings.size());
+		strings.push_back(p_string);
+	}
+
+	void write_color(const Color &p_color) {
+		write_float(p_color.r);
+		write_float(p_color.g);
+		write_float(p_color.b);
+		write_float(p_color.a);
+	}
+
+	void write_locator(const Locator &p_locator) {
+		write_float(p_locator.position.x);
+		write_float(p_locator.position.y);
+		write_float(p_locator.orientation);
+		write_float(p_locator.scale);
+	}
+
+	void write_aabb(const AABB &p_aabb) {
+		for (int i = 0; i < 3; ++i)
+			write_float(p_aabb.position[i]);
+		for (int i = 0; i < 3; ++i)
+			write_float(p_aabb.size[i]);
+	}
+
+	template <typename T> void write_indices(const Vec<T> &p_indices) {
+		write_u32(p_indices.size());
+		for (const T index : p_indices)
+			write_u32(uint32_t(index));
+	}
+
+	Vec<uint8_t> finish() {
+		SaveWriter header;
+		header.write_u32(save_magic);
+		header.write_u32(save_version);
+		header.write_u32(strings.size());
+		for (const String &string : strings) {
+			const CharString utf8 = string.utf8();
+			header.write_u32(utf8.length());
+			uint8_t *dst = header._grow(utf8.length());
+			memcpy(dst, utf8.get_data(), utf8.length());
+		}
+
+		const uint32_t header_size = header.data.size();
+		header._grow(data.size());
+		memcpy(header.data.ptr() + header_size, data.ptr(), data.size());
+		return std::move(header.data);
+	}
+
+private:
+	Vec<uint8_t> data;
+	Vec<String> strings;
+	AHashMap<String, uint32_t> string_indices;
+
+	uint8_t *_grow(uint32_t p_size) {
+		const uint32_t offset = data.size();
+		data.resize(offset + p_size);
+		return data.ptr() + offset;
+	}
+};
+
+// Reads a save, reading past the end returns zeros and marks the reader as failed so the caller only checks once at the end.
+class SaveReader {
+public:
+	explicit SaveReader(const Vector<uint8_t> &p_data) :
+			data(p_data.ptr()), size(p_data.size()) {}
+
+	uint8_t read_u8() {
+		const uint8_t *src = _read(1);
+		return src != nullptr ? *src : 0;
+	}
+
+	uint32_t read_u32() {
+		const uint8_t *src = _read(4);
+		return src != nullptr ? decode_uint32(src) : 0;
+	}
+
+	float read_float() {
+		const uint8_t *src = _read(4);
+		return src != nullptr ? decode_float(src) : 0.0;
+	}
+
+	double read_double() {
+		const uint8_t *src = _read(8);
+		return src != nullptr ? decode_double(src) : 0.0;
+	}
+
+	bool read_string_table() {
+		const uint32_t count = read_u32();
+		for (uint32_t i = 0; i < count and !failed; ++i) {
+			const uint32_t length = read_u32();
+			const uint8_t *src = _read(length);
+			if (src != nullptr)
+				strings.push_back(String::utf8(reinterpret_cast<const char *>(src), int(length)));
+		}
+		return !failed;
+	}
+
+	String read_string() {
+		const uint32_t index = read_u32();
+		if (index >= strings.size()) {
+			failed = true;
+			return String();
+		}
+		return strings[index];
+	}
+
+	Color read_color() {
+		Color color;
+		color.r = read_float();
+		color.g = read_float();
+		color.b = read_float();
+		color.a = read_float();
+		return color;
+	}
+
+	void read_locator(Locator &r_locator) {
+		r_locator.position.x = read_float();
+		r_locator.position.y = read_float();
+		r_locator.orientation = read_float();
+		r_locator.scale = read_float();
+	}
+
+	AABB read_aabb() {
+		AABB aabb;
+		for (int i = 0; i < 3; ++i)
+			aabb.position[i] = read_float();
+		for (int i = 0; i < 3; ++i)
+			aabb.size[i] = read_float();
+		return aabb;
+	}
+
+	template <typename T> void read_indices(Vec<T> &r_indices) {
+		const uint32_t count = read_count(4);
+		r_indices.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+			r_indices[i] = T(read_u32());
+	}
+
+	// Element count of a list, fails if the rest of the file can't even hold p_min_element_size bytes per element so corrupt counts don't allocate huge lists.
+	uint32_t read_count(uint32_t p_min_element_size) {
+		const uint32_t count = read_u32();
+		if (uint64_t(count) * p_min_element_size > size - position) {
+			failed = true;
+			return 0;
+		}
+		return count;
+	}
+
+	bool is_failed() const { return failed; }
+	bool is_at_end() const { return position == size; }
+
+private:
+	const uint8_t *data = nullptr;
+	uint64_t size = 0;
+	uint64_t position = 0;
+	bool failed = false;
+	Vec<String> strings;
+
+	const uint8_t *_read(uint64_t p_size) {
+		if (failed or p_size > size - position) {
+			failed = true;
+			return nullptr;
+		}
+
+		const uint8_t *src = data + position;
+		position += p_size;
+		return src;
+	}
+};
+
+} // namespace
+
+Error SaveGame::save(const String &p_path) const {
+	SaveWriter writer;
+
+	writer.write_u32(provinces.size());
+	for (const Province &province : provinces) {
+		writer.write_u32(province.id);
+		writer.write_u8(uint8_t(province.type));
+		writer.write_u8(province.flags);
+		writer.write_string(province.loc_key);
+		if (province.flags & HAS_TEXT_LOCATOR)
+			writer.write_locator(province.text_locator);
+		if (province.flags & HAS_UNIT_LOCATOR)
+			writer.write_locator(province.unit_locator);
+		if (province.flags & HAS_AABB)
+			writer.write_aabb(province.aabb);
+	}
+
+	writer.write_u32(areas.size());
+	for (const Area &area : areas) {
+		writer.write_string(area.name);
+		writer.write_string(area.loc_key);
+		writer.write_color(area.color);
+		writer.write_u32(area.capital);
+		writer.write_indices(area.provinces);
+	}
+
+	writer.write_u32(regions.size());
+	for (const Region &region : regions) {
+		writer.write_string(region.name);
+		writer.write_string(region.loc_key);
+		writer.write_color(region.color);
+		writer.write_u32(region.capital);
+		writer.write_indices(region.areas);
+	}
+
+	writer.write_u32(countries.size());
+	for (const Country &country : countries) {
+		writer.write_string(country.name);
+		writer.write_string(country.loc_key);
+		writer.write_color(country.color);
+		writer.write_u32(country.capital);
+		writer.write_double(country.treasury.gold);
+		writer.write_float(country.treasury.income);
+		writer.write_indices(country.provinces);
+	}
+
+	writer.write_u32(units.size());
+	for (const Unit &unit : units) {
+		writer.write_u32(unit.owner);
+		writer.write_u32(unit.location);
+	}
+
+	writer.write_u32(player);
+
+	const Vec<uint8_t> bytes = writer.finish();
+	Error error;
+	const Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::WRITE, &error);
+	ERR_FAIL_COND_V_MSG(file.is_null(), error, "Couldn't open save file " + p_path + ".");
+	file->store_buffer(bytes.ptr(), bytes.size());
+	return file->get_error();
+}
+
+Error SaveGame::load(const String &p_path) {
+	Error error;
+	const Vector<uint8_t> bytes = FileAccess::get_file_as_bytes(p_path, &error);
+	ERR_FAIL_COND_V_MSG(error != OK, error, "Couldn't open save file " + p_path + ".");
+
+	SaveReader reader(bytes);
+	ERR_FAIL_COND_V_MSG(reader.read_u32() != save_magic, ERR_FILE_UNRECOGNIZED, p_path + " isn't a save file.");
+	ERR_FAIL_COND_V_MSG(reader.read_u32() != save_version, ERR_FILE_UNRECOGNIZED, p_path + " was saved with another save version.");
+	ERR_FAIL_COND_V_MSG(!reader.read_string_table(), ERR_FILE_CORRUPT, p_path + " is corrupt.");
+
+	provinces.resize(reader.read_count(10));
+	for (Province &province : provinces) {
+		province.id = ProvinceIndex(reader.read_u32());
+		province.type = ProvinceType(reader.read_u8());
+		province.flags = reader.read_u8();
+		province.loc_key = reader.read_string();
+		if (province.flags & HAS_TEXT_LOCATOR)
+			reader.read_locator(province.text_locator);
+		if (province.flags & HAS_UNIT_LOCATOR)
+			reader.read_locator(province.unit_locator);
+		if (province.flags & HAS_AABB)
+			province.aabb = reader.read_aabb();
+	}
+
+	areas.resize(reader.read_count(32));
+	for (Area &area : areas) {
+		area.name = reader.read_string();
+		area.loc_key = reader.read_string();
+		area.color = reader.read_color();
+		area.capital = ProvinceIndex(reader.read_u32());
+		reader.read_indices(area.provinces);
+	}
+
+	regions.resize(reader.read_count(32));
+	for (Region &region : regions) {
+		region.name = reader.read_string();
+		region.loc_key = reader.read_string();
+		region.color = reader.read_color();
+		region.capital = ProvinceIndex(reader.read_u32());
+		reader.read_indices(region.areas);
+	}
+
+	countries.resize(reader.read_count(44));
+	for (Country &country : countries) {
+		country.name = reader.read_string();
+		country.loc_key = reader.read_string();
+		country.color = reader.read_color();
+		country.capital = ProvinceIndex(reader.read_u32());
+		country.treasury.gold = reader.read_double();
+		country.treasury.income = reader.read_float();
+		reader.read_indices(country.provinces);
+	}
+
+	units.resize(reader.read_count(8));
+	for (Unit &unit : units) {
+		unit.owner = reader.read_u32();
+		unit.location = ProvinceIndex(reader.read_u32());
+	}
+
+	player = reader.read_u32();
+
+	ERR_FAIL_COND_V_MSG(reader.is_failed() or !reader.is_at_end(), ERR_FILE_CORRUPT, p_path + " is corrupt.");
+	return OK;
+}
+
+SaveGame SaveGame::generate(uint32_t p_province_count, uint32_t p_country_count, uint32_t p_unit_count) {
+	static constexpr uint32_t provinces_per_area = 8;
+	static constexpr uint32_t areas_per_region = 8;
+	static constexpr float province_size = generated_province_size;
+
+	SaveGame save;
+	const uint32_t grid_width = get_generated_grid_width(p_province_count);
+
+	save.provinces.resize(p_province_count);
+	for (uint32_t i = 0; i < p_province_count; ++i) {
+		Province &province = save.provinces[i];
+		province.id = ProvinceIndex(i + 1);
+		province.type = ProvinceType::Land;
+		province.flags = HAS_TEXT_LOCATOR | HAS_UNIT_LOCATOR | HAS_AABB;
+		province.loc_key = "PROV" + itos(province.id);
+
+		const Vector2 position = Vector2(i % grid_width + 0.5, i / grid_width + 0.5) * province_size;
+		province.text_locator.position = position;
+		province.unit_locator.position = position;
+		province.aabb = AABB(Vector3(position.x, 0.0, position.y) - Vector3(0.5, 0.0, 0.5) * province_size, Vector3(province_size, 0.0, province_size));
+	}
+
+	save.areas.resize((p_province_count + provinces_per_area - 1) / provinces_per_area);
+	for (uint32_t i = 0; i < save.areas.size(); ++i) {
+		Area &area = save.areas[i];
+		area.name = "area_" + itos(i);
+		area.loc_key = area.name;
+		area.color = Color(Math::randf(), Math::randf(), Math::randf());
+		for (uint32_t province = i * provinces_per_area; province < MIN((i + 1) * provinces_per_area, p_province_count); ++province)
+			area.provinces.push_back(ProvinceIndex(province + 1));
+		area.capital = area.provinces[0];
+	}
+
+	save.regions.resize((save.areas.size() + areas_per_region - 1) / areas_per_region);
+	for (uint32_t i = 0; i < save.regions.size(); ++i) {
+		Region &region = save.regions[i];
+		region.name = "region_" + itos(i);
+		region.loc_key = region.name;
+		region.color = Color(Math::randf(), Math::randf(), Math::randf());
+		for (uint32_t area = i * areas_per_region; area < MIN((i + 1) * areas_per_region, save.areas.size()); ++area)
+			region.areas.push_back(area);
+		region.capital = save.areas[region.areas[0]].capital;
+	}
+
+	const uint32_t country_count = MIN(p_country_count, p_province_count);
+	save.countries.resize(country_count);
+	for (uint32_t i = 0; i < country_count; ++i) {
+		Country &country = save.countries[i];
+		country.name = "country_" + itos(i);
+		country.loc_key = country.name;
+		country.color = Color(Math::randf(), Math::randf(), Math::randf());
+		for (uint64_t province = uint64_t(i) * p_province_count / country_count; province < uint64_t(i + 1) * p_province_count / country_count; ++province)
+			country.provinces.push_back(ProvinceIndex(province + 1));
+		country.capital = country.provinces[0];
+		country.treasury.income = country.provinces.size() * Simulation::province_income;
+	}
+
+	if (country_count > 0) {
+		save.units.resize(p_unit_count);
+		for (uint32_t i = 0; i < p_unit_count; ++i) {
+			const Country &owner = save.countries[i % country_count];
+			save.units[i] = { .owner = i % country_count, .location = owner.provinces[Math::rand() % owner.provinces.size()] };
+		}
+	}
+
+	return save;
+}
+
+Ref<ConfigFile> SaveGame::generate_map_data(uint32_t p_province_count) {
+	const uint32_t grid_width = get_generated_grid_width(p_province_count);
+	const uint32_t grid_height = (p_province_count + grid_width - 1) / grid_width;
+	const float size = generated_province_size;
+
+	Dictionary borders;
+	PackedInt32Array adjacencies;
+	const auto add_border = [&](uint32_t p_province, uint32_t p_neighbour, const Vector4 &p_segment) {
+		// Keys are sorted like the baked borders, the larger id first.
+		PackedInt32Array key;
+		key.push_back(p_neighbour + 1);
+		key.push_back(p_province + 1);
+
+		PackedVector4Array segments;
+		segments.push_back(p_segment);
+		borders[key] = segments;
+
+		adjacencies.push_back(p_neighbour + 1);
+		adjacencies.push_back(p_province + 1);
+		adjacencies.push_back(int(ProvinceAdjacencyType::Land));
+		adjacencies.push_back(int(size));
+	};
+
+	for (uint32_t i = 0; i < p_province_count; ++i) {
+		const float x = (i % grid_width) * size;
+		const float y = (i / grid_width) * size;
+		if (i % grid_width + 1 < grid_width and i + 1 < p_province_count)
+			add_border(i, i + 1, Vector4(x + size, y, x + size, y + size));
+		if (i + grid_width < p_province_count)
+			add_border(i, i + grid_width, Vector4(x, y + size, x + size, y + size));
+	}
+
+	Ref<ConfigFile> map_data = memnew(ConfigFile());
+	map_data->set_value("map_data", "width", int(grid_width * size));
+	map_data->set_value("map_data", "height", int(grid_height * size));
+	map_data->set_value("map_data", "borders", borders);
+	map_data->set_value("map_data", "adjacencies", adjacencies);
+	return map_data;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "core/io/config_file.h"
+#include "core/math/aabb.h"
+#include "core/math/color.h"
+
+#include "ecs/components.hpp"
+#include "ecs/Provinces.hpp"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+// Snapshot of the map entities in a compact binary file.
+// Strings are written once to a string table at the start of the file and referenced by index, everything else is little endian numbers.
+// Relationships are stored as province ids and as indices into the lists of the save, entity ids aren't saved since they change between runs.
+struct SaveGame {
+	static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+	enum ProvinceFlags : uint8_t {
+		HAS_TEXT_LOCATOR = 1 << 0,
+		HAS_UNIT_LOCATOR = 1 << 1,
+		HAS_AABB = 1 << 2,
+	};
+
+	struct Province {
+		ProvinceIndex id = 0;
+		ProvinceType type = ProvinceType::None;
+		uint8_t flags = 0; // ProvinceFlags
+		String loc_key;
+		TextLocator text_locator;
+		UnitLocator unit_locator;
+		AABB aabb;
+	};
+
+	struct Area {
+		String name;
+		String loc_key;
+		Color color;
+		ProvinceIndex capital = 0;
+		Vec<ProvinceIndex> provinces;
+	};
+
+	struct Region {
+		String name;
+		String loc_key;
+		Color color;
+		ProvinceIndex capital = 0;
+		Vec<uint32_t> areas; // Indices into areas
+	};
+
+	struct Country {
+		String name;
+		String loc_key;
+		Color color;
+		ProvinceIndex capital = 0;
+		Treasury treasury;
+		Vec<ProvinceIndex> provinces;
+	};
+
+	struct Unit {
+		uint32_t owner = NO_INDEX; // Index into countries
+		ProvinceIndex location = 0;
+	};
+
+	Vec<Province> provinces;
+	Vec<Area> areas;
+	Vec<Region> regions;
+	Vec<Country> countries;
+	Vec<Unit> units;
+	uint32_t player = NO_INDEX; // Index into countries, NO_INDEX for the observer
+
+	Error save(const String &p_path) const;
+	Error load(const String &p_path);
+
+	// Synthetic world for benchmarks. Provinces are laid out on a grid in areas of 8 provinces and regions of 8 areas,
+	// every country owns a run of consecutive provinces and units are spread over the provinces of their owner.
+	static SaveGame generate(uint32_t p_province_count, uint32_t p_country_count, uint32_t p_unit_count);
+	// Map data like the map editor bakes it for the grid of generate(), every pair of neighbouring provinces has a straight border and a land adjacency.
+	static Ref<ConfigFile> generate_map_data(uint32_t p_province_count);
+};
+
+} // namespace CG
@@ -0,0 +1,122 @@
+#include "Simulation.hpp"
+
+#include "core/os/os.h"
+
+#include "ecs/components.hpp"
+
+#include "UnitMovement.hpp"
+
+using namespace CG;
+
+Simulation::Phases Simulation::create_phases(flecs::world &p_world) {
+	Phases new_phases;
+	new_phases.economy = p_world.entity("EconomyPhase").add(flecs::Phase).depends_on(flecs::OnUpdate);
+	new_phases.movement = p_world.entity("MovementPhase").add(flecs::Phase).depends_on(new_phases.economy);
+	new_phases.ai = p_world.entity("AIPhase").add(flecs::Phase).depends_on(new_phases.movement);
+	return new_phases;
+}
+
+Entity Simulation::register_economy_system(flecs::world &p_world, Entity p_phase) {
+	// Every country only writes its own treasury.
+	return p_world.system<Treasury>("EconomyTick").kind(p_phase).multi_threaded().each([](Treasury &treasury) { treasury.gold += treasury.income; });
+}
+
+void Simulation::init(UnitMovement *p_unit_movement, TickCallback p_begin_tick, void *p_userdata) {
+	ECS &ecs = *ECS::self;
+	ecs.set_threads(int(OS::get_singleton()->get_processor_count()));
+
+	phases = create_phases(ecs);
+	economy_system = register_economy_system(ecs, phases.economy);
+	unit_movement = p_unit_movement;
+	unit_movement->register_systems(phases.movement);
+	begin_tick = p_begin_tick;
+	begin_tick_userdata = p_userdata;
+}
+
+void Simulation::update(double p_delta) {
+	if (unit_movement == nullptr)
+		return;
+
+	accumulator += p_delta;
+
+	int ticks = 0;
+	while (accumulator >= tick_time and ticks < max_ticks_per_frame) {
+		if (begin_tick != nullptr)
+			begin_tick(begin_tick_userdata);
+		unit_movement->begin_tick();
+		ECS::self->progress(float(tick_time));
+		accumulator -= tick_time;
+		ticks++;
+	}
+
+	if (accumulator >= tick_time)
+		accumulator = Math::fmod(accumulator, tick_time);
+
+	unit_movement->draw(float(accumulator / tick_time));
+}
+
+const Simulation::Phases &Simulation::get_phases() const { return phases; }
+
+void Simulation::benchmark(uint32_t p_unit_count, uint32_t p_country_count, uint32_t p_ticks) {
+	flecs::world world;
+	const Phases benchmark_phases = create_phases(world);
+	register_economy_system(world, benchmark_phases.economy);
+	UnitMovement::register_tick_system(world, benchmark_phases.movement);
+
+	// Targets are far enough away that no unit arrives during the benchmark, so every unit moves every tick.
+	Vec<UnitProgress> unit_progress;
+	Vec<UnitPosition> unit_positions;
+	unit_progress.resize(p_unit_count);
+	unit_positions.resize(p_unit_count);
+	for (uint32_t i = 0; i < p_unit_count; ++i) {
+		unit_positions[i].current = Vector2(Math::random(0.0, 8192.0), Math::random(0.0, 8192.0));
+		unit_positions[i].previous = unit_positions[i].current;
+		unit_progress[i].target = unit_positions[i].current + Vector2(1.0, 0.0).rotated(Math::random(0.0, Math::TAU)) * 1e6;
+	}
+
+	ecs_bulk_desc_t unit_desc{};
+	void *unit_data[FLECS_ID_DESC_MAX]{ unit_progress.ptr(), unit_positions.ptr() };
+	unit_desc.count = int32_t(p_unit_count);
+	unit_desc.ids[0] = world.id<UnitProgress>();
+	unit_desc.ids[1] = world.id<UnitPosition>();
+	unit_desc.data = unit_data;
+	ecs_bulk_init(world.c_ptr(), &unit_desc);
+
+	Vec<Treasury> treasuries;
+	treasuries.resize(p_country_count);
+	for (Treasury &treasury : treasuries)
+		treasury.income = Math::random(0.0, 100.0) * province_income;
+
+	ecs_bulk_desc_t country_desc{};
+	void *country_data[FLECS_ID_DESC_MAX]{ treasuries.ptr() };
+	country_desc.count = int32_t(p_country_count);
+	country_desc.ids[0] = world.id<Treasury>();
+	country_desc.data = country_data;
+	ecs_bulk_init(world.c_ptr(), &country_desc);
+
+	const int max_thread_count = MAX(OS::get_singleton()->get_processor_count(), 1);
+	for (int thread_count = 1;; thread_count = MIN(thread_count * 2, max_thread_count)) {
+		world.set_threads(thread_count);
+		world.progress(float(tick_time)); // Warm up the new worker threads
+
+		const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+		for (uint32_t tick = 0; tick < p_ticks; ++tick)
+			world.progress(float(tick_time));
+		const uint64_t elapsed_usec = MAX(OS::get_singleton()->get_ticks_usec() - start_time, uint64_t(1));
+
+		print_line("Simulation benchmark with ", p_unit_count, " units and ", p_country_count, " countries on ", thread_count, " threads: ", p_ticks * 1000000.0 / elapsed_usec, " ticks per second, ",
+				elapsed_usec / 1000.0 / MAX(p_ticks, 1u), " ms per tick");
+
+		if (thread_count == max_thread_count)
+			break;
+	}
+}
+
+Simulation::~Simulation() {
+	// The ECS may already be gone when the map is freed.
+	if (ECS::self == nullptr)
+		return;
+
+	if (economy_system.is_alive())
+		economy_system.destruct();
+}
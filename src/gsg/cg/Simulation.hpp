@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ecs/entity.hpp"
+
+namespace CG {
+
+class UnitMovement;
+
+// The game tick as a pipeline of flecs systems that runs at a fixed rate.
+// Every tick runs the economy, movement and ai phases in that order, each phase depends on the one before it so its systems see what earlier phases wrote in the same tick.
+// Systems of a phase that are multi_threaded split their entities over the flecs worker threads, single threaded systems of the same phase run after them on the main thread.
+class Simulation {
+public:
+	static constexpr double tick_time = 0.1; // Seconds per tick.
+	static constexpr int max_ticks_per_frame = 4; // Ticks that didn't fit are dropped so a slow frame doesn't make the next one slower.
+	static constexpr float province_income = 0.05; // Gold per owned province per tick
+
+	struct Phases {
+		Entity economy;
+		Entity movement;
+		Entity ai; // Decisions made from the state after movement, no AI systems exist yet.
+	};
+
+	static Phases create_phases(flecs::world &p_world);
+	static Entity register_economy_system(flecs::world &p_world, Entity p_phase);
+
+	using TickCallback = void (*)(void *p_userdata);
+
+	// Start the worker threads and register the systems of every phase. p_begin_tick is called with p_userdata before every tick.
+	void init(UnitMovement *p_unit_movement, TickCallback p_begin_tick = nullptr, void *p_userdata = nullptr);
+	// Run the ticks that fit in p_delta seconds and draw units between the last two ticks.
+	void update(double p_delta);
+	const Phases &get_phases() const;
+
+	// Tick a synthetic world of p_unit_count moving units and p_country_count countries with 1, 2, 4... worker threads and print the ticks per second of every thread count.
+	// Doesn't use the map or the rendering server so it can run headless.
+	static void benchmark(uint32_t p_unit_count, uint32_t p_country_count, uint32_t p_ticks);
+
+	~Simulation();
+
+private:
+	Phases phases;
+	Entity economy_system;
+	UnitMovement *unit_movement = nullptr;
+	TickCallback begin_tick = nullptr;
+	void *begin_tick_userdata = nullptr;
+	double accumulator = 0.0;
+};
+
+} // namespace CG
@@ -0,0 +1,129 @@
+#include "UnitMovement.hpp"
+
+#include "ecs/components.hpp"
+
+#include "Map.hpp"
+#include "MapUnits.hpp"
+
+using namespace CG;
+
+void UnitMovement::register_systems(Entity p_phase) {
+	ECS &ecs = *ECS::self;
+	tick_system = register_tick_system(ecs, p_phase);
+
+	// Changing the Location relation and the unit stacks can't be done from worker threads so arrivals are handled after the tick, in the same phase.
+	arrival_system = ecs.system<UnitPath, UnitProgress, const UnitPosition>("UnitMovementArrival")
+							 .kind(p_phase)
+							 .each([this](Entity unit, UnitPath &path, UnitProgress &progress, const UnitPosition &position) {
+								 if (position.previous != position.current)
+									 moved_units.push_back(unit);
+
+								 if (!progress.arrived)
+									 return;
+
+								 if (path.next < path.provinces.size()) {
+									 ECS &ecs = *ECS::self;
+									 const ProvinceEntity old_location = ecs.get_target(unit, Relation::Location);
+									 const ProvinceEntity new_location = path.provinces[path.next++];
+
+									 if (old_location.is_valid())
+										 unit.remove(Relationship(Location), old_location);
+									 unit.add(Relationship(Location), new_location);
+									 Map::self->on_unit_location_changed(unit, old_location, new_location);
+
+									 if (_start_step(path, progress))
+										 return;
+								 }
+
+								 // The path is done, keep the components until the unit stopped so its last step is still interpolated.
+								 if (position.previous == position.current) {
+									 moved_units.push_back(unit);
+									 unit.remove<UnitPath>();
+									 unit.remove<UnitProgress>();
+								 }
+							 });
+}
+
+Entity UnitMovement::register_tick_system(flecs::world &p_world, Entity p_phase) {
+	// Runs on the flecs worker threads, each unit only reads and writes its own components.
+	return p_world.system<UnitProgress, UnitPosition>("UnitMovementTick").kind(p_phase).multi_threaded().each([](UnitProgress &progress, UnitPosition &position) {
+		position.previous = position.current;
+		if (progress.arrived)
+			return;
+
+		position.current = position.current.move_toward(progress.target, progress.speed);
+		progress.arrived = position.current == progress.target;
+	});
+}
+
+void UnitMovement::move_unit(UnitEntity p_unit, const Vec<ProvinceEntity> &p_path) {
+	ERR_FAIL_COND(!p_unit.is_alive());
+	if (p_path.is_empty())
+		return;
+
+	UnitPosition position;
+	if (p_unit.has<UnitPosition>()) {
+		position = p_unit.get<UnitPosition>();
+	} else if (p_unit.has<UnitModel>() and MapUnits::self != nullptr) {
+		const Vector3 &origin = MapUnits::self->get_transform(p_unit.get<UnitModel>()).origin;
+		position.current = Vector2(origin.x, origin.z);
+		position.previous = position.current;
+	}
+
+	UnitPath path;
+	path.provinces = p_path;
+
+	UnitProgress progress = p_unit.has<UnitProgress>() ? p_unit.get<UnitProgress>() : UnitProgress();
+	if (!_start_step(path, progress))
+		return;
+
+	p_unit.set<UnitPath>(path);
+	p_unit.set<UnitProgress>(progress);
+	p_unit.set<UnitPosition>(position);
+}
+
+void UnitMovement::begin_tick() { moved_units.clear(); }
+
+bool UnitMovement::_start_step(const UnitPath &p_path, UnitProgress &r_progress) {
+	if (p_path.next >= p_path.provinces.size())
+		return false;
+
+	const ProvinceIndex province_id = Map::self->get_province_index(p_path.provinces[p_path.next]);
+	ERR_FAIL_COND_V(province_id == 0, false);
+
+	r_progress.target = Map::self->get_province_table().get_position(province_id);
+	r_progress.arrived = false;
+	return true;
+}
+
+void UnitMovement::draw(float p_alpha) const {
+	MapUnits *map_units = MapUnits::self;
+	if (map_units == nullptr or moved_units.is_empty())
+		return;
+
+	for (const UnitEntity unit : moved_units) {
+		if (!unit.is_alive() or !unit.has<UnitPosition>() or !unit.has<UnitModel>())
+			continue;
+
+		const UnitPosition &position = unit.get<UnitPosition>();
+		const Vector2 map_position = position.previous.lerp(position.current, p_alpha);
+		const MapUnits::UnitSlot slot = unit.get<UnitModel>();
+
+		Transform3D transform = map_units->get_transform(slot);
+		transform.origin = Vector3(map_position.x, unit_map_layer, map_position.y);
+		map_units->set_transform(slot, transform);
+	}
+
+	map_units->flush();
+}
+
+UnitMovement::~UnitMovement() {
+	// The systems capture this so they can't outlive it.
+	if (ECS::self == nullptr)
+		return;
+
+	if (tick_system.is_alive())
+		tick_system.destruct();
+	if (arrival_system.is_alive())
+		arrival_system.destruct();
+}
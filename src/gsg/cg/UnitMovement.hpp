@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
+
+namespace CG {
+
+struct UnitPath;
+struct UnitProgress;
+
+// Moves units along their UnitPath in the movement phase of the Simulation tick and interpolates the drawn positions between ticks.
+// The tick is a multi threaded flecs system, every worker moves a batch of units and only writes the components of the units it owns.
+// Units that reached a province are handled by a single threaded system that runs after it, it updates their Location and starts the next step of the path.
+// Only units whose position changed in the last tick get their MapUnits transform written.
+class UnitMovement {
+public:
+	void register_systems(Entity p_phase);
+	// The multi threaded part of the movement, also used by the Simulation benchmark on its own world.
+	static Entity register_tick_system(flecs::world &p_world, Entity p_phase);
+
+	// Move a unit through p_path starting from its current position. The last province of the path is where it stops.
+	void move_unit(UnitEntity p_unit, const Vec<ProvinceEntity> &p_path);
+
+	// Called before every simulation tick.
+	void begin_tick();
+	// Draw the units that moved in the last tick, p_alpha is how far the frame is between the last two ticks.
+	void draw(float p_alpha) const;
+
+	~UnitMovement();
+
+private:
+	Vec<UnitEntity> moved_units; // Units whose position changed in the last tick.
+	Entity tick_system;
+	Entity arrival_system;
+
+	static bool _start_step(const UnitPath &p_path, UnitProgress &r_progress);
+};
+
+} // namespace CG
@@ -0,0 +1,175 @@
+#include "UnitStacks.hpp"
+
+#include "scene/resources/font.h"
+
+#include "ecs/components.hpp"
+
+#include "Map.hpp"
+
+using namespace CG;
+
+void UnitStacks::create(const RID &p_scenario) {
+	clear();
+	markers = memnew(MapUnits(p_scenario));
+	markers->set_visible(aggregated);
+}
+
+void UnitStacks::clear() {
+	for (KeyValue<ProvinceEntity, Stack> &kv : stacks)
+		_free_stack(kv.value);
+	stacks.clear();
+	dirty_provinces.clear();
+	memdelete_notnull(markers);
+	markers = nullptr;
+}
+
+void UnitStacks::add_unit(UnitEntity p_unit, ProvinceEntity p_province) {
+	ERR_FAIL_COND(!p_province.is_valid());
+
+	const CountryEntity owner = ECS::self->get_target(p_unit, Relation::Owner);
+	Stack &stack = stacks[p_province];
+	stack.count++;
+
+	for (OwnerCount &owner_count : stack.owners) {
+		if (owner_count.owner == owner) {
+			owner_count.count++;
+			_invalidate(p_province, stack);
+			return;
+		}
+	}
+
+	stack.owners.push_back({ owner, 1 });
+	_invalidate(p_province, stack);
+}
+
+void UnitStacks::remove_unit(UnitEntity p_unit, ProvinceEntity p_province) {
+	Stack *stack = stacks.getptr(p_province);
+	ERR_FAIL_NULL(stack);
+
+	const CountryEntity owner = ECS::self->get_target(p_unit, Relation::Owner);
+	for (uint32_t i = 0; i < stack->owners.size(); ++i) {
+		if (stack->owners[i].owner != owner)
+			continue;
+
+		stack->count--;
+		if (--stack->owners[i].count == 0)
+			stack->owners.remove_at_unordered(i);
+		break;
+	}
+
+	_invalidate(p_province, *stack);
+}
+
+void UnitStacks::move_unit(UnitEntity p_unit, ProvinceEntity p_from, ProvinceEntity p_to) {
+	if (p_from == p_to)
+		return;
+
+	if (p_from.is_valid())
+		remove_unit(p_unit, p_from);
+	if (p_to.is_valid())
+		add_unit(p_unit, p_to);
+}
+
+void UnitStacks::update(float p_camera_distance) {
+	if (markers == nullptr or MapLabelBatch::self == nullptr)
+		return;
+
+	for (const ProvinceEntity province : dirty_provinces)
+		_update_stack(province);
+	dirty_provinces.clear();
+
+	const bool should_aggregate = p_camera_distance >= aggregate_camera_distance;
+	if (should_aggregate != aggregated) {
+		aggregated = should_aggregate;
+		markers->set_visible(aggregated);
+		if (MapUnits::self != nullptr)
+			MapUnits::self->set_visible(!aggregated);
+
+		for (const KeyValue<ProvinceEntity, Stack> &kv : stacks)
+			if (kv.value.count_label != MapLabelBatch::INVALID_LABEL)
+				MapLabelBatch::self->set_label_visible(kv.value.count_label, aggregated);
+	}
+
+	markers->flush();
+	MapLabelBatch::self->flush();
+}
+
+bool UnitStacks::is_aggregated() const { return aggregated; }
+
+void UnitStacks::_invalidate(ProvinceEntity p_province, Stack &r_stack) {
+	if (r_stack.dirty)
+		return;
+	r_stack.dirty = true;
+	dirty_provinces.push_back(p_province);
+}
+
+void UnitStacks::_update_stack(ProvinceEntity p_province) {
+	Stack *stack = stacks.getptr(p_province);
+	if (stack == nullptr)
+		return;
+	stack->dirty = false;
+
+	if (stack->count <= 0) {
+		_free_stack(*stack);
+		stacks.erase(p_province);
+		return;
+	}
+
+	// The marker uses the color of the country with the most units in the province.
+	const OwnerCount *top_owner = &stack->owners[0];
+	for (const OwnerCount &owner_count : stack->owners)
+		if (owner_count.count > top_owner->count)
+			top_owner = &owner_count;
+	const Color color = top_owner->owner.is_valid() and top_owner->owner.has<Color>() ? top_owner->owner.get<Color>() : Color(1, 1, 1);
+
+	if (stack->marker == MapUnits::INVALID_SLOT) {
+		ERR_FAIL_COND(!p_province.has<UnitLocator>());
+		const UnitLocator &locator = p_province.get<UnitLocator>();
+
+		Transform3D marker_transform;
+		marker_transform.origin = Vector3(locator.position.x, unit_map_layer, locator.position.y);
+		marker_transform.basis.scale(Vector3(locator.scale, locator.scale, locator.scale));
+		marker_transform.basis.rotate(Vector3(unit_x_rotation, locator.orientation, 0.0));
+		stack->marker = markers->add_unit(UnitEntity(), marker_transform, color);
+	} else {
+		markers->set_owner_color(stack->marker, color);
+	}
+
+	if (stack->count == stack->shown_count)
+		return;
+
+	if (font.rids.is_empty()) {
+		const Ref<Font> default_font = MapLabel::get_font_or_default();
+		ERR_FAIL_COND(default_font.is_null());
+		font.rids = default_font->get_rids();
+		font.opentype_features = default_font->get_opentype_features();
+	}
+
+	// Counts are only a few glyphs so they are shaped right away instead of on the MapLabelShaper.
+	LabelGlyphSurfaces surfaces;
+	AABB aabb;
+	MapLabel::shape_text(itos(stack->count), font, surfaces, aabb);
+
+	if (stack->count_label == MapLabelBatch::INVALID_LABEL) {
+		const Transform3D &marker_transform = markers->get_transform(stack->marker);
+		const Transform3D count_offset = Transform3D(Basis().scaled(Vector3(count_text_scale, count_text_scale, count_text_scale)), Vector3(0.0, count_text_offset, 0.01));
+		stack->count_label = MapLabelBatch::self->create_label(marker_transform * count_offset);
+	}
+
+	MapLabelBatch::self->set_label_glyphs(stack->count_label, surfaces);
+	MapLabelBatch::self->set_label_visible(stack->count_label, aggregated);
+	stack->shown_count = stack->count;
+}
+
+void UnitStacks::_free_stack(Stack &p_stack) {
+	if (p_stack.marker != MapUnits::INVALID_SLOT and markers != nullptr)
+		markers->remove_unit(p_stack.marker);
+	if (p_stack.count_label != MapLabelBatch::INVALID_LABEL and MapLabelBatch::self != nullptr)
+		MapLabelBatch::self->free_label(p_stack.count_label);
+
+	p_stack.marker = MapUnits::INVALID_SLOT;
+	p_stack.count_label = MapLabelBatch::INVALID_LABEL;
+	p_stack.shown_count = 0;
+}
+
+UnitStacks::~UnitStacks() { clear(); }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "core/templates/a_hash_map.h"
+
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
+
+#include "MapLabel.hpp"
+#include "MapUnits.hpp"
+
+namespace CG {
+
+// Replaces the units on the map with one stack marker per province when the camera is far away.
+// Each stack shows the number of units in the province and is colored by the country with the most units there.
+// Stacks are updated incrementally when a unit is added, removed or moves to another province, so the number of drawn instances is bounded by the number of provinces.
+class UnitStacks {
+public:
+	void create(const RID &p_scenario);
+	void clear();
+
+	void add_unit(UnitEntity p_unit, ProvinceEntity p_province);
+	void remove_unit(UnitEntity p_unit, ProvinceEntity p_province);
+	void move_unit(UnitEntity p_unit, ProvinceEntity p_from, ProvinceEntity p_to);
+
+	// Switch between units and stacks at this camera distance and upload the stacks that changed.
+	void update(float p_camera_distance);
+	bool is_aggregated() const;
+
+	~UnitStacks();
+
+private:
+	static constexpr float aggregate_camera_distance = 450.0; // Camera distance where units are replaced by stacks.
+	static constexpr float count_text_scale = 3.0;
+	static constexpr float count_text_offset = -0.9; // Offset of the count below the marker in marker space.
+
+	struct OwnerCount {
+		CountryEntity owner;
+		int count = 0;
+	};
+
+	struct Stack {
+		Vec<OwnerCount> owners;
+		int count = 0;
+		int shown_count = 0; // Count the label was shaped with.
+		bool dirty = false; // Already in dirty_provinces.
+		MapUnits::UnitSlot marker = MapUnits::INVALID_SLOT;
+		MapLabelBatch::LabelID count_label = MapLabelBatch::INVALID_LABEL;
+	};
+
+	MapUnits *markers = nullptr;
+	AHashMap<ProvinceEntity, Stack, EntityHasher> stacks;
+	Vec<ProvinceEntity> dirty_provinces;
+	MapLabel::LabelFont font;
+	bool aggregated = false;
+
+	void _invalidate(ProvinceEntity p_province, Stack &r_stack);
+	void _update_stack(ProvinceEntity p_province);
+	void _free_stack(Stack &p_stack);
+};
+
+} // namespace CG
@@ -2,11 +2,15 @@
 
 #include <cstdint>
 
+#include "core/math/vector4.h"
+
 #include "ecs/entity.hpp"
 #include "ecs/tags.hpp"
 
 namespace CG {
 
+using ProvinceIndex = int; // Index into the province lookup texture.
+
 enum class ProvinceAdjacencyType : uint8_t {
 	Water = 0, // both provinces are water
 	Land = 1, // both provinces are land
@@ -25,8 +29,41 @@ enum class ProvinceBorderType : uint8_t {
 	PROVINCE_BORDER_TYPE_MAX = 6
 };
 
-inline bool is_navigable_water_province(const Entity p_entity) { return p_entity.has<OceanProvinceTag>() or p_entity.has<RiverProvinceTag>(); }
+// Province type tags packed in a byte for the ProvinceTable.
+enum class ProvinceType : uint8_t {
+	None = 0, // no type tag
+	Land = 1,
+	Ocean = 2,
+	River = 3,
+	Lake = 4,
+	Impassable = 5,
+	Uninhabitable = 6,
+};
 
-inline bool is_impassable_province(const Entity p_entity) { return p_entity.has<ImpassableProvinceTag>() or p_entity.has<UninhabitableProvinceTag>(); }
+inline ProvinceType get_province_type(const Entity p_entity) {
+	if (p_entity.has<LandProvinceTag>())
+		return ProvinceType::Land;
+	else if (p_entity.has<OceanProvinceTag>())
+		return ProvinceType::Ocean;
+	else if (p_entity.has<RiverProvinceTag>())
+		return ProvinceType::River;
+	else if (p_entity.has<LakeProvinceTag>())
+		return ProvinceType::Lake;
+	else if (p_entity.has<ImpassableProvinceTag>())
+		return ProvinceType::Impassable;
+	else if (p_entity.has<UninhabitableProvinceTag>())
+		return ProvinceType::Uninhabitable;
+	else
+		return ProvinceType::None;
+}
+
+// One row of the province adjacency table, every pair of provinces that share a border or a crossing has one row.
+struct ProvinceAdjacency {
+	ProvinceEntity first;
+	ProvinceEntity second;
+	ProvinceAdjacencyType type = ProvinceAdjacencyType::Land;
+	uint32_t border_length = 0; // Shared border in pixels, 0 for crossings
+	Vector4 crossing_locator; // Start and end of the line drawn for a crossing
+};
 
 } // namespace CG
\ No newline at end of file
@@ -5,9 +5,11 @@
 
 #include "cg/Locator.hpp"
 
-namespace CG {
+#include "ecs/entity.hpp"
+
+#include "templates/Vec.hpp"
 
-class MapUnit;
+namespace CG {
 
 #define MAKE_SAME(m_class, m_type)                                                                                                                                                           \
 	m_type same_type_value;                                                                                                                                                                  \
@@ -40,10 +42,6 @@ struct LocKey {
 
 /* Province components */
 
-struct CrossingLocator {
-	MAKE_SAME(CrossingLocator, Vector4)
-};
-
 struct ProvinceBorderMeshRID {
 	MAKE_SAME(ProvinceBorderMeshRID, RID)
 };
@@ -57,8 +55,36 @@ struct Player {
 	MAKE_SAME(Player, Entity)
 };
 
+// Gold of a country, the economy phase of the Simulation adds the income every tick.
+struct Treasury {
+	double gold = 0.0;
+	float income = 0.0; // Gold per tick
+};
+
+/* Unit components */
+
+// Slot of the unit in the MapUnits multimesh
 struct UnitModel {
-	MAKE_SAME_PTR(UnitModel, MapUnit)
+	MAKE_SAME(UnitModel, uint32_t)
+};
+
+// Provinces a unit moves through, next is the index of the province it is moving to.
+struct UnitPath {
+	Vec<ProvinceEntity> provinces;
+	uint32_t next = 0;
+};
+
+// Movement towards the next province of the UnitPath.
+struct UnitProgress {
+	Vector2 target; // Map position of the UnitLocator of the next province
+	float speed = 2.0; // Map pixels per movement tick
+	bool arrived = false;
+};
+
+// Map position of a unit at the previous and current movement tick, the drawn position is interpolated between them.
+struct UnitPosition {
+	Vector2 previous;
+	Vector2 current;
 };
 
 #undef MAKE_SAME
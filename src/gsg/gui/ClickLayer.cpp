@@ -5,11 +5,12 @@
 #include "scene/3d/camera_3d.h"
 #include "scene/main/viewport.h"
 
+#include "cg/Map.hpp"
+#include "cg/MapUtils.hpp"
+
 #include "ecs/components.hpp"
 #include "ecs/ecs.hpp"
 
-#include "MapUnit.hpp"
-
 using namespace CG;
 
 void ClickLayer::_notification(int p_what) {
@@ -55,15 +56,14 @@ template void ClickLayer::update_selected_units<true>();
 
 template <bool is_click> void ClickLayer::update_selected_units() {
 	const CountryEntity player = ECS::self->get<Player>();
-	const RelationEntity unit_relation = ECS::self->get_relation(Relation::Unit);
-
-	UnitEntity unit;
-	int idx{};
-	Vector3 pos;
 	Viewport *vp = get_viewport();
+	const Camera3D *camera = vp->get_camera_3d();
+	MapUnits &map_units = *MapUnits::self;
+
+	// Only units near the click or under the selection box are looked at, the grid in MapUnits finds them.
+	candidate_units.clear();
 
 	if constexpr (is_click) {
-		const Camera3D *camera = vp->get_camera_3d();
 		const Vector2 mouse_position = vp->get_mouse_position();
 
 		const Vector3 origin = camera->project_ray_origin(mouse_position);
@@ -71,25 +71,74 @@ template <bool is_click> void ClickLayer::update_selected_units() {
 
 		const float distance = -origin.y / direction.y;
 		const Vector3 xz_pos = origin + direction * distance;
-		pos = Vector3(xz_pos.x, 15.0, xz_pos.z);
+		map_units.get_units_at_point(Vector3(xz_pos.x, unit_map_layer, xz_pos.z), candidate_units);
+
+		if (select_box.get_size() == Vector2(0, 0))
+			deselect_units();
+	} else {
+		Rect2 map_rect;
+		if (get_select_box_map_rect(camera, map_rect))
+			map_units.get_units_in_rect(map_rect, candidate_units);
+		else
+			map_units.get_units_in_rect(Rect2(Vector2(), Vector2(map_dimensions)), candidate_units);
+
+		deselect_units();
+
+		// Same projection as Camera3D::unproject_position but the camera matrices are only computed once for every unit.
+		const Projection camera_projection = camera->get_camera_projection();
+		const Transform3D view_transform = camera->get_camera_transform().affine_inverse();
+		const Vector2 viewport_size = vp->get_visible_rect().size;
+
+		for (uint32_t i = candidate_units.size(); i > 0; --i) {
+			const Vector3 view_position = view_transform.xform(map_units.get_transform(candidate_units[i - 1]).origin);
+			const Vector4 clip_position = camera_projection.xform(Vector4(view_position.x, view_position.y, view_position.z, 1.0));
+			const Vector2 screen_position = Vector2((clip_position.x / clip_position.w * 0.5 + 0.5) * viewport_size.x, (-clip_position.y / clip_position.w * 0.5 + 0.5) * viewport_size.y);
+
+			if (!select_box.has_point(screen_position))
+				candidate_units.remove_at_unordered(i - 1);
+		}
 	}
 
-	while ((unit = player.target(unit_relation, idx++))) {
-		MapUnit *unit_mesh = unit.get_mut<UnitModel>().ptr();
-
-		if constexpr (is_click) {
-			const AABB aabb = unit_mesh->get_global_transform().xform(unit_mesh->get_aabb());
-			if (aabb.has_point(pos)) {
-				unit_mesh->select();
-				vp->set_input_as_handled();
-			} else if (select_box.get_size() == Vector2(0, 0)) {
-				unit_mesh->deselect();
-			}
-		} else if (unit_mesh->is_inside_selection_box(select_box)) {
-			unit_mesh->select();
-			vp->set_input_as_handled();
-		} else {
-			unit_mesh->deselect();
-		}
+	for (const MapUnits::UnitSlot slot : candidate_units) {
+		if (ECS::self->get_target(map_units.get_unit(slot), Relation::Owner) != player or map_units.is_selected(slot))
+			continue;
+
+		map_units.set_selected(slot, true);
+		selected_units.push_back(slot);
+		vp->set_input_as_handled();
 	}
+
+	map_units.flush();
+}
+
+bool ClickLayer::get_select_box_map_rect(const Camera3D *p_camera, Rect2 &r_map_rect) const {
+	const Vector2 corners[4] = { select_box.position, Vector2(select_box.get_end().x, select_box.position.y), select_box.get_end(), Vector2(select_box.position.x, select_box.get_end().y) };
+
+	for (int i = 0; i < 4; ++i) {
+		const Vector3 origin = p_camera->project_ray_origin(corners[i]);
+		const Vector3 direction = p_camera->project_ray_normal(corners[i]);
+		if (direction.y >= 0.0)
+			return false;
+
+		const Vector3 map_position = origin + (direction * ((unit_map_layer - origin.y) / direction.y));
+		if (i == 0)
+			r_map_rect = Rect2(map_position.x, map_position.z, 0.0, 0.0);
+		else
+			r_map_rect.expand_to(Vector2(map_position.x, map_position.z));
+	}
+
+	return true;
+}
+
+void ClickLayer::deselect_units() {
+	for (const MapUnits::UnitSlot slot : selected_units)
+		MapUnits::self->set_selected(slot, false);
+	selected_units.clear();
+}
+
+void ClickLayer::clear_selection() {
+	selected_units.clear();
+	candidate_units.clear();
+	selecting = false;
+	queue_redraw();
 }
@@ -2,6 +2,10 @@
 
 #include "scene/main/canvas_item.h"
 
+#include "cg/MapUnits.hpp"
+
+class Camera3D;
+
 namespace CG {
 
 class ClickLayer : public CanvasItem {
@@ -12,6 +16,10 @@ protected:
 	void _notification(int p_what);
 	void unhandled_input(const Ref<InputEvent> &p_event) final;
 
+public:
+	// Forget the selected units without deselecting them, their slots belong to the MapUnits of a map that is being replaced.
+	void clear_selection();
+
 #ifdef TOOLS_ENABLED
 public:
 	void _edit_set_position(const Point2 &p_position) final {};
@@ -23,10 +31,15 @@ public:
 
 private:
 	template <bool is_click> void update_selected_units();
+	// Map space bounds of the selection box projected onto the unit layer, false if part of the box doesn't hit the map.
+	bool get_select_box_map_rect(const Camera3D *p_camera, Rect2 &r_map_rect) const;
+	void deselect_units();
 
 	bool selecting = false;
 	Vector2 drag_start;
 	Rect2 select_box;
+	Vec<MapUnits::UnitSlot> selected_units;
+	Vec<MapUnits::UnitSlot> candidate_units;
 };
 
 } // namespace CG
@@ -1,6 +1,8 @@
 #include "Map3D.hpp"
 
 #include "core/input/input_event.h"
+#include "core/io/file_access.h"
+#include "core/os/os.h"
 
 #include "scene/3d/camera_3d.h"
 #include "scene/3d/mesh_instance_3d.h"
@@ -11,10 +13,13 @@
 #include "cg/MapMode.hpp"
 #include "cg/MapUtils.hpp"
 #include "cg/NodeManager.hpp"
+#include "cg/SaveGame.hpp"
+#include "cg/Simulation.hpp"
 
 #include "ecs/components.hpp"
 #include "ecs/tags.hpp"
 
+#include "gui/ClickLayer.hpp"
 #include "gui/Hud.hpp"
 
 using namespace CG;
@@ -32,14 +37,25 @@ void Map3D::_notification(int p_what) {
 
 			// Load map
 			set_process_unhandled_input(true);
-			Map::self = memnew(Map);
-			Map::self->load_map<false>(this);
+			set_process(true);
 			map_mesh = Object::cast_to<MeshInstance3D>(get_node(NodePath("%MapMesh")));
-
-			const Ref<ShaderMaterial> material = map_mesh->get_mesh()->surface_get_material(0);
-
-			material->set_shader_parameter("color_texture", Map::self->get_map_mode<MapMode::Country>());
-			material->set_shader_parameter("lookup_texture", Map::self->get_lookup_texture());
+			_load_map(String());
+
+			if (OS::get_singleton()->get_cmdline_user_args().has("--benchmark-transfers") and _write_benchmark_save() == OK) {
+				_load_map(benchmark_save_path, benchmark_map_data_path);
+				Map::self->benchmark_transfers(1000, 100);
+			}
+			if (OS::get_singleton()->get_cmdline_user_args().has("--benchmark-simulation"))
+				Simulation::benchmark(100000, 1000, 200);
+			if (OS::get_singleton()->get_cmdline_user_args().has("--benchmark-save"))
+				_benchmark_save();
+			if (OS::get_singleton()->get_cmdline_user_args().has("--benchmark-entity-creation"))
+				_benchmark_entity_creation();
+		} break;
+		case NOTIFICATION_PROCESS: {
+			Map::self->update_labels();
+			Map::self->update_transfers();
+			Map::self->update_units(get_process_delta_time());
 		} break;
 		case NOTIFICATION_EXIT_TREE: {
 			NM::clear_temporary_nodes();
@@ -48,7 +64,71 @@ void Map3D::_notification(int p_what) {
 	}
 }
 
+void Map3D::_load_map(const String &p_save_path, const String &p_map_data_path) {
+	// The whole map is created again, the old map frees its labels, units and borders first.
+	// Selected unit slots index the MapUnits of the old map so the selection is dropped with it.
+	if (ClickLayer *click_layer = Object::cast_to<ClickLayer>(get_node_or_null(NodePath("ClickLayer"))))
+		click_layer->clear_selection();
+	memdelete_notnull(Map::self);
+	Map::self = memnew(Map);
+	Map::self->load_map<false>(this, p_save_path, p_map_data_path.is_empty() ? String(Map::default_map_data_path) : p_map_data_path);
+
+	const Ref<ShaderMaterial> material = map_mesh->get_mesh()->surface_get_material(0);
+
+	material->set_shader_parameter("color_texture", Map::self->get_map_mode<MapMode::Country>());
+	material->set_shader_parameter("lookup_texture", Map::self->get_lookup_texture());
+	material->set_shader_parameter("selection_texture", Map::self->get_selection_texture());
+}
+
+Error Map3D::_write_benchmark_save() {
+	static constexpr uint32_t province_count = 20000;
+	const Error err = SaveGame::generate(province_count, 1000, 50000).save(benchmark_save_path);
+	return err == OK ? SaveGame::generate_map_data(province_count)->save(benchmark_map_data_path) : err;
+}
+
+void Map3D::_benchmark_save() {
+	ERR_FAIL_COND(_write_benchmark_save() != OK);
+
+	// Loading prints the entity creation time and save_game() prints the total save time.
+	const uint64_t start_time = OS::get_singleton()->get_ticks_usec();
+	SaveGame loaded_save;
+	ERR_FAIL_COND(loaded_save.load(benchmark_save_path) != OK);
+	print_line("Read ", loaded_save.provinces.size(), " provinces and ", loaded_save.units.size(), " units from ", benchmark_save_path, " in ", (OS::get_singleton()->get_ticks_usec() - start_time) / 1000.0, " ms");
+
+	_load_map(benchmark_save_path, benchmark_map_data_path);
+	Map::self->save_game(benchmark_save_path);
+}
+
+void Map3D::_benchmark_entity_creation() {
+	// The benchmark resets the world so it runs on an empty map that is replaced afterwards.
+	memdelete_notnull(Map::self);
+	Map::self = memnew(Map);
+	Map::self->benchmark_entity_creation(20000, 500, 500);
+	_load_map(String());
+}
+
 void Map3D::unhandled_input(const Ref<InputEvent> &p_event) {
+	// Designers reload the map configs while the game keeps running, F6 and F9 quicksave and quickload the map.
+	const Ref<InputEventKey> key = p_event;
+	if (key.is_valid() and key->is_pressed() and !key->is_echo()) {
+		switch (key->get_keycode()) {
+			case Key::F5: {
+				Map::self->reload_map_config();
+			} break;
+			case Key::F6: {
+				Map::self->save_game(quicksave_path);
+			} break;
+			case Key::F9: {
+				if (FileAccess::exists(quicksave_path))
+					_load_map(quicksave_path);
+			} break;
+			default: return;
+		}
+
+		get_viewport()->set_input_as_handled();
+		return;
+	}
+
 	const Ref<InputEventMouseButton> mb = p_event;
 	if (!mb.is_valid() or !mb->is_released() or (mb->get_button_index() != MouseButton::LEFT and mb->get_button_index() != MouseButton::RIGHT))
 		return;
@@ -67,7 +147,7 @@ void Map3D::unhandled_input(const Ref<InputEvent> &p_event) {
 	if (province_id == 0)
 		return;
 
-	const ProvinceEntity province_entity = ECS::self->scope_lookup(Scope::Province, uitos(province_id));
+	const ProvinceEntity province_entity = Map::self->get_province_entity(province_id);
 	ECS &ecs = *ECS::self;
 	if (mb->is_ctrl_pressed() and ecs.has_relation(province_entity, Relation::Owner)) {
 		const CountryEntity owner = ecs.get_target(province_entity, Relation::Owner);
@@ -85,38 +165,30 @@ void Map3D::unhandled_input(const Ref<InputEvent> &p_event) {
 		return;
 	}
 
-	if (!province_entity.has<LandProvinceTag>())
+	if (Map::self->get_province_table().get_type(province_id) != ProvinceType::Land)
 		return;
 
-	const Ref<ShaderMaterial> material = map_mesh->get_mesh()->surface_get_material(0);
-	PackedColorArray selected_areas;
-
-	if (mb->get_button_index() == MouseButton::RIGHT) {
-		if (!ecs.has_relation(province_entity, Relation::Owner))
-			return;
-
-		const CountryEntity owner = ecs.get_target(province_entity, Relation::Owner);
-		const RelationEntity province_relation = ecs.get_relation(Relation::Province);
+	if (mb->get_button_index() == MouseButton::RIGHT and Map::self->move_selected_units(province_entity)) {
+		vp->set_input_as_handled();
+		return;
+	}
 
-		ProvinceEntity entity;
-		int idx = 0;
+	if (mb->get_button_index() == MouseButton::RIGHT and !ecs.has_relation(province_entity, Relation::Owner))
+		return;
 
-		while ((entity = owner.target(province_relation, idx++))) {
-			const int p_id = atoi(entity.name());
-			const auto kv = Map::self->get_color_to_id_map().get_by_index(p_id - 1); // province ids start at 1
-			selected_areas.push_back(kv.key.linear_to_srgb());
-		}
+	Map &map = *Map::self;
+	map.clear_selection();
 
-		material->set_shader_parameter("selected_areas", selected_areas);
-		material->set_shader_parameter("selected_areas_total", selected_areas.size());
-		vp->set_input_as_handled();
-		return;
+	if (mb->get_button_index() == MouseButton::RIGHT) {
+		const CountryEntity owner = ecs.get_target(province_entity, Relation::Owner);
+		for (const ProvinceIndex owned_province : map.get_country_provinces(owner))
+			map.select_province(owned_province);
 	} else {
-		selected_areas.push_back(province_color.linear_to_srgb());
-		material->set_shader_parameter("selected_areas", selected_areas);
-		material->set_shader_parameter("selected_areas_total", 1);
-		vp->set_input_as_handled();
+		map.select_province(province_id);
 	}
+
+	map.update_selection_texture();
+	vp->set_input_as_handled();
 }
 
 void Map3D::set_map_mode(MapMode p_map_mode) {
@@ -132,5 +204,6 @@ void Map3D::set_map_mode(MapMode p_map_mode) {
 		case MapMode::Region: {
 			material->set_shader_parameter("color_texture", Map::self->get_map_mode<MapMode::Region>());
 		} break;
+		case MapMode::MAP_MODE_MAX: break;
 	}
 }
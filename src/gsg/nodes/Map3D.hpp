@@ -14,6 +14,19 @@ class Map3D : public Node3D {
 private:
 	MeshInstance3D *map_mesh{};
 	static inline Vector2i map_dimensions{ 1024, 1024 }; // TODO don't hardcode.
+	static constexpr const char *quicksave_path = "user://quicksave.sav";
+	static constexpr const char *benchmark_save_path = "user://benchmark.sav";
+	static constexpr const char *benchmark_map_data_path = "user://benchmark_map_data.cfg";
+
+	// Create a new Map from the map configs, or from a save file if p_save_path isn't empty. An empty p_map_data_path reads the baked map data of the sample map.
+	void _load_map(const String &p_save_path, const String &p_map_data_path = String());
+	// Write a synthetic world with 20000 provinces, 1000 countries and 50000 units to benchmark_save_path and its borders and adjacencies to benchmark_map_data_path,
+	// benchmarks load it instead of the much smaller sample map.
+	static Error _write_benchmark_save();
+	// Print the times to load the synthetic world and save it again.
+	void _benchmark_save();
+	// Print the times to create a synthetic world with 20000 provinces one entity at a time and in bulk, then load the map configs again.
+	void _benchmark_entity_creation();
 
 protected:
 	static void _bind_methods();
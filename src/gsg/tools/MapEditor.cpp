@@ -40,6 +40,9 @@ void MapEditorNode::load_map() {
 	Map::self->load_map_editor(this);
 
 	map_mesh = Object::cast_to<MeshInstance3D>(get_node(NodePath("%MapMesh")));
+	const Ref<ShaderMaterial> material = map_mesh->get_mesh()->surface_get_material(0);
+	material->set_shader_parameter("selection_texture", Map::self->get_selection_texture());
+
 	memnew(EditorLocators());
 
 	has_loaded_map = true;
@@ -103,6 +106,13 @@ void MapEditor::_locator_button_toggled(bool p_toggled) {
 
 void MapEditor::_province_selection_button_toggled(bool p_toggled) { province_selection_enabled = p_toggled; }
 
+void MapEditor::_place_labels_button_pressed() {
+	// Deselecting saves the edited locators first so the nodes can't overwrite the new placement afterwards.
+	deselect_all_map_provinces();
+	const int count = EditorLocators::self->apply_label_placement();
+	print_line("Placed ", count, " text locators from the baked label placement");
+}
+
 void MapEditor::province_inspector_item_list_multi_selected(int p_index, bool p_selected) {
 	if (p_selected) {
 		MapEditorPlugin::self->select_province(p_index + 1);
@@ -338,6 +348,14 @@ MapEditor::MapEditor() :
 
 	map_object_toolbar_container->add_child(map_object_toolbar_province_selection_button);
 
+	// Text locators are only seeded from the label placement bake when they are new, this places all of them again.
+	map_object_toolbar_place_labels_button = memnew(Button());
+	add_tool_button(map_object_toolbar_place_labels_button, "Place Labels From Map Data");
+	map_object_toolbar_place_labels_button->set_toggle_mode(false);
+	map_object_toolbar_place_labels_button->set_text("Place Labels");
+	map_object_toolbar_place_labels_button->connect("pressed", callable_mp(this, &MapEditor::_place_labels_button_pressed));
+	map_object_toolbar_container->add_child(map_object_toolbar_place_labels_button);
+
 	map_object_toolbar_container->set_custom_minimum_size(Vector2(20, 0));
 	Node3DEditor::get_singleton()->add_control_to_menu_panel(map_object_toolbar_container);
 
@@ -398,39 +416,13 @@ String MapEditorPlugin::get_plugin_name() const { return "MapEditor"; }
 bool MapEditorPlugin::has_main_screen() const { return false; }
 
 void MapEditorPlugin::select_province(const int p_province_id) {
-	const ProvinceColorMap &map = Map::self->get_color_to_id_map();
-
-	// Find key from value and apply it to the shader
-	for (const KeyValue<Color, int> &kv : map) {
-		if (kv.value == p_province_id) {
-			const Color srgb_province_color = kv.key.linear_to_srgb();
-			selected_areas.push_back(srgb_province_color);
-
-			const Ref<ShaderMaterial> material = map_editor_node->map_mesh->get_mesh()->surface_get_material(0);
-			material->set_shader_parameter("selected_areas", selected_areas);
-			material->set_shader_parameter("selected_areas_total", MAX(10, selected_areas.size()));
-
-			return;
-		}
-	}
+	Map::self->select_province(p_province_id);
+	Map::self->update_selection_texture();
 }
 
 void MapEditorPlugin::deselect_province(int p_province_id) {
-	const ProvinceColorMap &map = Map::self->get_color_to_id_map();
-
-	// Find key from value and apply it to the shader
-	for (const KeyValue<Color, int> &kv : map) {
-		if (kv.value == p_province_id) {
-			const Color &srgb_province_color = kv.key.linear_to_srgb();
-			selected_areas.erase(srgb_province_color);
-
-			const Ref<ShaderMaterial> material = map_editor_node->map_mesh->get_mesh()->surface_get_material(0);
-			material->set_shader_parameter("selected_areas", selected_areas);
-			material->set_shader_parameter("selected_areas_total", MAX(10, selected_areas.size()));
-
-			return;
-		}
-	}
+	Map::self->deselect_province(p_province_id);
+	Map::self->update_selection_texture();
 }
 
 EditorPlugin::AfterGUIInput MapEditorPlugin::forward_3d_gui_input(Camera3D *p_camera, const Ref<InputEvent> &p_event) {
@@ -467,34 +459,32 @@ EditorPlugin::AfterGUIInput MapEditorPlugin::forward_3d_gui_input(Camera3D *p_ca
 		if (province_id == 0)
 			return AFTER_GUI_INPUT_CUSTOM;
 
-		const Color srgb_province_color = province_color.linear_to_srgb();
+		Map &map = *Map::self;
 
 		// If not holding shift only allow selection of 1 province
 		if (!mb->is_shift_pressed()) {
 			// If already selected and pressed again remove from selected areas.
-			if (selected_areas.has(srgb_province_color)) {
-				selected_areas.erase(srgb_province_color);
+			if (map.is_province_selected(province_id)) {
+				map.deselect_province(province_id);
 				map_editor->on_map_province_deselected(province_id);
 			} else {
 				map_editor->deselect_all_map_provinces();
-				selected_areas.clear();
-				selected_areas.push_back(srgb_province_color);
+				map.clear_selection();
+				map.select_province(province_id);
 				map_editor->on_map_province_selected(province_id);
 			}
 		} else {
 			// If already selected and pressed again remove from selected areas.
-			if (selected_areas.has(srgb_province_color)) {
-				selected_areas.erase(srgb_province_color);
+			if (map.is_province_selected(province_id)) {
+				map.deselect_province(province_id);
 				map_editor->on_map_province_deselected(province_id);
 			} else {
-				selected_areas.push_back(srgb_province_color);
+				map.select_province(province_id);
 				map_editor->on_map_province_selected(province_id);
 			}
 		}
 
-		const Ref<ShaderMaterial> material = map_editor_node->map_mesh->get_mesh()->surface_get_material(0);
-		material->set_shader_parameter("selected_areas", selected_areas);
-		material->set_shader_parameter("selected_areas_total", MAX(10, selected_areas.size()));
+		map.update_selection_texture();
 
 		return EditorPlugin::AFTER_GUI_INPUT_CUSTOM;
 	}
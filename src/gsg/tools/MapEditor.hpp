@@ -73,6 +73,7 @@ private:
 
 	Button *map_object_button{};
 	Button *map_object_toolbar_province_selection_button{};
+	Button *map_object_toolbar_place_labels_button{};
 
 	enum class ActiveToolbar : uint8_t { None, MapObject };
 
@@ -83,6 +84,7 @@ private:
 
 	void _locator_button_toggled(bool p_toggled);
 	void _province_selection_button_toggled(bool p_toggled);
+	void _place_labels_button_pressed();
 	void province_inspector_item_list_multi_selected(int p_index, bool p_selected);
 	void province_inspector_item_list_node_selected(int p_index);
 
@@ -126,9 +128,6 @@ public:
 class MapEditorPlugin : public EditorPlugin {
 	GDCLASS(MapEditorPlugin, EditorPlugin);
 
-private:
-	PackedColorArray selected_areas;
-
 public:
 	MapEditor *map_editor{};
 	static inline MapEditorNode *map_editor_node{};